@@ -0,0 +1,155 @@
+#pragma once
+
+/* Tiny benchmark harness: calibrated batches, repeated samples, table + JSON output */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <types.hpp>
+
+// keeps the compiler from throwing away a result it thinks nobody reads
+template <typename T>
+inline void doNotOptimize(const T& value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchResult {
+	std::string name;
+	// calls per sample, picked so a sample runs for at least Bench.min_sample_ms
+	usize batch;
+	// one per sample
+	std::vector<double> ns_per_op;
+	double median;
+	double mean;
+	double stddev;
+	double min;
+	double max;
+};
+
+struct Bench {
+	std::string title;
+	std::vector<BenchResult> results;
+	int samples;
+	double min_sample_ms;
+	// only run benchmarks whose name contains this
+	std::string filter;
+	// empty for no JSON
+	std::string json_path;
+
+	// usage: <bench> [--samples N] [--min-ms MS] [--filter STR] [--json FILE], anything else is
+	// left in `args` for the benchmark itself
+	static Bench init(const std::string& title, int argc, char **argv, std::vector<std::string>& args) {
+		Bench bench = {};
+		bench.title = title;
+		bench.samples = 15;
+		bench.min_sample_ms = 10.0;
+		for (int i = 1; i < argc; i++) {
+			if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+				bench.samples = std::max(std::stoi(argv[++i]), 1);
+			} else if (std::strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc) {
+				bench.min_sample_ms = std::stod(argv[++i]);
+			} else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+				bench.filter = argv[++i];
+			} else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+				bench.json_path = argv[++i];
+			} else {
+				args.push_back(argv[i]);
+			}
+		}
+		return bench;
+	}
+
+	bool enabled(const std::string& name) const {
+		return this->filter.empty() || name.find(this->filter) != std::string::npos;
+	}
+
+	// `f` is one operation. returns the median ns/op, or 0 if filtered out
+	template <typename F>
+	double run(const std::string& name, F f) {
+		if (!this->enabled(name)) {
+			return 0.0;
+		}
+		auto timeBatch = [&](usize batch) {
+			auto start = chrono::steady_clock::now();
+			for (usize i = 0; i < batch; i++) {
+				f();
+			}
+			return chrono::duration<double, std::nano>(chrono::steady_clock::now() - start).count();
+		};
+
+		// double the batch until one takes long enough to drown out the clock
+		usize batch = 1;
+		while (timeBatch(batch) < this->min_sample_ms * 1e6 && batch < (usize(1) << 40)) {
+			batch *= 2;
+		}
+
+		BenchResult result = {};
+		result.name = name;
+		result.batch = batch;
+		for (int s = 0; s < this->samples; s++) {
+			result.ns_per_op.push_back(timeBatch(batch) / batch);
+		}
+
+		std::vector<double> sorted = result.ns_per_op;
+		std::sort(sorted.begin(), sorted.end());
+		const usize n = sorted.size();
+		result.median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+		result.min = sorted.front();
+		result.max = sorted.back();
+		double sum = 0.0;
+		for (double v : sorted) {
+			sum += v;
+		}
+		result.mean = sum / n;
+		double var = 0.0;
+		for (double v : sorted) {
+			var += (v - result.mean) * (v - result.mean);
+		}
+		result.stddev = n > 1 ? std::sqrt(var / (n - 1)) : 0.0;
+
+		std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(1)
+			  << std::setw(14) << result.median << " ns/op"
+			  << "  ±" << std::setprecision(1) << (result.mean > 0.0 ? 100.0 * result.stddev / result.mean : 0.0) << "%"
+			  << "  (min " << result.min << ", max " << result.max << ", " << this->samples << "x" << batch << ")"
+			  << std::defaultfloat << std::endl;
+		this->results.push_back(result);
+		return result.median;
+	}
+
+	// for reporting something that isn't a timing loop alongside the rest
+	void note(const std::string& name, const std::string& value) const {
+		std::cout << std::left << std::setw(48) << name << std::right << std::setw(14) << value << std::endl;
+	}
+
+	bool writeJson() const {
+		if (this->json_path.empty()) {
+			return true;
+		}
+		std::ofstream file(this->json_path);
+		if (!file) {
+			std::cerr << "bench(error): can't write " << this->json_path << std::endl;
+			return false;
+		}
+		file << "{\"bench\":\"" << this->title << "\",\"unit\":\"ns/op\",\"results\":[";
+		for (usize i = 0; i < this->results.size(); i++) {
+			const BenchResult& r = this->results[i];
+			file << (i > 0 ? ",\n" : "\n")
+			     << "{\"name\":\"" << r.name << "\",\"median\":" << r.median << ",\"mean\":" << r.mean
+			     << ",\"stddev\":" << r.stddev << ",\"min\":" << r.min << ",\"max\":" << r.max
+			     << ",\"batch\":" << r.batch << ",\"samples\":[";
+			for (usize s = 0; s < r.ns_per_op.size(); s++) {
+				file << (s > 0 ? "," : "") << r.ns_per_op[s];
+			}
+			file << "]}";
+		}
+		file << "\n]}" << std::endl;
+		std::cerr << "bench(info): wrote " << this->results.size() << " results to " << this->json_path << std::endl;
+		return true;
+	}
+};
@@ -0,0 +1,130 @@
+/* Collision broadphase cost against the number of placed objects: spatial hash pairs vs testing every object.
+   Objects are placed at a constant density so the world grows with them, the way a bigger level would.
+   The first argument is the grid cell size */
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <broadphase.hpp>
+#include <bench.hpp>
+
+#define BENCH_DYNAMIC 64
+// dynamic bodies go around a loop of this many steps, so a bench.run() can go on as long as it likes
+#define BENCH_STEPS 100
+
+int main(int argc, char** argv) {
+	std::vector<std::string> args;
+	Bench bench = Bench::init("broadphase", argc, argv, args);
+	const float cell_size = args.size() > 0 ? std::stof(args[0]) : 2.0f;
+	bool ok = true;
+
+	std::cout << "cell size " << cell_size << ", " << BENCH_DYNAMIC << " dynamic bodies, " << BENCH_STEPS << " steps" << std::endl;
+	for (uint n : { 1000u, 10000u, 50000u }) {
+		const std::string objects = " " + std::to_string(n) + " objects";
+		std::mt19937 rng(1234);
+		// about one object per 16 square units
+		const float half = std::sqrt(n * 16.0f) / 2.0f;
+		std::uniform_real_distribution<float> pos(-half, half);
+		std::uniform_real_distribution<float> size(0.2f, 1.5f);
+		std::uniform_real_distribution<float> radius(2.0f, 5.0f);
+
+		std::vector<Box> boxes;
+		auto randomBox = [&](float y) {
+			vec3 c = vec3(pos(rng), y, pos(rng));
+			vec3 e = vec3(size(rng));
+			return Box{ .min = c - e, .max = c + e };
+		};
+		for (uint i = 0; i < n; i++) {
+			boxes.push_back(randomBox(0.0f));
+		}
+		// one huge one, like the island
+		boxes.push_back({ .min = vec3(-half, -2.0f, -half), .max = vec3(half, -1.0f, half) });
+		const usize n_static = boxes.size();
+
+		bench.run("broadphase/insert" + objects, [&] {
+			SpatialHash fresh = SpatialHash::init(cell_size);
+			for (usize i = 0; i < n_static; i++) {
+				fresh.insert(boxes[i], false);
+			}
+			doNotOptimize(fresh.cells.size());
+		});
+
+		SpatialHash hash = SpatialHash::init(cell_size);
+		for (usize i = 0; i < n_static; i++) {
+			hash.insert(boxes[i], false);
+		}
+		// each dynamic body's box at every step of its loop, a circle around where it starts
+		std::vector<uint> dynamic;
+		std::vector<std::vector<Box>> path(BENCH_STEPS);
+		for (uint i = 0; i < BENCH_DYNAMIC; i++) {
+			boxes.push_back(randomBox(0.0f));
+			dynamic.push_back(hash.insert(boxes.back(), true));
+			const float r = radius(rng);
+			for (uint s = 0; s < BENCH_STEPS; s++) {
+				const float angle = 6.2832f * s / BENCH_STEPS;
+				path[s].push_back(boxes.back().translate(vec3(std::cos(angle) - 1.0f, 0.0f, std::sin(angle)) * r));
+			}
+		}
+		uint next = 0;
+		auto move = [&] {
+			for (uint k = 0; k < BENCH_DYNAMIC; k++) {
+				boxes[dynamic[k]] = path[next][k];
+				hash.update(dynamic[k], boxes[dynamic[k]]);
+			}
+			next = (next + 1) % BENCH_STEPS;
+		};
+
+		std::vector<BodyPair> pairs, brute;
+		// what detectObj() over every object amounts to
+		auto bruteForce = [&] {
+			brute.clear();
+			for (uint a : dynamic) {
+				for (uint b = 0; b < boxes.size(); b++) {
+					if (b != a && !(hash.bodies[b].dynamic && b < a) && boxes[a].overlaps(boxes[b])) {
+						brute.push_back({ a, b });
+					}
+				}
+			}
+		};
+
+		// once around the loop untimed, the grid has to find exactly what testing everything does
+		usize n_pairs = 0;
+		for (uint s = 0; s < BENCH_STEPS; s++) {
+			move();
+			pairs.clear();
+			hash.pairs(pairs);
+			bruteForce();
+			n_pairs += pairs.size();
+			std::sort(pairs.begin(), pairs.end());
+			std::sort(brute.begin(), brute.end());
+			ok = ok && pairs == brute;
+		}
+		bench.note("cells" + objects, std::to_string(hash.cells.size()));
+		bench.note("pairs/step" + objects, std::to_string(n_pairs / BENCH_STEPS));
+
+		const usize moves = hash.moves, updates = hash.updates;
+		bench.run("broadphase/update x" + std::to_string(BENCH_DYNAMIC) + objects, move);
+		if (hash.updates > updates) {
+			bench.note("changed cells/update" + objects, std::to_string(100 * (hash.moves - moves) / (hash.updates - updates)) + "%");
+		}
+		bench.run("broadphase/pairs" + objects, [&] {
+			pairs.clear();
+			hash.pairs(pairs);
+			doNotOptimize(pairs.data());
+		});
+		bench.run("broadphase/brute force" + objects, [&] {
+			bruteForce();
+			doNotOptimize(brute.data());
+		});
+	}
+	if (!ok) {
+		std::cerr << "broadphase(error): pairs don't match brute force" << std::endl;
+	}
+	return bench.writeJson() && ok ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+/* Scene BVH build, refit and query throughput over synthetic placed objects */
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <bvh.hpp>
+#include <bench.hpp>
+
+int main(int argc, char** argv) {
+	std::vector<std::string> args;
+	Bench bench = Bench::init("bvh", argc, argv, args);
+	const uint n = args.size() > 0 ? std::stoul(args[0]) : 100000;
+	const uint n_queries = 10000;
+	const uint n_threads = args.size() > 1 ? std::stoul(args[1]) : std::max(std::thread::hardware_concurrency(), 1u);
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> pos(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> size(0.2f, 3.0f);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	std::vector<Box> boxes;
+	boxes.reserve(n);
+	for (uint i = 0; i < n; i++) {
+		vec3 c = vec3(pos(rng), pos(rng) * 0.05f, pos(rng));
+		vec3 e = vec3(size(rng));
+		boxes.push_back({ .min = c - e, .max = c + e });
+	}
+
+	// one thread, then all of them
+	std::vector<uint> counts = { 1 };
+	if (n_threads > 1) {
+		counts.push_back(n_threads);
+	}
+
+	SceneBVH bvh = SceneBVH::init(boxes, n_threads);
+	const std::string objects = " " + std::to_string(n) + " objects";
+	bench.note("nodes" + objects, std::to_string(bvh.nodes.size()) + ", " + std::to_string(bvh.max_depth) + " deep");
+	bench.note("sah cost" + objects, std::to_string(bvh.built_cost));
+	for (uint threads : counts) {
+		bench.run("bvh/build" + objects + " (" + std::to_string(threads) + (threads == 1 ? " thread)" : " threads)"), [&] {
+			SceneBVH built = SceneBVH::init(boxes, threads);
+			doNotOptimize(built.nodes.data());
+		});
+	}
+
+	// 10% of the objects move a bit, there and back again so a long run doesn't wander off
+	std::vector<uint> movers;
+	std::vector<vec3> offsets;
+	for (uint i = 0; i < n; i += 10) {
+		movers.push_back(i);
+		offsets.push_back(vec3(unit(rng), 0.0f, unit(rng)));
+	}
+	float direction = 1.0f;
+	auto move = [&] {
+		for (usize m = 0; m < movers.size(); m++) {
+			bvh.update(movers[m], bvh.boxes[movers[m]].translate(offsets[m] * direction));
+		}
+		direction = -direction;
+	};
+	move();
+	// update() keeps the cost maintain() looks at current, refit() recomputes it from scratch
+	const float updated_cost = bvh.cost;
+	bvh.refit();
+	std::ostringstream cost;
+	cost << updated_cost << " (refit says " << bvh.cost << ", rebuild at " << bvh.rebuild_ratio * bvh.built_cost << ")";
+	bench.note("sah cost after moves" + objects, cost.str());
+
+	bench.run("bvh/update x" + std::to_string(movers.size()) + objects, move);
+	bench.run("bvh/refit" + objects, [&] {
+		bvh.refit();
+		doNotOptimize(bvh.cost);
+	});
+
+	mat4 proj = glm::perspective(glm::radians(90.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+	mat4 view = glm::lookAt(vec3(0.0f, 2.0f, 0.0f), vec3(1.0f, 2.0f, -1.0f), vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = Frustum::init(proj * view);
+
+	// the tree has to find exactly what testing every box does
+	std::vector<uint> out;
+	bvh.queryFrustum(frustum, out);
+	const usize frustum_hits = out.size();
+	usize brute_hits = 0;
+	for (const auto& box : bvh.boxes) {
+		brute_hits += frustum.testBox(box.center(), box.extent());
+	}
+	bench.note("check/frustum hits", std::to_string(frustum_hits) + " (brute force " + std::to_string(brute_hits) + ")");
+
+	bench.run("bvh/frustum query" + objects, [&] {
+		out.clear();
+		bvh.queryFrustum(frustum, out);
+		doNotOptimize(out.data());
+	});
+
+	std::vector<Box> query_boxes;
+	std::vector<vec3> ray_origins, ray_dirs;
+	for (uint i = 0; i < n_queries; i++) {
+		vec3 c = vec3(pos(rng), 0.0f, pos(rng));
+		query_boxes.push_back({ .min = c - vec3(5.0f), .max = c + vec3(5.0f) });
+		ray_origins.push_back(vec3(pos(rng), 10.0f, pos(rng)));
+		ray_dirs.push_back(glm::normalize(vec3(unit(rng), -0.2f, unit(rng))));
+	}
+
+	uint next = 0;
+	bench.run("bvh/box query" + objects, [&] {
+		out.clear();
+		bvh.queryBox(query_boxes[next], out);
+		next = (next + 1) % n_queries;
+		doNotOptimize(out.data());
+	});
+	next = 0;
+	bench.run("bvh/raycast" + objects, [&] {
+		RayHit hit;
+		doNotOptimize(bvh.raycast(ray_origins[next], ray_dirs[next], 1000.0f, hit));
+		next = (next + 1) % n_queries;
+	});
+
+	return bench.writeJson() && frustum_hits == brute_hits ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+/* Frustum culling over a synthetic scene, SIMD against the scalar reference. No window or GL context needed.
+   The first argument is the box count */
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <cull.hpp>
+#include <bench.hpp>
+
+int main(int argc, char** argv) {
+	std::vector<std::string> args;
+	Bench bench = Bench::init("cull", argc, argv, args);
+	const usize n = args.size() > 0 ? std::stoul(args[0]) : 1000000;
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> pos(-200.0f, 200.0f);
+	std::uniform_real_distribution<float> size(0.1f, 4.0f);
+
+	CullBoxes boxes;
+	boxes.reserve(n);
+	for (usize i = 0; i < n; i++) {
+		vec3 c = vec3(pos(rng), pos(rng) * 0.1f, pos(rng));
+		vec3 e = vec3(size(rng), size(rng), size(rng));
+		boxes.push({ .min = c - e, .max = c + e });
+	}
+
+	mat4 proj = glm::perspective(glm::radians(90.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+	mat4 view = glm::lookAt(vec3(0.0f, 2.0f, 0.0f), vec3(1.0f, 2.0f, -1.0f), vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = Frustum::init(proj * view);
+
+	std::vector<uchar> visible, reference((n + 7) / 8);
+	cullBoxesScalar(frustum, boxes, 0, reference);
+	const CullStats stats = cullBoxes(frustum, boxes, visible);
+
+	usize mismatches = 0;
+	for (usize i = 0; i < n; i++) {
+		mismatches += isVisible(visible, i) != isVisible(reference, i);
+	}
+	const std::string suffix = " " + std::to_string(n) + " boxes";
+	bench.note("submitted" + suffix, std::to_string(stats.submitted()) + " of " + std::to_string(stats.tested));
+	bench.note("check/simd differing from scalar", std::to_string(mismatches));
+
+	bench.run("cull/simd" + suffix, [&] {
+		doNotOptimize(cullBoxes(frustum, boxes, visible).culled);
+	});
+	bench.run("cull/scalar" + suffix, [&] {
+		cullBoxesScalar(frustum, boxes, 0, reference);
+		doNotOptimize(reference.data());
+	});
+
+	return bench.writeJson() && mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+/* Engine hot paths: keyframes, skeletons, mesh conversion, texture dedup, collision, file reads.
+   No window or GL context needed. Run from the repo root, the Mixamo clips are skipped if
+   ./assets (or the directory given as the first argument) isn't there */
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <assimp/scene.h>
+
+#include <animator.hpp>
+#include <bench.hpp>
+
+// 2s at Mixamo's 30 keys/s
+#define BENCH_KEYS 60
+#define BENCH_MESH_VERTICES 20000
+#define BENCH_MESH_BONES 64
+
+Bone syntheticBone(std::mt19937& rng, usize n_keys) {
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	Bone bone = {};
+	bone.name = "bone";
+	bone.local_transform = mat4(1.0f);
+	for (usize i = 0; i < n_keys; i++) {
+		float t = (float)i;
+		bone.positions.push_back({ .pos = vec3(unit(rng), unit(rng), unit(rng)), .timestamp = t });
+		bone.rotations.push_back({ .rot = glm::normalize(glm::quat(unit(rng), unit(rng), unit(rng), unit(rng))), .timestamp = t });
+		bone.scales.push_back({ .scale = vec3(1.0f), .timestamp = t });
+	}
+	return bone;
+}
+
+// roughly what a skinned Mixamo body looks like to Mesh::fromAssimp: every vertex has
+// normals and uvs and is weighted to MAX_BONE_INFLUENCE bones
+std::unique_ptr<aiScene> syntheticScene(std::mt19937& rng) {
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_int_distribution<uint> pick_bone(0, BENCH_MESH_BONES - 1);
+
+	aiMesh *mesh = new aiMesh();
+	mesh->mNumVertices = BENCH_MESH_VERTICES;
+	mesh->mVertices = new aiVector3D[BENCH_MESH_VERTICES];
+	mesh->mNormals = new aiVector3D[BENCH_MESH_VERTICES];
+	mesh->mTextureCoords[0] = new aiVector3D[BENCH_MESH_VERTICES];
+	for (uint i = 0; i < BENCH_MESH_VERTICES; i++) {
+		mesh->mVertices[i] = aiVector3D(unit(rng), unit(rng) + 1.0f, unit(rng));
+		mesh->mNormals[i] = aiVector3D(0.0f, 1.0f, 0.0f);
+		mesh->mTextureCoords[0][i] = aiVector3D(unit(rng), unit(rng), 0.0f);
+	}
+
+	mesh->mNumFaces = BENCH_MESH_VERTICES / 3;
+	mesh->mFaces = new aiFace[mesh->mNumFaces];
+	for (uint i = 0; i < mesh->mNumFaces; i++) {
+		mesh->mFaces[i].mNumIndices = 3;
+		mesh->mFaces[i].mIndices = new unsigned[3] { 3*i, 3*i + 1, 3*i + 2 };
+	}
+
+	std::vector<std::vector<aiVertexWeight>> weights(BENCH_MESH_BONES);
+	for (uint i = 0; i < BENCH_MESH_VERTICES; i++) {
+		for (uint j = 0; j < MAX_BONE_INFLUENCE; j++) {
+			weights[pick_bone(rng)].push_back({ i, 1.0f / MAX_BONE_INFLUENCE });
+		}
+	}
+	mesh->mNumBones = BENCH_MESH_BONES;
+	mesh->mBones = new aiBone*[BENCH_MESH_BONES];
+	for (uint b = 0; b < BENCH_MESH_BONES; b++) {
+		aiBone *bone = new aiBone();
+		bone->mName = aiString("mixamorig:bone" + std::to_string(b));
+		bone->mNumWeights = weights[b].size();
+		bone->mWeights = new aiVertexWeight[bone->mNumWeights];
+		std::copy(weights[b].begin(), weights[b].end(), bone->mWeights);
+		mesh->mBones[b] = bone;
+	}
+
+	std::unique_ptr<aiScene> scene = std::make_unique<aiScene>();
+	scene->mNumMeshes = 1;
+	scene->mMeshes = new aiMesh*[1] { mesh };
+	// no textures, so nothing here needs GL
+	scene->mNumMaterials = 1;
+	scene->mMaterials = new aiMaterial*[1] { new aiMaterial() };
+	return scene;
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::string> args;
+	Bench bench = Bench::init("engine", argc, argv, args);
+	const std::string assets = args.size() > 0 ? args[0] : "./assets";
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	// keyframes
+	{
+		Bone bone = syntheticBone(rng, BENCH_KEYS);
+		std::vector<float> times(1024);
+		for (auto& t : times) {
+			t = (unit(rng) * 0.5f + 0.5f) * (BENCH_KEYS - 1) * 0.999f;
+		}
+		usize i = 0;
+		bench.run("bone/getPosIdx (60 keys)", [&] {
+			doNotOptimize(bone.getPosIdx(times[i++ % times.size()]));
+		});
+		bench.run("bone/update (60 keys)", [&] {
+			bone.update(times[i++ % times.size()]);
+			doNotOptimize(bone.local_transform);
+		});
+	}
+
+	// whole skeletons on the clips main.cpp plays
+	for (const char *clip : { "Dancing Twerk", "Walking", "Swimming" }) {
+		const std::string name = std::string("animator/updateAnimation (") + clip + ")";
+		if (!bench.enabled(name)) {
+			continue;
+		}
+		// offsets stay zero, the timing doesn't care
+		std::map<std::string, BoneInfo> bone_info_map;
+		Animation anim = Animation::init(assets + "/" + clip + ".dae", bone_info_map);
+		if (anim.bones.empty()) {
+			bench.note(name, "skipped");
+			continue;
+		}
+		Animator animator = Animator::init(&anim);
+		bench.run(name, [&] {
+			animator.updateAnimation(1.0f / 60.0f);
+			doNotOptimize(animator.bone_matrices[0]);
+		});
+	}
+
+	// vertex and bone weight conversion, minus the GL upload
+	{
+		std::unique_ptr<aiScene> scene = syntheticScene(rng);
+		std::vector<TextureInfo> textures_loaded;
+		std::map<std::string, BoneInfo> bone_info_map;
+		bench.run("mesh/fromAssimp (20k verts, 64 bones)", [&] {
+			Mesh mesh = Mesh::fromAssimp(scene->mMeshes[0], scene.get(), textures_loaded, bone_info_map, ".");
+			doNotOptimize(mesh.vertices.data());
+		});
+	}
+
+	// every lookup hits, so texture2DFromFile() (and GL) is never reached
+	{
+		std::vector<TextureInfo> textures_loaded;
+		for (uint i = 0; i < 64; i++) {
+			textures_loaded.push_back({
+				.texture = { .id = i + 1, .type = aiTextureType_DIFFUSE },
+				.path = "textures/material_" + std::to_string(i) + "_diffuse.png",
+			});
+		}
+		aiMaterial material;
+		for (uint i = 0; i < 4; i++) {
+			aiString path(textures_loaded[60 + i].path);
+			material.AddProperty(&path, AI_MATKEY_TEXTURE_DIFFUSE(i));
+		}
+		std::vector<Texture> textures;
+		textures.reserve(4);
+		bench.run("material/loadMaterialTextures (4 of 64, hits)", [&] {
+			textures.clear();
+			loadMaterialTextures(textures, textures_loaded, &material, aiTextureType_DIFFUSE, ".");
+			doNotOptimize(textures.data());
+		});
+	}
+
+	// hitbox against hitbox, the other model's meshes are never touched
+	{
+		std::unique_ptr<aiScene> scene = syntheticScene(rng);
+		std::vector<TextureInfo> textures_loaded;
+		Model player = {};
+		player.hitbox = { .min = vec3(-0.5f, 0.0f, -0.5f), .max = vec3(0.5f, 2.0f, 0.5f) };
+		Model tower = {};
+		tower.meshes.push_back(Mesh::fromAssimp(scene->mMeshes[0], scene.get(), textures_loaded, tower.bone_info_map, "."));
+		tower.pos = vec3(0.5f, 0.0f, 0.0f);
+		tower.hitbox = { .min = vec3(-1.0f), .max = vec3(1.0f) };
+		vec3 new_pos = vec3(0.0f, -0.1f, 0.0f);
+		bench.run("model/detectObj (20k vert obj)", [&] {
+			vec3 p = new_pos;
+			vec3 velocity = vec3(0.0f, -0.1f, 0.0f);
+			doNotOptimize(player.detectObj(p, velocity, tower));
+		});
+	}
+
+	{
+		std::vector<aiMatrix4x4> mats(1024);
+		for (auto& m : mats) {
+			m = aiMatrix4x4(
+				unit(rng), unit(rng), unit(rng), unit(rng),
+				unit(rng), unit(rng), unit(rng), unit(rng),
+				unit(rng), unit(rng), unit(rng), unit(rng),
+				0.0f, 0.0f, 0.0f, 1.0f
+			);
+		}
+		usize i = 0;
+		bench.run("utils/glmFromAssimpMat4", [&] {
+			doNotOptimize(glmFromAssimpMat4(mats[i++ % mats.size()]));
+		});
+	}
+
+	// readFile() logs every call, that's part of its cost but not of the table
+	if (std::ifstream("shaders/model.frag")) {
+		std::ostringstream sink;
+		std::streambuf *cerr_buf = std::cerr.rdbuf(sink.rdbuf());
+		bench.run("utils/readFile (shaders/model.frag)", [&] {
+			sink.str({});
+			doNotOptimize(readFile("shaders/model.frag").size());
+		});
+		std::cerr.rdbuf(cerr_buf);
+	} else {
+		bench.note("utils/readFile (shaders/model.frag)", "skipped");
+	}
+
+	return bench.writeJson() ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+/* Synthetic scene pieces shared by the benches, built on the CPU without a GL context */
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <types.hpp>
+#include <model.hpp>
+
+// one opaque mesh, the 12 triangles of a box centered on the origin
+Model boxModel(vec3 half) {
+	Mesh mesh = {};
+	for (int i = 0; i < 8; i++) {
+		Vertex v = {};
+		v.pos = vec3(i & 1 ? half.x : -half.x, i & 2 ? half.y : -half.y, i & 4 ? half.z : -half.z);
+		mesh.vertices.push_back(v);
+	}
+	// corner i is +x if bit 0 is set, +y for bit 1, +z for bit 2
+	const uint faces[6][4] = { { 0, 2, 6, 4 }, { 1, 5, 7, 3 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 1, 3, 2 }, { 4, 6, 7, 5 } };
+	for (const auto& f : faces) {
+		mesh.indices.insert(mesh.indices.end(), { f[0], f[1], f[2], f[0], f[2], f[3] });
+	}
+	mesh.bounds = { .min = -half, .max = half };
+	mesh.alpha_mode = ALPHA_OPAQUE;
+	Model model = {};
+	model.meshes.push_back(mesh);
+	model.bounds = mesh.bounds;
+	return model;
+}
@@ -0,0 +1,186 @@
+/* Job system scaling from 1 to N threads: culling, skeletons and a frame shaped task graph.
+   No window or GL context needed. The first argument caps the thread count, one per core by default */
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <animator.hpp>
+#include <cull.hpp>
+#include <render_queue.hpp>
+#include <jobs.hpp>
+#include <bench.hpp>
+#include <fixtures.hpp>
+
+#define BENCH_BOXES (1 << 18)
+#define BENCH_CHARACTERS 256
+#define BENCH_BONES 64
+#define BENCH_KEYS 60
+#define BENCH_WALLS 16
+
+std::vector<Bone> syntheticSkeleton(std::mt19937& rng) {
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<Bone> bones(BENCH_BONES);
+	for (auto& bone : bones) {
+		bone.name = "bone";
+		bone.local_transform = mat4(1.0f);
+		for (usize i = 0; i < BENCH_KEYS; i++) {
+			float t = (float)i;
+			bone.positions.push_back({ .pos = vec3(unit(rng), unit(rng), unit(rng)), .timestamp = t });
+			bone.rotations.push_back({ .rot = glm::normalize(glm::quat(unit(rng), unit(rng), unit(rng), unit(rng))), .timestamp = t });
+			bone.scales.push_back({ .scale = vec3(1.0f), .timestamp = t });
+		}
+	}
+	return bones;
+}
+
+void animate(std::vector<Bone>& bones, float t) {
+	for (auto& bone : bones) {
+		bone.update(t);
+	}
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::string> args;
+	Bench bench = Bench::init("jobs", argc, argv, args);
+	const uint max_threads = args.size() > 0 ? std::stoul(args[0]) : std::max(std::thread::hardware_concurrency(), 1u);
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> pos(-200.0f, 200.0f);
+	std::uniform_real_distribution<float> size(0.1f, 4.0f);
+
+	// the same boxes as crates in a render queue for the frame graph, unit cubes scaled to fit
+	const Model crate = boxModel(vec3(1.0f));
+	CullBoxes boxes;
+	RenderQueue queue = {};
+	boxes.reserve(BENCH_BOXES);
+	for (usize i = 0; i < BENCH_BOXES; i++) {
+		vec3 c = vec3(pos(rng), pos(rng) * 0.1f, pos(rng));
+		vec3 e = vec3(size(rng), size(rng), size(rng));
+		boxes.push({ .min = c - e, .max = c + e });
+		queue.push(crate, glm::scale(glm::translate(mat4(1.0f), c), e));
+	}
+	std::vector<uchar> visible((BENCH_BOXES + 7) / 8);
+	mat4 proj = glm::perspective(glm::radians(90.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+	mat4 view = glm::lookAt(vec3(0.0f, 2.0f, 0.0f), vec3(1.0f, 2.0f, -1.0f), vec3(0.0f, 1.0f, 0.0f));
+	const mat4 view_proj = proj * view;
+	const Frustum frustum = Frustum::init(view_proj);
+
+	// walls across the view for the occlusion buffer, turned to face the camera
+	const Model wall = boxModel(vec3(2.0f, 1.5f, 0.1f));
+	const Occluder wall_occluder = Occluder::init(wall, 2048);
+	std::uniform_real_distribution<float> along(5.0f, 40.0f), across(-10.0f, 10.0f);
+	const vec3 forward = glm::normalize(vec3(1.0f, 0.0f, -1.0f)), right = glm::normalize(vec3(1.0f, 0.0f, 1.0f));
+	for (uint i = 0; i < BENCH_WALLS; i++) {
+		const vec3 at = vec3(0.0f, 2.0f, 0.0f) + forward * along(rng) + right * across(rng);
+		const mat4 transform = glm::rotate(glm::translate(mat4(1.0f), at), glm::radians(45.0f), vec3(0.0f, 1.0f, 0.0f));
+		queue.pushOccluder(wall_occluder, queue.push(wall, transform));
+	}
+
+	std::vector<std::vector<Bone>> characters;
+	for (usize i = 0; i < BENCH_CHARACTERS; i++) {
+		characters.push_back(syntheticSkeleton(rng));
+	}
+	float t = 0.0f;
+	auto tick = [&] {
+		t += 1.0f / 60.0f;
+		if (t >= BENCH_KEYS - 1) {
+			t = 0.0f;
+		}
+	};
+
+	// 1, 2, 4 ... and max_threads itself
+	std::vector<uint> counts;
+	for (uint n = 1; n < max_threads; n *= 2) {
+		counts.push_back(n);
+	}
+	counts.push_back(max_threads);
+
+	const char *workloads[] = { "cull 256k boxes", "animate 256 skeletons", "frame graph", "empty jobs x1024" };
+	std::vector<std::vector<double>> medians(std::size(workloads));
+	for (uint n : counts) {
+		job_system.init(n);
+		const std::string threads = " (" + std::to_string(n) + (n == 1 ? " thread)" : " threads)");
+
+		medians[0].push_back(bench.run(std::string("jobs/") + workloads[0] + threads, [&] {
+			job_system.parallelFor(BENCH_BOXES, 4096, [&](usize first, usize last) {
+				cullBoxRange(frustum, boxes, first, last, visible);
+			});
+			doNotOptimize(visible.data());
+		}));
+
+		medians[1].push_back(bench.run(std::string("jobs/") + workloads[1] + threads, [&] {
+			tick();
+			job_system.parallelFor(characters.size(), 4, [&](usize first, usize last) {
+				for (usize i = first; i < last; i++) {
+					animate(characters[i], t);
+				}
+			});
+			doNotOptimize(characters[0][0].local_transform);
+		}));
+
+		// main.cpp's shape: physics, then animation next to camera -> list -> (cull | occluders) -> occlusion
+		{
+			TaskGraph graph;
+			OcclusionBuffer occlusion = OcclusionBuffer::init(256, 144, n);
+			CullStats stats = {};
+			const uint physics = graph.add("physics", ALLOC_PHYSICS, {}, [&] { tick(); });
+			graph.add("animation", ALLOC_ANIMATION, { physics }, [&] {
+				job_system.parallelFor(characters.size(), 4, [&](usize first, usize last) {
+					for (usize i = first; i < last; i++) {
+						animate(characters[i], t);
+					}
+				});
+			});
+			const uint camera = graph.add("camera", ALLOC_RENDER, { physics }, [] {});
+			const uint list = graph.add("render list", ALLOC_RENDER, { camera }, [] {});
+			const uint cull = graph.add("frustum cull", ALLOC_RENDER, { list }, [&] {
+				queue.cull(frustum);
+			});
+			const uint occluders = graph.add("occluders", ALLOC_RENDER, { list }, [&] {
+				queue.rasterizeOccluders(occlusion, view_proj);
+			});
+			graph.add("occlusion cull", ALLOC_RENDER, { cull, occluders }, [&] {
+				queue.testOcclusion(occlusion, view_proj);
+				stats = queue.stats;
+			});
+			medians[2].push_back(bench.run(std::string("jobs/") + workloads[2] + threads, [&] {
+				graph.run(job_system);
+				doNotOptimize(stats.culled);
+			}));
+			if (stats.tested > 0) {
+				bench.note("occluded/frame graph" + threads, std::to_string(stats.occluded) + " of " + std::to_string(stats.tested - stats.culled) + " in view");
+			}
+		}
+
+		// pure scheduling overhead
+		medians[3].push_back(bench.run(std::string("jobs/") + workloads[3] + threads, [&] {
+			job_system.parallelFor(1024, 1, [](usize, usize) {});
+		}));
+
+		job_system.deinit();
+	}
+
+	for (usize w = 0; w < std::size(workloads); w++) {
+		for (usize i = 0; i < counts.size(); i++) {
+			if (medians[w][0] <= 0.0 || medians[w][i] <= 0.0) {
+				continue;
+			}
+			std::ostringstream speedup;
+			speedup << std::fixed << std::setprecision(2) << medians[w][0] / medians[w][i] << "x";
+			bench.note(std::string("speedup/") + workloads[w] + " (" + std::to_string(counts[i]) + ")", speedup.str());
+		}
+	}
+
+	return bench.writeJson() ? 0 : 1;
+}
@@ -0,0 +1,283 @@
+/* Level triangle BVH: build time, ray casts per second and capsule sweeps on the island mesh, and the
+   same mesh baked into a heightfield at a few resolutions for comparison.
+   The first argument is the mesh, a synthetic heightfield stands in when it can't be loaded, the second
+   the thread count for builds and ray batches, one per core by default */
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <mesh_bvh.hpp>
+#include <heightfield.hpp>
+#include <bench.hpp>
+
+#define BENCH_RAYS (1 << 20)
+#define BENCH_SWEEPS (1 << 16)
+#define BENCH_TERRAIN 512
+// rays per bench.run() op when they're split over threads
+#define BENCH_RAY_BATCH 4096
+// march step for checking Heightfield::raycast(), in cells
+#define BENCH_MARCH_STEP (1.0f / 64.0f)
+
+// node transforms baked in, then placed the way main() places the map
+bool loadCorners(const std::string& path, std::vector<vec3>& corners) {
+	Assimp::Importer imp;
+	const aiScene *scene = imp.ReadFile(path, aiProcess_Triangulate | aiProcess_PreTransformVertices);
+	if (!scene || !scene->mRootNode) {
+		return false;
+	}
+	const mat4 transform = glm::translate(glm::scale(mat4(1.0f), vec3(4.0f, 1.0f, 4.0f)), vec3(0.0f, -2.0f, 0.0f));
+	for (uint m = 0; m < scene->mNumMeshes; m++) {
+		const aiMesh *mesh = scene->mMeshes[m];
+		for (uint f = 0; f < mesh->mNumFaces; f++) {
+			if (mesh->mFaces[f].mNumIndices != 3) {
+				continue;
+			}
+			for (uint j = 0; j < 3; j++) {
+				const aiVector3D& v = mesh->mVertices[mesh->mFaces[f].mIndices[j]];
+				corners.push_back(vec3(transform * vec4(v.x, v.y, v.z, 1.0f)));
+			}
+		}
+	}
+	return true;
+}
+
+void terrainCorners(std::vector<vec3>& corners) {
+	auto height = [](int x, int z) {
+		return 2.0f * std::sin(x * 0.05f) * std::cos(z * 0.07f) + 0.5f * std::sin(x * 0.31f + z * 0.17f);
+	};
+	const float spacing = 0.25f, half = BENCH_TERRAIN * spacing / 2.0f;
+	auto corner = [&](int x, int z) { return vec3(x * spacing - half, height(x, z), z * spacing - half); };
+	for (int z = 0; z < BENCH_TERRAIN; z++) {
+		for (int x = 0; x < BENCH_TERRAIN; x++) {
+			corners.insert(corners.end(), { corner(x, z), corner(x, z + 1), corner(x + 1, z) });
+			corners.insert(corners.end(), { corner(x + 1, z), corner(x, z + 1), corner(x + 1, z + 1) });
+		}
+	}
+}
+
+// what Heightfield::raycast() is meant to find, the slow way: walk the ray in `step`s until it's under height(),
+// then bisect the last step. can only step over something thinner than `step`
+bool marchHeight(const Heightfield& field, const Ray& ray, float step, float& t_hit) {
+	auto under = [&](float t) {
+		const vec3 p = ray.origin + ray.dir * t;
+		return p.y <= field.height(p.x, p.z);
+	};
+	for (float t = 0.0f, prev = 0.0f; prev < ray.max_t; prev = t, t = std::min(t + step, ray.max_t)) {
+		if (!under(t)) {
+			continue;
+		}
+		if (t == 0.0f) {
+			t_hit = 0.0f;
+			return true;
+		}
+		float a = prev, b = t;
+		for (int i = 0; i < 24; i++) {
+			const float mid = (a + b) / 2.0f;
+			(under(mid) ? b : a) = mid;
+		}
+		t_hit = b;
+		return true;
+	}
+	return false;
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::string> args;
+	Bench bench = Bench::init("mesh_bvh", argc, argv, args);
+	const std::string path = args.size() > 0 ? args[0] : "./assets/low_poly_island/scene.gltf";
+	const uint n_threads = args.size() > 1 ? std::stoul(args[1]) : std::max(std::thread::hardware_concurrency(), 1u);
+
+	std::vector<vec3> corners;
+	if (!loadCorners(path, corners)) {
+		std::cout << "can't load " << path << ", using a " << BENCH_TERRAIN << "x" << BENCH_TERRAIN << " heightfield" << std::endl;
+		terrainCorners(corners);
+	}
+
+	// one thread, then all of them
+	std::vector<uint> counts = { 1 };
+	if (n_threads > 1) {
+		counts.push_back(n_threads);
+	}
+
+	const MeshBVH bvh = MeshBVH::init(corners, n_threads);
+	bvh.print(std::cout);
+	for (uint threads : counts) {
+		bench.run("mesh_bvh/build (" + std::to_string(threads) + (threads == 1 ? " thread)" : " threads)"), [&] {
+			MeshBVH built = MeshBVH::init(corners, threads);
+			doNotOptimize(built.nodes.data());
+		});
+	}
+
+	const vec3 lo = bvh.nodes[0].min, hi = bvh.nodes[0].max;
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	auto inside = [&] { return lo + (hi - lo) * vec3(unit(rng), unit(rng), unit(rng)); };
+
+	// picking: from above, down at the level, each on its own. camera boom: short and sideways through the middle
+	// of it, a packet's worth at a time fanned out a little from the same spot like main()'s
+	std::vector<Ray> picks(BENCH_RAYS), booms(BENCH_RAYS);
+	for (uint i = 0; i < BENCH_RAYS; i++) {
+		const vec3 target = inside();
+		const vec3 origin = vec3(target.x, hi.y + 10.0f, target.z) + vec3(unit(rng) - 0.5f, 0.0f, unit(rng) - 0.5f) * 20.0f;
+		picks[i] = { .origin = origin, .dir = glm::normalize(target - origin), .max_t = 1000.0f };
+	}
+	for (uint i = 0; i < BENCH_RAYS; i += MESH_BVH_PACKET) {
+		const vec3 origin = inside();
+		const float angle = unit(rng) * 6.2832f, pitch = unit(rng) - 0.5f;
+		for (uint k = 0; k < MESH_BVH_PACKET; k++) {
+			const float spread = (unit(rng) - 0.5f) * 0.3f;
+			booms[i + k] = { .origin = origin, .dir = vec3(std::cos(angle + spread), pitch + spread, std::sin(angle + spread)), .max_t = 2.0f };
+		}
+	}
+
+	// one op is the next BENCH_RAY_BATCH rays split over `threads`, walking through all of them. in packets
+	// through the batched raycast(), or one at a time for comparison
+	std::vector<TriHit> hits(BENCH_RAYS);
+	auto castRays = [&](const std::string& name, const std::vector<Ray>& rays, uint threads, bool packets) {
+		std::vector<usize> thread_hits(threads);
+		usize next = 0, n_cast = 0, n_hits = 0;
+		const double ns = bench.run("mesh_bvh/" + name, [&] {
+			std::vector<std::thread> pool;
+			for (uint t = 0; t < threads; t++) {
+				pool.emplace_back([&, t] {
+					const usize begin = next + BENCH_RAY_BATCH * t / threads, end = next + BENCH_RAY_BATCH * (t + 1) / threads;
+					if (packets) {
+						thread_hits[t] = bvh.raycast(&rays[begin], &hits[begin], end - begin);
+						return;
+					}
+					thread_hits[t] = 0;
+					for (usize i = begin; i < end; i++) {
+						thread_hits[t] += bvh.raycast(rays[i], hits[i]);
+					}
+				});
+			}
+			for (auto& thread : pool) {
+				thread.join();
+			}
+			for (usize h : thread_hits) {
+				n_hits += h;
+			}
+			n_cast += BENCH_RAY_BATCH;
+			next = (next + BENCH_RAY_BATCH) % BENCH_RAYS;
+		});
+		if (ns > 0.0) {
+			std::ostringstream rate;
+			rate << std::fixed << std::setprecision(3) << BENCH_RAY_BATCH / ns * 1e3 << " M/s, " << std::setprecision(1)
+			     << 100.0 * n_hits / n_cast << "% hit";
+			bench.note("rays/s/" + name, rate.str());
+		}
+	};
+	for (uint threads : counts) {
+		const std::string suffix = " x" + std::to_string(BENCH_RAY_BATCH) + " (" + std::to_string(threads) + (threads == 1 ? " thread)" : " threads)");
+		castRays("picking rays" + suffix, picks, threads, true);
+		castRays("boom rays" + suffix, booms, threads, true);
+	}
+	const std::string single = " x" + std::to_string(BENCH_RAY_BATCH) + " (1 thread)";
+	castRays("picking rays one at a time" + single, picks, 1, false);
+	castRays("boom rays one at a time" + single, booms, 1, false);
+
+	// packets have to find the same hits as the rays one at a time, a different triangle at the same t is a shared edge
+	std::vector<TriHit> batch(BENCH_RAY_BATCH);
+	bvh.raycast(booms.data(), batch.data(), BENCH_RAY_BATCH);
+	usize boom_mismatches = 0;
+	for (uint i = 0; i < BENCH_RAY_BATCH; i++) {
+		TriHit hit;
+		bvh.raycast(booms[i], hit);
+		boom_mismatches += (hit.tri == UINT32_MAX) != (batch[i].tri == UINT32_MAX) || hit.t != batch[i].t;
+	}
+	bench.note("check/boom packets differing from single rays", std::to_string(boom_mismatches) + " of " + std::to_string(BENCH_RAY_BATCH));
+
+	// brute force on a few picks, the BVH and each heightfield have to find the same closest hit
+	usize mismatches = 0;
+	for (uint i = 0; i < 256; i++) {
+		TriHit hit;
+		bvh.raycast(picks[i], hit);
+		float best = picks[i].max_t;
+		for (const auto& tri : bvh.tris) {
+			best = std::min(best, MeshBVH::rayTriangle(picks[i].origin, picks[i].dir, tri));
+		}
+		mismatches += std::abs(best - hit.t) > 1e-4f * std::max(best, 1.0f);
+	}
+	bench.note("check/brute force picks differing", std::to_string(mismatches) + " of 256");
+	mismatches += boom_mismatches;
+
+	// a character sized capsule dropped a step's worth toward the ground from somewhere above it
+	usize next = 0;
+	bench.run("mesh_bvh/capsule sweep", [&] {
+		const Ray& pick = picks[next];
+		next = (next + 1) % BENCH_SWEEPS;
+		TriHit ground;
+		if (!bvh.raycast(pick, ground)) {
+			return;
+		}
+		const vec3 feet = pick.origin + pick.dir * ground.t + vec3(0.0f, 0.3f, 0.0f);
+		const Capsule capsule = { .a = feet + vec3(0.0f, 0.2f, 0.0f), .b = feet + vec3(0.0f, 0.8f, 0.0f), .radius = 0.2f };
+		CapsuleHit hit;
+		doNotOptimize(bvh.sweepCapsule(capsule, vec3(0.1f, -0.5f, 0.0f), hit));
+	});
+
+	// ground height under a point: straight down through the BVH, or one lookup
+	std::vector<vec2> points(BENCH_SWEEPS);
+	for (auto& p : points) {
+		const vec3 q = inside();
+		p = vec2(q.x, q.z);
+	}
+	next = 0;
+	bench.run("mesh_bvh/ground via bvh", [&] {
+		const vec2 p = points[next];
+		next = (next + 1) % BENCH_SWEEPS;
+		TriHit hit;
+		bvh.raycast({ .origin = vec3(p.x, hi.y + 1.0f, p.y), .dir = vec3(0.0f, -1.0f, 0.0f), .max_t = 1000.0f }, hit);
+		doNotOptimize(hit.t);
+	});
+
+	for (float cell : { 1.0f, 0.5f, 0.25f }) {
+		Heightfield field = Heightfield::init(corners, cell, lo.y);
+		field.print(std::cout);
+		std::ostringstream prefix;
+		prefix << "mesh_bvh/heightfield " << std::fixed << std::setprecision(2) << cell << " ";
+
+		// raycast() against a fine march of height() on the same picks, they have to agree to about a step
+		const float step = field.cell_size * BENCH_MARCH_STEP;
+		usize field_mismatches = 0;
+		for (uint i = 0; i < 256; i++) {
+			float t, t_march;
+			vec3 normal;
+			const bool hit = field.raycast(picks[i], t, normal), marched = marchHeight(field, picks[i], step, t_march);
+			field_mismatches += hit != marched || (hit && std::abs(t - t_march) > step + 1e-4f * std::max(t, 1.0f));
+		}
+		mismatches += field_mismatches;
+		bench.note("check/" + prefix.str().substr(9) + "picks differing from height()", std::to_string(field_mismatches) + " of 256");
+		next = 0;
+		bench.run(prefix.str() + "ground", [&] {
+			const vec2 p = points[next];
+			next = (next + 1) % BENCH_SWEEPS;
+			doNotOptimize(field.height(p.x, p.y));
+		});
+		next = 0;
+		bench.run(prefix.str() + "picking ray", [&] {
+			float t;
+			vec3 normal;
+			doNotOptimize(field.raycast(picks[next], t, normal));
+			next = (next + 1) % BENCH_RAYS;
+		});
+	}
+
+	return bench.writeJson() && mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+/* Software occlusion culling: walls rasterized into the depth buffer and crates tested against it, from 1 to N
+   threads. Checks the buffer comes out byte for byte the same whatever it's split into, and that a box right
+   behind a wall is hidden and one in front of it isn't. No window or GL context needed. The first argument caps
+   the thread count, one per core by default */
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <render_queue.hpp>
+#include <jobs.hpp>
+#include <bench.hpp>
+#include <fixtures.hpp>
+
+#define BENCH_WALLS 24
+#define BENCH_CRATES (1 << 14)
+// what main() rasterizes into
+#define BENCH_WIDTH 256
+#define BENCH_HEIGHT 144
+
+int main(int argc, char** argv) {
+	std::vector<std::string> args;
+	Bench bench = Bench::init("occlusion", argc, argv, args);
+	const uint max_threads = args.size() > 0 ? std::stoul(args[0]) : std::max(std::thread::hardware_concurrency(), 1u);
+
+	const mat4 proj = glm::perspective(glm::radians(90.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+	const mat4 view = glm::lookAt(vec3(0.0f, 2.0f, 0.0f), vec3(0.0f, 2.0f, -1.0f), vec3(0.0f, 1.0f, 0.0f));
+	const mat4 view_proj = proj * view;
+	const Frustum frustum = Frustum::init(view_proj);
+
+	const Model wall = boxModel(vec3(2.0f, 1.5f, 0.1f));
+	const Model crate = boxModel(vec3(0.5f));
+	const Occluder wall_occluder = Occluder::init(wall, 2048);
+
+	// one big wall straight ahead for the known answers, then a scatter of smaller ones and crates all over
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> x(-30.0f, 30.0f), y(0.0f, 4.0f), wall_z(-30.0f, -8.0f), crate_z(-60.0f, -2.0f);
+	RenderQueue queue = {};
+	queue.pushOccluder(wall_occluder, queue.push(wall, glm::scale(glm::translate(mat4(1.0f), vec3(0.0f, 2.0f, -10.0f)), vec3(2.0f))));
+	for (uint i = 1; i < BENCH_WALLS; i++) {
+		queue.pushOccluder(wall_occluder, queue.push(wall, glm::translate(mat4(1.0f), vec3(x(rng), y(rng), wall_z(rng)))));
+	}
+	for (uint i = 0; i < BENCH_CRATES; i++) {
+		queue.push(crate, glm::translate(mat4(1.0f), vec3(x(rng), y(rng), crate_z(rng))));
+	}
+	const Box behind = { .min = vec3(-0.5f, 1.5f, -20.5f), .max = vec3(0.5f, 2.5f, -19.5f) };
+	const Box in_front = { .min = vec3(-0.5f, 1.5f, -6.5f), .max = vec3(0.5f, 2.5f, -5.5f) };
+
+	// 1, 2, 4 ... and max_threads itself
+	std::vector<uint> counts;
+	for (uint n = 1; n < max_threads; n *= 2) {
+		counts.push_back(n);
+	}
+	counts.push_back(max_threads);
+
+	uint failures = 0;
+	OcclusionBuffer reference = {};
+	auto check = [&](const OcclusionBuffer& buffer, const std::string& name) {
+		if (reference.depth.empty()) {
+			reference = buffer;
+			if (buffer.testBox(behind, view_proj)) {
+				std::cerr << "occlusion(error): a box right behind the wall isn't occluded" << std::endl;
+				failures++;
+			}
+			if (!buffer.testBox(in_front, view_proj)) {
+				std::cerr << "occlusion(error): a box in front of the wall is occluded" << std::endl;
+				failures++;
+			}
+			return;
+		}
+		if (std::memcmp(buffer.depth.data(), reference.depth.data(), buffer.depth.size() * sizeof(float)) != 0
+		 || std::memcmp(buffer.tile_max.data(), reference.tile_max.data(), buffer.tile_max.size() * sizeof(float)) != 0) {
+			std::cerr << "occlusion(error): " << name << " doesn't rasterize the same as 1 thread" << std::endl;
+			failures++;
+		}
+	};
+
+	for (uint n : counts) {
+		job_system.init(n);
+		const std::string threads = " (" + std::to_string(n) + (n == 1 ? " thread)" : " threads)");
+		OcclusionBuffer buffer = OcclusionBuffer::init(BENCH_WIDTH, BENCH_HEIGHT, n);
+		queue.rasterizeOccluders(buffer, view_proj);
+		check(buffer, std::to_string(n) + " threads");
+
+		bench.run("occlusion/rasterize " + std::to_string(BENCH_WALLS) + " walls" + threads, [&] {
+			queue.rasterizeOccluders(buffer, view_proj);
+			doNotOptimize(buffer.depth.data());
+		});
+		bench.run("occlusion/cull + test " + std::to_string(BENCH_CRATES / 1024) + "k crates" + threads, [&] {
+			queue.cull(frustum);
+			queue.testOcclusion(buffer, view_proj);
+			doNotOptimize(queue.stats.occluded);
+		});
+		job_system.deinit();
+	}
+	bench.note("occluded crates", std::to_string(queue.stats.occluded) + " of " + std::to_string(queue.stats.tested - queue.stats.culled) + " in view");
+
+	// bands that don't divide the tile rows evenly, and one per tile row
+	job_system.init(max_threads);
+	for (uint bands : { 3u, 5u, 7u, (uint)BENCH_HEIGHT / OCCLUSION_TILE }) {
+		OcclusionBuffer buffer = OcclusionBuffer::init(BENCH_WIDTH, BENCH_HEIGHT, bands);
+		queue.rasterizeOccluders(buffer, view_proj);
+		check(buffer, std::to_string(bands) + " bands");
+	}
+	job_system.deinit();
+
+	return bench.writeJson() && failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+/* Rigid body steps per second for 10k to 100k boxes dropped in stacks onto a flat floor, from 1 to N threads:
+   the first second while everything falls and lands, then once the piles have gone to sleep, then one more
+   box thrown onto a sleeping pile, which has to wake it and settle back down. No window or GL context needed. The first argument caps the thread count, one per core by default, the
+   second is the grid cell size */
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <rigid_bodies.hpp>
+#include <jobs.hpp>
+#include <bench.hpp>
+
+#define BENCH_DT (1.0f / 60.0f)
+#define BENCH_FALL_STEPS 60
+// gives up waiting for everything to sleep after this many
+#define BENCH_SETTLE_STEPS 900
+#define BENCH_LAYERS 10
+// the box thrown onto a pile, well over BODIES_WAKE_SPEED when it lands
+#define BENCH_THROW_SPEED 8.0f
+
+// columns of BENCH_LAYERS boxes a few units up, a little off center so the piles aren't perfect
+RigidBodies spawn(usize n, float cell_size) {
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> jitter(-0.08f, 0.08f);
+	RigidBodies bodies = RigidBodies::init(cell_size, 0.0f);
+	const usize side = (usize)std::ceil(std::sqrt((double)n / BENCH_LAYERS));
+	const float spacing = 0.75f, half = side * spacing / 2.0f;
+	for (usize i = 0; i < n; i++) {
+		const usize column = i % (side * side), layer = i / (side * side);
+		const vec3 pos = vec3((column % side) * spacing - half + jitter(rng), 3.0f + layer * 0.75f, (column / side) * spacing - half + jitter(rng));
+		bodies.add(pos, vec3(0.25f));
+	}
+	return bodies;
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::string> args;
+	Bench bench = Bench::init("rigid_bodies", argc, argv, args);
+	const uint max_threads = args.size() > 0 ? std::stoul(args[0]) : std::max(std::thread::hardware_concurrency(), 1u);
+	const float cell_size = args.size() > 1 ? std::stof(args[1]) : 1.0f;
+
+	// 1, 2, 4 ... and max_threads itself
+	uint failures = 0;
+	std::vector<uint> counts;
+	for (uint n = 1; n < max_threads; n *= 2) {
+		counts.push_back(n);
+	}
+	counts.push_back(max_threads);
+
+	for (usize n : { 10000u, 50000u, 100000u }) {
+		std::vector<double> falling;
+		for (uint threads : counts) {
+			job_system.init(threads);
+			const std::string name = std::to_string(n / 1000) + "k boxes (" + std::to_string(threads) + (threads == 1 ? " thread)" : " threads)");
+			RigidBodies bodies = spawn(n, cell_size);
+
+			// not through bench.run(), every step of the fall is different
+			double integrate_ms = 0.0, broadphase_ms = 0.0, contact_ms = 0.0, sleep_ms = 0.0;
+			auto start = chrono::steady_clock::now();
+			for (uint s = 0; s < BENCH_FALL_STEPS; s++) {
+				bodies.step(BENCH_DT, nullptr);
+				integrate_ms += bodies.integrate_ms;
+				broadphase_ms += bodies.broadphase_ms;
+				contact_ms += bodies.contact_ms;
+				sleep_ms += bodies.sleep_ms;
+			}
+			const double fall_ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+			falling.push_back(fall_ms);
+			std::cout << std::fixed << std::setprecision(2) << "falling " << name << ": " << BENCH_FALL_STEPS / fall_ms * 1000.0 << " steps/s, per step "
+				  << integrate_ms / BENCH_FALL_STEPS << " ms integrate + ground, " << broadphase_ms / BENCH_FALL_STEPS << " ms grid, "
+				  << contact_ms / BENCH_FALL_STEPS << " ms contacts, " << sleep_ms / BENCH_FALL_STEPS << " ms islands" << std::endl;
+
+			uint settle = BENCH_FALL_STEPS;
+			for (; settle < BENCH_SETTLE_STEPS && bodies.n_awake > 0; settle++) {
+				bodies.step(BENCH_DT, nullptr);
+				if (settle % 120 == 0) {
+					std::cout << "  step " << settle << ": " << bodies.n_awake << " awake" << std::endl;
+				}
+			}
+			std::cout << "  settled after " << settle << " steps, ";
+			bodies.print(std::cout);
+
+			const double resting_ns = bench.run("rigid_bodies/resting " + name, [&] {
+				bodies.step(BENCH_DT, nullptr);
+				doNotOptimize(bodies.n_awake);
+			});
+			if (resting_ns > 0.0) {
+				bench.note("steps/s/resting " + name, std::to_string((uint64_t)(1e9 / resting_ns)));
+			}
+			bench.note("steps/s/falling " + name, std::to_string((uint64_t)(BENCH_FALL_STEPS / fall_ms * 1000.0)));
+
+			// straight down onto the pile body 0 is at the bottom of, from above where its top box started
+			const vec3 base = bodies.position(0);
+			const usize woken = bodies.woken;
+			bodies.add(vec3(base.x, 3.0f + BENCH_LAYERS * 0.75f + 2.0f, base.z), vec3(0.25f), vec3(0.0f, -BENCH_THROW_SPEED, 0.0f));
+			bool pile_woke = false;
+			uint resettle = 0;
+			for (; resettle < BENCH_SETTLE_STEPS && (resettle == 0 || bodies.n_awake > 0); resettle++) {
+				bodies.step(BENCH_DT, nullptr);
+				pile_woke |= bodies.awake(0);
+			}
+			if (!pile_woke || bodies.woken == woken) {
+				std::cerr << "rigid_bodies(error): " << name << ": the pile didn't wake when a box hit it" << std::endl;
+				failures++;
+			} else if (bodies.n_awake > 0) {
+				std::cerr << "rigid_bodies(error): " << name << ": " << bodies.n_awake << " still awake " << resettle << " steps after the hit" << std::endl;
+				failures++;
+			}
+			bench.note("steps to settle/hit " + name, std::to_string(resettle));
+			job_system.deinit();
+		}
+		for (usize i = 0; i < counts.size(); i++) {
+			std::ostringstream speedup;
+			speedup << std::fixed << std::setprecision(2) << falling[0] / falling[i] << "x";
+			bench.note("speedup/falling " + std::to_string(n / 1000) + "k boxes (" + std::to_string(counts[i]) + ")", speedup.str());
+		}
+	}
+
+	return bench.writeJson() && failures == 0 ? 0 : 1;
+}
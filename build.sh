@@ -4,4 +4,4 @@
 
 mkdir -p build
 
-g++ -o build/main -Og -Wall src/main.cpp ./glad/src/gl.c -I ./glad/include -l glfw -I include -l assimp "$@"
+g++ -o build/main -Og -Wall -mavx2 -mfma src/main.cpp ./glad/src/gl.c -I ./glad/include -l glfw -I include -l assimp -l EGL "$@"
@@ -17,6 +17,9 @@
         glm
         stb
         assimp
+        # EGL for --headless, mesa's llvmpipe runs it without a GPU
+        libGL
+        mesa
       ];
     in
     {
@@ -0,0 +1,295 @@
+#pragma once
+
+/* Heap allocations per subsystem: live bytes and per-frame counts, through a replaced global operator new.
+   Define ALLOCATIONS_IMPLEMENTATION in the one file that should define the operators */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+#include <types.hpp>
+
+// frames the loop gets to settle (first-time growth of queues, caches and the frame arena)
+// before ALLOCATIONS_ASSERT_STEADY starts failing on allocations
+#define ALLOCATIONS_WARMUP_FRAMES 120
+
+#define ALLOC_CONCAT2(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT2(a, b)
+// tags every allocation in the scope, nests
+#define ALLOC_SCOPE(tag) AllocScope ALLOC_CONCAT(alloc_scope_, __LINE__)(tag)
+// for allocations that are known and accepted, still counted but never asserted on
+#define ALLOC_ALLOW() AllocAllowScope ALLOC_CONCAT(alloc_allow_, __LINE__)
+
+enum AllocTag : uint32_t {
+	ALLOC_OTHER,
+	ALLOC_ANIMATION,
+	ALLOC_RENDER,
+	ALLOC_PHYSICS,
+	ALLOC_ASSETS,
+	ALLOC_TAG_COUNT,
+};
+
+const std::array<const char*, ALLOC_TAG_COUNT> alloc_tag_names = {
+	"other",
+	"animation",
+	"render",
+	"physics",
+	"assets",
+};
+
+struct AllocTagStats {
+	std::atomic<int64_t> live_bytes;
+	std::atomic<int64_t> live_allocs;
+	// since the last endFrame()
+	std::atomic<uint64_t> frame_allocs;
+	std::atomic<uint64_t> frame_bytes;
+	uint64_t peak_bytes;
+	// frames that allocated at all, once past the warmup
+	uint64_t steady_frames_allocating;
+};
+
+struct AllocFrame {
+	uint64_t allocs;
+	uint64_t bytes;
+};
+
+struct AllocTracker {
+	std::array<AllocTagStats, ALLOC_TAG_COUNT> tags;
+	std::array<AllocFrame, ALLOC_TAG_COUNT> last;
+	usize frames;
+	// set once the warmup is over, see ALLOCATIONS_WARMUP_FRAMES
+	std::atomic<bool> steady;
+
+	void add(AllocTag tag, int64_t bytes) {
+		AllocTagStats& t = this->tags[tag];
+		t.live_bytes.fetch_add(bytes, std::memory_order_relaxed);
+		t.live_allocs.fetch_add(1, std::memory_order_relaxed);
+		t.frame_allocs.fetch_add(1, std::memory_order_relaxed);
+		t.frame_bytes.fetch_add(bytes, std::memory_order_relaxed);
+	}
+
+	void remove(AllocTag tag, int64_t bytes) {
+		AllocTagStats& t = this->tags[tag];
+		t.live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+		t.live_allocs.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	// once per frame on the main thread
+	void endFrame() {
+		for (usize i = 0; i < ALLOC_TAG_COUNT; i++) {
+			AllocTagStats& t = this->tags[i];
+			this->last[i] = {
+				.allocs = t.frame_allocs.exchange(0, std::memory_order_relaxed),
+				.bytes = t.frame_bytes.exchange(0, std::memory_order_relaxed),
+			};
+			t.peak_bytes = std::max<uint64_t>(t.peak_bytes, t.live_bytes.load(std::memory_order_relaxed));
+			if (this->steady.load(std::memory_order_relaxed) && this->last[i].allocs > 0) {
+				t.steady_frames_allocating++;
+			}
+		}
+		this->frames++;
+		if (this->frames == ALLOCATIONS_WARMUP_FRAMES) {
+			this->steady.store(true, std::memory_order_relaxed);
+		}
+	}
+
+	// the last finished frame
+	void print(std::ostream& out) const {
+		out << "alloc(info):";
+		for (usize i = 0; i < ALLOC_TAG_COUNT; i++) {
+			out << " " << alloc_tag_names[i] << "=" << this->last[i].allocs << "/" << this->last[i].bytes << "B";
+		}
+		out << " (allocations/bytes last frame)" << std::endl;
+	}
+
+	void report(std::ostream& out) const {
+		out << "alloc(info): per subsystem after " << this->frames << " frames" << std::endl;
+		for (usize i = 0; i < ALLOC_TAG_COUNT; i++) {
+			const AllocTagStats& t = this->tags[i];
+			out << "  " << std::left << std::setw(10) << alloc_tag_names[i] << std::right
+			    << " live " << t.live_bytes.load() << "B in " << t.live_allocs.load() << " allocations, peak " << t.peak_bytes << "B";
+			if (this->frames > ALLOCATIONS_WARMUP_FRAMES) {
+				out << ", allocated in " << t.steady_frames_allocating << " of " << this->frames - ALLOCATIONS_WARMUP_FRAMES << " steady frames";
+			}
+			out << std::endl;
+		}
+	}
+};
+
+inline AllocTracker alloc_tracker;
+inline thread_local AllocTag alloc_tag = ALLOC_OTHER;
+inline thread_local bool alloc_allowed = false;
+
+struct AllocScope {
+	AllocTag prev;
+
+	explicit AllocScope(AllocTag tag) : prev(alloc_tag) {
+		alloc_tag = tag;
+	}
+
+	~AllocScope() {
+		alloc_tag = this->prev;
+	}
+};
+
+struct AllocAllowScope {
+	bool prev;
+
+	AllocAllowScope() : prev(alloc_allowed) {
+		alloc_allowed = true;
+	}
+
+	~AllocAllowScope() {
+		alloc_allowed = this->prev;
+	}
+};
+
+// build with -DALLOCATIONS_DISABLE to keep the standard operator new
+#if defined(ALLOCATIONS_IMPLEMENTATION) && !defined(ALLOCATIONS_DISABLE)
+
+// right in front of every allocation, keeps the 16 byte alignment operator new promises
+struct alignas(16) AllocHeader {
+	uint64_t size;
+	AllocTag tag;
+	// from what malloc() returned to the header, only over-aligned allocations have any
+	uint32_t offset;
+};
+
+void* trackedAlloc(usize size, usize align = alignof(AllocHeader)) {
+	const AllocTag tag = alloc_tag;
+#ifdef ALLOCATIONS_ASSERT_STEADY
+	// debug builds: the frame loop's subsystems don't touch the heap once they've warmed up
+	if (tag != ALLOC_OTHER && tag != ALLOC_ASSETS && !alloc_allowed && alloc_tracker.steady.load(std::memory_order_relaxed)) {
+		// no iostreams, they might allocate
+		std::fprintf(stderr, "alloc(error): %zu bytes allocated by %s after the warmup\n", size, alloc_tag_names[tag]);
+		std::abort();
+	}
+#endif
+	align = std::max(align, alignof(AllocHeader));
+	uchar *base = static_cast<uchar*>(std::malloc(sizeof(AllocHeader) + size + align - alignof(AllocHeader)));
+	if (base == nullptr) {
+		throw std::bad_alloc();
+	}
+	const uintptr_t p = (reinterpret_cast<uintptr_t>(base) + sizeof(AllocHeader) + align - 1) & ~(uintptr_t)(align - 1);
+	AllocHeader *header = reinterpret_cast<AllocHeader*>(p) - 1;
+	header->size = size;
+	header->tag = tag;
+	header->offset = reinterpret_cast<uchar*>(header) - base;
+	alloc_tracker.add(tag, size);
+	return header + 1;
+}
+
+void trackedFree(void *ptr) {
+	if (ptr == nullptr) {
+		return;
+	}
+	AllocHeader *header = static_cast<AllocHeader*>(ptr) - 1;
+	alloc_tracker.remove(header->tag, header->size);
+	std::free(reinterpret_cast<uchar*>(header) - header->offset);
+}
+
+void* operator new(usize size) {
+	return trackedAlloc(size);
+}
+
+void* operator new[](usize size) {
+	return trackedAlloc(size);
+}
+
+void* operator new(usize size, const std::nothrow_t&) noexcept {
+	try {
+		return trackedAlloc(size);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void* operator new[](usize size, const std::nothrow_t&) noexcept {
+	try {
+		return trackedAlloc(size);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void operator delete(void *ptr) noexcept {
+	trackedFree(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+	trackedFree(ptr);
+}
+
+void operator delete(void *ptr, usize) noexcept {
+	trackedFree(ptr);
+}
+
+void operator delete[](void *ptr, usize) noexcept {
+	trackedFree(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t&) noexcept {
+	trackedFree(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept {
+	trackedFree(ptr);
+}
+
+// over-aligned types (alignas(64) job workers and the like) come through these
+
+void* operator new(usize size, std::align_val_t align) {
+	return trackedAlloc(size, static_cast<usize>(align));
+}
+
+void* operator new[](usize size, std::align_val_t align) {
+	return trackedAlloc(size, static_cast<usize>(align));
+}
+
+void* operator new(usize size, std::align_val_t align, const std::nothrow_t&) noexcept {
+	try {
+		return trackedAlloc(size, static_cast<usize>(align));
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void* operator new[](usize size, std::align_val_t align, const std::nothrow_t&) noexcept {
+	try {
+		return trackedAlloc(size, static_cast<usize>(align));
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+	trackedFree(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+	trackedFree(ptr);
+}
+
+void operator delete(void *ptr, usize, std::align_val_t) noexcept {
+	trackedFree(ptr);
+}
+
+void operator delete[](void *ptr, usize, std::align_val_t) noexcept {
+	trackedFree(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+	trackedFree(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+	trackedFree(ptr);
+}
+
+#endif
@@ -11,6 +11,7 @@
 #include <bone.hpp>
 #include <utils.hpp>
 #include <model.hpp>
+#include <load_stats.hpp>
 
 struct AssimpNode {
 	glm::mat4 transform;
@@ -40,8 +41,9 @@ struct Animation {
 	AssimpNode root_node;
 
 	static Animation init(const std::string& filepath, std::map<std::string, BoneInfo>& bone_info_map) {
+		LoadAsset asset(filepath);
 		Assimp::Importer imp;
-		const aiScene *scene = imp.ReadFile(filepath, aiProcess_Triangulate);
+		const aiScene *scene = readScene(imp, filepath, aiProcess_Triangulate);
 		if (!(scene && scene->mRootNode)) {
 			std::cerr << "assimp(error): " << imp.GetErrorString() << std::endl;
 			return {
@@ -50,6 +52,7 @@ struct Animation {
 		}
 
 		auto anim = scene->mAnimations[0];
+		LoadTimer timer(LOAD_BONES);
 
 		// populate bones and also add missing bones
 		std::vector<Bone> bones;
@@ -67,12 +70,19 @@ struct Animation {
 			bones.push_back(Bone::init(bone_name, bone_info_map[bone_name].id, channel));
 		}
 
+		AssimpNode root_node = AssimpNode::init(scene->mRootNode);
+		uint64_t key_bytes = 0;
+		for (const auto& bone : bones) {
+			key_bytes += bone.positions.size() * sizeof(KeyPosition) + bone.rotations.size() * sizeof(KeyRotation) + bone.scales.size() * sizeof(KeyScale);
+		}
+		timer.stop(key_bytes);
+
 		return {
 			.bones = bones,
 			.bone_info_map = bone_info_map,
 			.duration = (float)anim->mDuration,
 			.ticks_per_sec = (float)anim->mTicksPerSecond,
-			.root_node = AssimpNode::init(scene->mRootNode),
+			.root_node = std::move(root_node),
 		};
 	}
 
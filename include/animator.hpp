@@ -11,18 +11,24 @@
 
 #include <animation.hpp>
 #include <bone.hpp>
+#include <counters.hpp>
 
 // TODO: multiple animations
 struct Animator {
 	std::vector<glm::mat4> bone_matrices;
 	Animation* curr_anim;
 	float curr_time;
+	// before the last advance(), pose() interpolates from here
+	Animation* prev_anim;
+	float prev_time;
 
 	static Animator init(Animation* animation) {
 		return {
 			.bone_matrices = std::vector<glm::mat4>(MAX_BONE_MATRICES, glm::mat4(1.0f)),
 			.curr_anim = animation,
 			.curr_time = 0,
+			.prev_anim = animation,
+			.prev_time = 0,
 		};
 	}
 
@@ -31,32 +37,63 @@ struct Animator {
 		this->curr_time = 0;
 	}
 
-	void updateAnimation(float dt) {
+	// moves the clock only, so fixed sim steps don't each pay for a palette
+	void advance(float dt) {
+		this->prev_anim = this->curr_anim;
+		this->prev_time = this->curr_time;
 		if (this->curr_anim) {
 			this->curr_time = std::fmod(this->curr_time + this->curr_anim->ticks_per_sec * dt, this->curr_anim->duration);
-			this->calculateBoneTransform(&this->curr_anim->root_node, glm::mat4(1.0f));
 		}
 	}
 
-	void calculateBoneTransform(const AssimpNode* node, const glm::mat4& parent_transform) {
-		std::string node_name = node->name;
+	// the palette `alpha` of the way from the previous advance() to the last one. a clip that changed
+	// in between isn't blended, it just starts
+	void pose(float alpha) {
+		if (!this->curr_anim) {
+			return;
+		}
+		float time = this->curr_time;
+		if (this->prev_anim == this->curr_anim) {
+			const float duration = this->curr_anim->duration;
+			// wrapped around the end of the clip
+			if (time < this->prev_time) {
+				time += duration;
+			}
+			time = std::fmod(this->prev_time + (time - this->prev_time) * alpha, duration);
+		}
+		COUNTER_ADD(COUNTER_SKELETONS, 1);
+		this->calculateBoneTransform(&this->curr_anim->root_node, glm::mat4(1.0f), time);
+	}
+
+	void updateAnimation(float dt) {
+		this->advance(dt);
+		this->pose(1.0f);
+	}
+
+	void calculateBoneTransform(const AssimpNode* node, const glm::mat4& parent_transform, float time) {
+		const std::string& node_name = node->name;
 		glm::mat4 node_transform = node->transform;
 
 		auto bone = this->curr_anim->findBone(node_name);
+		// findBone() is a search too
+		COUNTER_ADD(COUNTER_KEYFRAME_SEARCHES, 1);
 		if (bone) {
-			bone->update(this->curr_time);
+			// one per channel that has more than a single key
+			COUNTER_ADD(COUNTER_KEYFRAME_SEARCHES, (bone->positions.size() > 1) + (bone->rotations.size() > 1) + (bone->scales.size() > 1));
+			bone->update(time);
 			node_transform = bone->local_transform;
 		}
 
 		glm::mat4 global_transform = parent_transform * node_transform;
 
 		auto& bone_info_map = this->curr_anim->bone_info_map;
-		if (bone_info_map.contains(node_name)) {
-			bone_matrices[bone_info_map[node_name].id] = global_transform * bone_info_map[node_name].offset;
+		auto bone_info = bone_info_map.find(node_name);
+		if (bone_info != bone_info_map.end()) {
+			bone_matrices[bone_info->second.id] = global_transform * bone_info->second.offset;
 		}
 
 		for (usize i = 0; i < node->children.size(); i++) {
-			this->calculateBoneTransform(&node->children[i], global_transform);
+			this->calculateBoneTransform(&node->children[i], global_transform, time);
 		}
 	}
 };
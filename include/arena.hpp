@@ -0,0 +1,65 @@
+#pragma once
+
+/* Per-frame linear allocator for transient data, reset once the frame is done */
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include <types.hpp>
+
+struct FrameArena {
+	std::unique_ptr<uchar[]> base;
+	usize capacity;
+	usize offset;
+	// whatever didn't fit this frame, folded into `base` by the next reset() so the arena stops
+	// touching the heap once it has seen its busiest frame
+	std::vector<std::unique_ptr<uchar[]>> overflow;
+	usize overflow_bytes;
+	// most bytes handed out in one frame
+	usize high_water;
+
+	static FrameArena init(usize capacity) {
+		FrameArena arena = {};
+		arena.base = std::make_unique_for_overwrite<uchar[]>(capacity);
+		arena.capacity = capacity;
+		return arena;
+	}
+
+	void* alloc(usize size, usize align) {
+		usize p = (this->offset + align - 1) & ~(align - 1);
+		if (p + size <= this->capacity) {
+			this->offset = p + size;
+			this->high_water = std::max(this->high_water, this->offset + this->overflow_bytes);
+			return this->base.get() + p;
+		}
+		this->overflow.push_back(std::make_unique_for_overwrite<uchar[]>(size + align));
+		this->overflow_bytes += size + align;
+		this->high_water = std::max(this->high_water, this->offset + this->overflow_bytes);
+		uintptr_t q = reinterpret_cast<uintptr_t>(this->overflow.back().get());
+		return reinterpret_cast<void*>((q + align - 1) & ~(uintptr_t)(align - 1));
+	}
+
+	// uninitialized, nothing in here is ever destructed
+	template <typename T>
+	T* alloc(usize n) {
+		static_assert(std::is_trivially_destructible_v<T>);
+		return static_cast<T*>(this->alloc(n * sizeof(T), alignof(T)));
+	}
+
+	// everything handed out since the last reset() is gone after this
+	void reset() {
+		if (!this->overflow.empty()) {
+			this->capacity = std::max(2 * this->capacity, this->capacity + this->overflow_bytes);
+			this->base = std::make_unique_for_overwrite<uchar[]>(this->capacity);
+			this->overflow.clear();
+			this->overflow_bytes = 0;
+		}
+		this->offset = 0;
+	}
+};
+
+// main thread only, reset at the end of every frame
+inline FrameArena frame_arena;
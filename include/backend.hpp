@@ -0,0 +1,160 @@
+#pragma once
+
+/* Where frames go: a GLFW window, or an offscreen framebuffer on a surfaceless EGL context */
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <iostream>
+
+#include <types.hpp>
+#include <utils.hpp>
+
+enum BackendKind {
+	BACKEND_WINDOW,
+	// no display needed, mesa's llvmpipe is enough
+	BACKEND_HEADLESS,
+};
+
+struct Backend {
+	BackendKind kind;
+	// BACKEND_WINDOW only
+	GLFWwindow *window;
+	// BACKEND_HEADLESS only
+	EGLDisplay display;
+	EGLContext context;
+	uint color_rb;
+	uint depth_rb;
+	// what the frame is rendered into, 0 for the window
+	uint framebuffer;
+	ivec2 size;
+
+	static Backend init(BackendKind kind, ivec2 size) {
+		Backend backend = {};
+		backend.kind = kind;
+		backend.size = size;
+		switch (kind) {
+		case BACKEND_WINDOW:
+			backend.window = ::init();
+			glfwGetWindowSize(backend.window, &backend.size.x, &backend.size.y);
+			break;
+		case BACKEND_HEADLESS:
+			backend.initHeadless();
+			break;
+		}
+		return backend;
+	}
+
+	void initHeadless() {
+		this->display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		EGLint major, minor;
+		if (this->display == EGL_NO_DISPLAY || !eglInitialize(this->display, &major, &minor)) {
+			std::cout << "Failed to initialize surfaceless EGL display" << std::endl;
+			exit(-1);
+		}
+		std::cout << "EGL " << major << "." << minor << " (" << eglQueryString(this->display, EGL_VENDOR) << ")" << std::endl;
+
+		const EGLint config_attribs[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_NONE,
+		};
+		EGLConfig config;
+		EGLint n_configs = 0;
+		eglBindAPI(EGL_OPENGL_API);
+		if (!eglChooseConfig(this->display, config_attribs, &config, 1, &n_configs) || n_configs == 0) {
+			std::cout << "Failed to find an EGL config" << std::endl;
+			exit(-1);
+		}
+
+		const EGLint context_attribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 4,
+			EGL_CONTEXT_MINOR_VERSION, 6,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE,
+		};
+		this->context = eglCreateContext(this->display, config, EGL_NO_CONTEXT, context_attribs);
+		if (this->context == EGL_NO_CONTEXT || !eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, this->context)) {
+			std::cout << "Failed to create a surfaceless GL 4.6 context" << std::endl;
+			exit(-1);
+		}
+
+		int version = gladLoadGL(reinterpret_cast<GLADloadfunc>(eglGetProcAddress));
+		if (version == 0) {
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			exit(-1);
+		}
+		std::cout << "GL " << GLAD_VERSION_MAJOR(version) << "." << GLAD_VERSION_MINOR(version) << " (headless)" << std::endl;
+
+		glEnable(GL_DEBUG_OUTPUT);
+		glDebugMessageCallback(debugMessageCallback, 0);
+
+		// there's no default framebuffer without a surface
+		glCreateRenderbuffers(1, &this->color_rb);
+		glNamedRenderbufferStorage(this->color_rb, GL_RGBA8, this->size.x, this->size.y);
+		glCreateRenderbuffers(1, &this->depth_rb);
+		glNamedRenderbufferStorage(this->depth_rb, GL_DEPTH_COMPONENT24, this->size.x, this->size.y);
+		gpu_resources.renderbuffer(this->color_rb, GL_RGBA8, this->size.x, this->size.y);
+		gpu_resources.renderbuffer(this->depth_rb, GL_DEPTH_COMPONENT24, this->size.x, this->size.y);
+		glCreateFramebuffers(1, &this->framebuffer);
+		glNamedFramebufferRenderbuffer(this->framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->color_rb);
+		glNamedFramebufferRenderbuffer(this->framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depth_rb);
+		if (glCheckNamedFramebufferStatus(this->framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			std::cout << "Failed to create the offscreen framebuffer" << std::endl;
+			exit(-1);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+		glViewport(0, 0, this->size.x, this->size.y);
+	}
+
+	bool headless() const {
+		return this->kind == BACKEND_HEADLESS;
+	}
+
+	bool shouldClose() const {
+		return this->window != nullptr && glfwWindowShouldClose(this->window);
+	}
+
+	// what present() shows, in pixels
+	ivec2 framebufferSize() const {
+		ivec2 size = this->size;
+		if (this->window != nullptr) {
+			glfwGetFramebufferSize(this->window, &size.x, &size.y);
+		}
+		return size;
+	}
+
+	void pollEvents() const {
+		if (this->window != nullptr) {
+			glfwPollEvents();
+		}
+	}
+
+	void present() const {
+		if (this->window != nullptr) {
+			glfwSwapBuffers(this->window);
+		} else {
+			// nothing to swap, but wait like a swap would so frame times mean something
+			glFinish();
+		}
+	}
+
+	void deinit() {
+		switch (this->kind) {
+		case BACKEND_WINDOW:
+			::deinit(&this->window);
+			break;
+		case BACKEND_HEADLESS:
+			glDeleteFramebuffers(1, &this->framebuffer);
+			gpu_resources.deleteRenderbuffers(1, &this->color_rb);
+			gpu_resources.deleteRenderbuffers(1, &this->depth_rb);
+			eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			eglDestroyContext(this->display, this->context);
+			eglTerminate(this->display);
+			break;
+		}
+	}
+};
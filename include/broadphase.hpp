@@ -0,0 +1,269 @@
+#pragma once
+
+/* Collision broadphase: a uniform spatial hash grid over body boxes, updated incrementally as bodies move */
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <types.hpp>
+
+// a body covering more cells than this isn't inserted into them, it goes on a list every query checks
+#define SPATIAL_HASH_MAX_CELLS 64
+// per axis in a cell key, coordinates wrap past this which only costs an extra overlap test
+#define SPATIAL_HASH_AXIS_BITS 21
+
+struct BroadphaseBody {
+	Box box;
+	// inclusive range of cells it's in, unused when oversized
+	ivec3 lo;
+	ivec3 hi;
+	// static bodies are only ever paired with dynamic ones
+	bool dynamic;
+	// where it is in SpatialHash::dynamic while dynamic
+	uint dynamic_index;
+	bool oversized;
+	bool alive;
+};
+
+typedef std::pair<uint, uint> BodyPair;
+
+// pairs and queries only look at the cells a box covers, so their cost follows how crowded it is
+// around the dynamic bodies rather than how many bodies there are
+struct SpatialHash {
+	float cell_size;
+	float inv_cell_size;
+	std::vector<BroadphaseBody> bodies;
+	// cell key -> bodies in it
+	std::unordered_map<uint64_t, std::vector<uint>> cells;
+	std::vector<uint> oversized;
+	std::vector<uint> dynamic;
+	// ids of removed bodies, reused by insert()
+	std::vector<uint> free_ids;
+	// update() calls since init(), and how many of those changed cells
+	usize updates;
+	usize moves;
+
+	// `cell_size` around the size of a typical dynamic body, a few times smaller than the world's spacing
+	static SpatialHash init(float cell_size) {
+		SpatialHash hash = {};
+		hash.cell_size = cell_size;
+		hash.inv_cell_size = 1.0f / cell_size;
+		return hash;
+	}
+
+	ivec3 cellOf(vec3 p) const {
+		return ivec3(glm::floor(p * this->inv_cell_size));
+	}
+
+	static uint64_t key(ivec3 cell) {
+		const uint64_t mask = (1ull << SPATIAL_HASH_AXIS_BITS) - 1;
+		return ((uint64_t)cell.x & mask)
+		     | ((uint64_t)cell.y & mask) << SPATIAL_HASH_AXIS_BITS
+		     | ((uint64_t)cell.z & mask) << (2 * SPATIAL_HASH_AXIS_BITS);
+	}
+
+	static usize cellCount(ivec3 lo, ivec3 hi) {
+		return (usize)((int64_t)hi.x - lo.x + 1) * ((int64_t)hi.y - lo.y + 1) * ((int64_t)hi.z - lo.z + 1);
+	}
+
+	// returns the body's id, which stays valid until remove()
+	uint insert(const Box& box, bool dynamic) {
+		uint id;
+		if (!this->free_ids.empty()) {
+			id = this->free_ids.back();
+			this->free_ids.pop_back();
+		} else {
+			id = this->bodies.size();
+			this->bodies.emplace_back();
+		}
+		this->bodies[id] = { .box = box, .lo = ivec3(0), .hi = ivec3(0), .dynamic = false, .dynamic_index = 0, .oversized = false, .alive = true };
+		this->setDynamic(id, dynamic);
+		this->place(id);
+		return id;
+	}
+
+	void remove(uint id) {
+		this->unplace(id);
+		this->setDynamic(id, false);
+		this->bodies[id].alive = false;
+		this->free_ids.push_back(id);
+	}
+
+	// a static body is only looked at when a dynamic one runs into it. constant time, so whole piles of
+	// bodies can go to sleep and wake up at once
+	void setDynamic(uint id, bool dynamic) {
+		BroadphaseBody& body = this->bodies[id];
+		if (body.dynamic == dynamic) {
+			return;
+		}
+		body.dynamic = dynamic;
+		if (dynamic) {
+			body.dynamic_index = this->dynamic.size();
+			this->dynamic.push_back(id);
+		} else {
+			const uint last = this->dynamic.back();
+			this->dynamic[body.dynamic_index] = last;
+			this->bodies[last].dynamic_index = body.dynamic_index;
+			this->dynamic.pop_back();
+		}
+	}
+
+	// only touches the grid when the box crossed into different cells
+	void update(uint id, const Box& box) {
+		this->updates++;
+		BroadphaseBody& body = this->bodies[id];
+		const ivec3 lo = this->cellOf(box.min), hi = this->cellOf(box.max);
+		const bool oversized = cellCount(lo, hi) > SPATIAL_HASH_MAX_CELLS;
+		if (oversized == body.oversized && (oversized || (lo == body.lo && hi == body.hi))) {
+			body.box = box;
+			return;
+		}
+		this->moves++;
+		this->unplace(id);
+		body.box = box;
+		this->place(id);
+	}
+
+	void place(uint id) {
+		BroadphaseBody& body = this->bodies[id];
+		body.lo = this->cellOf(body.box.min);
+		body.hi = this->cellOf(body.box.max);
+		body.oversized = cellCount(body.lo, body.hi) > SPATIAL_HASH_MAX_CELLS;
+		if (body.oversized) {
+			this->oversized.push_back(id);
+			return;
+		}
+		for (int z = body.lo.z; z <= body.hi.z; z++) {
+			for (int y = body.lo.y; y <= body.hi.y; y++) {
+				for (int x = body.lo.x; x <= body.hi.x; x++) {
+					this->cells[key(ivec3(x, y, z))].push_back(id);
+				}
+			}
+		}
+	}
+
+	void unplace(uint id) {
+		const BroadphaseBody& body = this->bodies[id];
+		if (body.oversized) {
+			eraseId(this->oversized, id);
+			return;
+		}
+		for (int z = body.lo.z; z <= body.hi.z; z++) {
+			for (int y = body.lo.y; y <= body.hi.y; y++) {
+				for (int x = body.lo.x; x <= body.hi.x; x++) {
+					auto cell = this->cells.find(key(ivec3(x, y, z)));
+					eraseId(cell->second, id);
+					if (cell->second.empty()) {
+						this->cells.erase(cell);
+					}
+				}
+			}
+		}
+	}
+
+	// order doesn't matter anywhere ids are kept
+	static void eraseId(std::vector<uint>& ids, uint id) {
+		auto it = std::find(ids.begin(), ids.end(), id);
+		*it = ids.back();
+		ids.pop_back();
+	}
+
+	// two bodies in several of the same cells are only looked at in the first of them
+	static bool firstSharedCell(ivec3 cell, const BroadphaseBody& a, ivec3 lo) {
+		return cell == glm::max(a.lo, lo);
+	}
+
+	// bodies whose box overlaps `box`, each once
+	void query(const Box& box, std::vector<uint>& out) const {
+		const ivec3 lo = this->cellOf(box.min), hi = this->cellOf(box.max);
+		if (cellCount(lo, hi) > SPATIAL_HASH_MAX_CELLS) {
+			for (uint id = 0; id < this->bodies.size(); id++) {
+				if (this->bodies[id].alive && this->bodies[id].box.overlaps(box)) {
+					out.push_back(id);
+				}
+			}
+			return;
+		}
+		for (int z = lo.z; z <= hi.z; z++) {
+			for (int y = lo.y; y <= hi.y; y++) {
+				for (int x = lo.x; x <= hi.x; x++) {
+					auto cell = this->cells.find(key(ivec3(x, y, z)));
+					if (cell == this->cells.end()) {
+						continue;
+					}
+					for (uint id : cell->second) {
+						const BroadphaseBody& body = this->bodies[id];
+						if (firstSharedCell(ivec3(x, y, z), body, lo) && body.box.overlaps(box)) {
+							out.push_back(id);
+						}
+					}
+				}
+			}
+		}
+		for (uint id : this->oversized) {
+			if (this->bodies[id].box.overlaps(box)) {
+				out.push_back(id);
+			}
+		}
+	}
+
+	// every overlapping pair with at least one dynamic body, each once. a pair is reported by whichever
+	// of its bodies is dynamic, by the lower id when both are, and by the one in the grid when the other
+	// is oversized
+	void pairs(std::vector<BodyPair>& out) const {
+		this->pairs(0, this->dynamic.size(), out);
+	}
+
+	// the pairs reported by dynamic[first, last). doesn't touch the grid, so ranges can go to different threads
+	void pairs(usize first, usize last, std::vector<BodyPair>& out) const {
+		for (usize i = first; i < last; i++) {
+			const uint a = this->dynamic[i];
+			const BroadphaseBody& body = this->bodies[a];
+			if (body.oversized) {
+				for (uint b = 0; b < this->bodies.size(); b++) {
+					const BroadphaseBody& other = this->bodies[b];
+					if (b == a || !other.alive || (other.dynamic && (!other.oversized || b < a))) {
+						continue;
+					}
+					if (body.box.overlaps(other.box)) {
+						out.push_back({ a, b });
+					}
+				}
+				continue;
+			}
+			for (int z = body.lo.z; z <= body.hi.z; z++) {
+				for (int y = body.lo.y; y <= body.hi.y; y++) {
+					for (int x = body.lo.x; x <= body.hi.x; x++) {
+						const std::vector<uint>& cell = this->cells.find(key(ivec3(x, y, z)))->second;
+						for (uint b : cell) {
+							const BroadphaseBody& other = this->bodies[b];
+							if (b == a || (other.dynamic && b < a)) {
+								continue;
+							}
+							if (firstSharedCell(ivec3(x, y, z), other, body.lo) && body.box.overlaps(other.box)) {
+								out.push_back({ a, b });
+							}
+						}
+					}
+				}
+			}
+			for (uint b : this->oversized) {
+				if (body.box.overlaps(this->bodies[b].box)) {
+					out.push_back({ a, b });
+				}
+			}
+		}
+	}
+
+	void print(std::ostream& out) const {
+		out << "broadphase(info): " << this->bodies.size() - this->free_ids.size() << " bodies (" << this->dynamic.size()
+		    << " dynamic, " << this->oversized.size() << " oversized) in " << this->cells.size() << " cells of "
+		    << this->cell_size << ", " << this->moves << " of " << this->updates << " updates changed cells" << std::endl;
+	}
+};
@@ -0,0 +1,411 @@
+#pragma once
+
+/* Bounding volume hierarchy over scene object instances */
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <types.hpp>
+#include <cull.hpp>
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF 4
+// traversal stack slots, a tree is never built deeper than this minus 2 so it can't overflow
+#define BVH_STACK 128
+// subtrees smaller than this aren't worth a thread
+#define BVH_PARALLEL_MIN 4096
+
+struct BVHNode {
+	Box box;
+	// leaf: first index in SceneBVH.refs. inner: index of the left child, right child follows it
+	uint first;
+	// 0 for inner nodes
+	uint count;
+
+	bool isLeaf() const {
+		return this->count > 0;
+	}
+};
+
+struct RayHit {
+	uint id;
+	float t;
+};
+
+struct SceneBVH {
+	std::vector<BVHNode> nodes;
+	// object ids in leaf order
+	std::vector<uint> refs;
+	// world space box per object id, the only input
+	std::vector<Box> boxes;
+	// object id -> leaf node and node -> parent node, for incremental refits
+	std::vector<uint> leaf_of;
+	std::vector<uint> parent;
+	// SAH cost right after the last build and as of the last refit or update()
+	float built_cost;
+	float cost;
+	// what `cost` is before dividing by the root's area, kept current by update()
+	float area_cost;
+	// of the deepest leaf, the root is 0
+	uint max_depth;
+	// rebuild once refits have degraded the tree by this much
+	float rebuild_ratio;
+	uint n_threads;
+
+	static SceneBVH init(std::vector<Box> boxes, uint n_threads) {
+		SceneBVH bvh = {};
+		bvh.boxes = std::move(boxes);
+		bvh.rebuild_ratio = 1.3f;
+		bvh.n_threads = std::max(n_threads, 1u);
+		bvh.build();
+		return bvh;
+	}
+
+	void build() {
+		const uint n = this->boxes.size();
+		this->refs.resize(n);
+		for (uint i = 0; i < n; i++) {
+			this->refs[i] = i;
+		}
+		this->leaf_of.assign(n, 0);
+		// a binary tree with n leaves never has more than 2n - 1 nodes
+		this->nodes.resize(std::max(2 * n, 1u));
+		this->parent.assign(this->nodes.size(), 0);
+		// shared between build threads, each grabs its children pairs from it
+		std::atomic<uint> n_nodes = n > 0 ? 1 : 0;
+		std::atomic<uint> max_depth = 0;
+
+		if (n > 0) {
+			// 2^depth threads at most
+			int par_depth = 0;
+			while ((1u << par_depth) < this->n_threads) {
+				par_depth++;
+			}
+			this->buildNode(n_nodes, max_depth, 0, 0, n, 0, par_depth);
+		}
+		this->nodes.resize(n_nodes);
+		this->parent.resize(n_nodes);
+		this->max_depth = max_depth;
+
+		this->updateCost();
+		this->built_cost = this->cost;
+	}
+
+	// moves one object and refits its path to the root
+	void update(uint id, const Box& box) {
+		this->boxes[id] = box;
+		uint node = this->leaf_of[id];
+		while (true) {
+			Box old = this->nodes[node].box;
+			const float old_cost = nodeCost(this->nodes[node]);
+			this->refitNode(node);
+			const Box& now = this->nodes[node].box;
+			this->area_cost += nodeCost(this->nodes[node]) - old_cost;
+			if (node == 0 || (old.min == now.min && old.max == now.max)) {
+				break;
+			}
+			node = this->parent[node];
+		}
+		this->cost = this->area_cost / rootArea();
+	}
+
+	// full bottom-up pass, cheaper than update() once lots of objects moved.
+	// children are always allocated after their parent so walking backwards is bottom-up
+	void refit() {
+		for (uint i = this->nodes.size(); i-- > 0;) {
+			this->refitNode(i);
+		}
+		this->updateCost();
+	}
+
+	// rebuilds if refits made the tree too loose, returns whether it did
+	bool maintain() {
+		if (this->cost > this->rebuild_ratio * this->built_cost) {
+			this->build();
+			return true;
+		}
+		return false;
+	}
+
+	void queryFrustum(const Frustum& frustum, std::vector<uint>& out) const {
+		if (this->nodes.empty()) {
+			return;
+		}
+		uint stack[BVH_STACK];
+		int sp = 0;
+		stack[sp++] = 0;
+		while (sp > 0) {
+			const BVHNode& node = this->nodes[stack[--sp]];
+			Containment c = frustum.classifyBox(node.box.center(), node.box.extent());
+			if (c == OUTSIDE) {
+				continue;
+			}
+			if (c == INSIDE) {
+				this->collect(node, out);
+			} else if (node.isLeaf()) {
+				for (uint i = node.first; i < node.first + node.count; i++) {
+					const Box& box = this->boxes[this->refs[i]];
+					if (frustum.testBox(box.center(), box.extent())) {
+						out.push_back(this->refs[i]);
+					}
+				}
+			} else {
+				assert(sp + 2 <= BVH_STACK);
+				stack[sp++] = node.first;
+				stack[sp++] = node.first + 1;
+			}
+		}
+	}
+
+	void queryBox(const Box& box, std::vector<uint>& out) const {
+		if (this->nodes.empty()) {
+			return;
+		}
+		uint stack[BVH_STACK];
+		int sp = 0;
+		stack[sp++] = 0;
+		while (sp > 0) {
+			const BVHNode& node = this->nodes[stack[--sp]];
+			if (!node.box.overlaps(box)) {
+				continue;
+			}
+			if (node.isLeaf()) {
+				for (uint i = node.first; i < node.first + node.count; i++) {
+					if (this->boxes[this->refs[i]].overlaps(box)) {
+						out.push_back(this->refs[i]);
+					}
+				}
+			} else {
+				assert(sp + 2 <= BVH_STACK);
+				stack[sp++] = node.first;
+				stack[sp++] = node.first + 1;
+			}
+		}
+	}
+
+	// closest object box hit by origin + t*dir, t in [0, max_t]
+	bool raycast(vec3 origin, vec3 dir, float max_t, RayHit& hit) const {
+		if (this->nodes.empty()) {
+			return false;
+		}
+		const vec3 inv_dir = 1.0f / dir;
+		hit = { .id = 0, .t = max_t };
+		bool found = false;
+
+		uint stack[BVH_STACK];
+		int sp = 0;
+		stack[sp++] = 0;
+		while (sp > 0) {
+			const BVHNode& node = this->nodes[stack[--sp]];
+			if (rayBox(origin, inv_dir, node.box, hit.t) > hit.t) {
+				continue;
+			}
+			if (node.isLeaf()) {
+				for (uint i = node.first; i < node.first + node.count; i++) {
+					float t = rayBox(origin, inv_dir, this->boxes[this->refs[i]], hit.t);
+					if (t <= hit.t) {
+						hit = { .id = this->refs[i], .t = t };
+						found = true;
+					}
+				}
+			} else {
+				// near child last so it's popped first and shrinks hit.t early
+				uint l = node.first, r = node.first + 1;
+				float tl = rayBox(origin, inv_dir, this->nodes[l].box, hit.t);
+				float tr = rayBox(origin, inv_dir, this->nodes[r].box, hit.t);
+				if (tl < tr) {
+					std::swap(l, r);
+					std::swap(tl, tr);
+				}
+				assert(sp + 2 <= BVH_STACK);
+				if (tl <= hit.t) stack[sp++] = l;
+				if (tr <= hit.t) stack[sp++] = r;
+			}
+		}
+		return found;
+	}
+
+	// slab test, entry t or infinity on a miss
+	static float rayBox(vec3 origin, vec3 inv_dir, const Box& box, float max_t) {
+		vec3 t0 = (box.min - origin) * inv_dir;
+		vec3 t1 = (box.max - origin) * inv_dir;
+		vec3 t_near = glm::min(t0, t1), t_far = glm::max(t0, t1);
+		float t_enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+		float t_exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, max_t));
+		return t_enter <= t_exit ? t_enter : std::numeric_limits<float>::infinity();
+	}
+
+	void collect(const BVHNode& root, std::vector<uint>& out) const {
+		uint stack[BVH_STACK];
+		int sp = 0;
+		const BVHNode* node = &root;
+		while (true) {
+			if (node->isLeaf()) {
+				out.insert(out.end(), this->refs.begin() + node->first, this->refs.begin() + node->first + node->count);
+			} else {
+				assert(sp + 2 <= BVH_STACK);
+				stack[sp++] = node->first;
+				stack[sp++] = node->first + 1;
+			}
+			if (sp == 0) {
+				break;
+			}
+			node = &this->nodes[stack[--sp]];
+		}
+	}
+
+	void refitNode(uint i) {
+		BVHNode& node = this->nodes[i];
+		Box box = Box::empty();
+		if (node.isLeaf()) {
+			for (uint j = node.first; j < node.first + node.count; j++) {
+				box.expand(this->boxes[this->refs[j]]);
+			}
+		} else {
+			box.expand(this->nodes[node.first].box);
+			box.expand(this->nodes[node.first + 1].box);
+		}
+		node.box = box;
+	}
+
+	// inner nodes cost 1 and leaves 1 per object, times the chance a random query reaches them
+	static float nodeCost(const BVHNode& node) {
+		return node.box.surfaceArea() * (node.isLeaf() ? node.count : 1.0f);
+	}
+
+	float rootArea() const {
+		return this->nodes.empty() ? 1.0f : std::max(this->nodes[0].box.surfaceArea(), 1e-12f);
+	}
+
+	// expected cost of a random query relative to testing the root
+	float sahCost() const {
+		float cost = 0.0f;
+		for (const auto& node : this->nodes) {
+			cost += nodeCost(node);
+		}
+		return cost / this->rootArea();
+	}
+
+	// from scratch, update() only adds the difference so this also clears its rounding
+	void updateCost() {
+		this->area_cost = 0.0f;
+		for (const auto& node : this->nodes) {
+			this->area_cost += nodeCost(node);
+		}
+		this->cost = this->area_cost / this->rootArea();
+	}
+
+	void makeLeaf(uint i, uint first, uint count) {
+		this->nodes[i].first = first;
+		this->nodes[i].count = count;
+		for (uint j = first; j < first + count; j++) {
+			this->leaf_of[this->refs[j]] = i;
+		}
+	}
+
+	void buildNode(std::atomic<uint>& n_nodes, std::atomic<uint>& max_depth, uint i, uint first, uint count, uint depth, int par_depth) {
+		Box box = Box::empty(), centroids = Box::empty();
+		for (uint j = first; j < first + count; j++) {
+			const Box& b = this->boxes[this->refs[j]];
+			box.expand(b);
+			centroids.expand(b.center());
+		}
+		this->nodes[i].box = box;
+
+		// a lopsided scene gets a big leaf at the bottom rather than a tree too deep to traverse
+		if (count <= BVH_MAX_LEAF || depth + 2 >= BVH_STACK) {
+			this->makeLeaf(i, first, count);
+			uint deepest = max_depth.load(std::memory_order_relaxed);
+			while (depth > deepest && !max_depth.compare_exchange_weak(deepest, depth, std::memory_order_relaxed)) {}
+			return;
+		}
+
+		vec3 size = centroids.max - centroids.min;
+		int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+		uint mid = first;
+		if (size[axis] > 0.0f) {
+			// SAH over BVH_BINS equal bins along the widest centroid axis
+			struct Bin {
+				Box box;
+				uint count;
+			};
+			Bin bins[BVH_BINS];
+			for (auto& bin : bins) {
+				bin = { .box = Box::empty(), .count = 0 };
+			}
+			const float scale = BVH_BINS / size[axis];
+			auto binOf = [&](uint ref) {
+				float c = this->boxes[ref].center()[axis];
+				return std::min((int)((c - centroids.min[axis]) * scale), BVH_BINS - 1);
+			};
+			for (uint j = first; j < first + count; j++) {
+				Bin& bin = bins[binOf(this->refs[j])];
+				bin.box.expand(this->boxes[this->refs[j]]);
+				bin.count++;
+			}
+
+			// sweep from the right to get the area/count of every right side
+			float right_area[BVH_BINS];
+			uint right_count[BVH_BINS];
+			Box acc = Box::empty();
+			uint acc_count = 0;
+			for (int b = BVH_BINS - 1; b > 0; b--) {
+				acc.expand(bins[b].box);
+				acc_count += bins[b].count;
+				right_area[b] = acc.surfaceArea();
+				right_count[b] = acc_count;
+			}
+
+			int best_split = -1;
+			float best_cost = std::numeric_limits<float>::max();
+			acc = Box::empty();
+			acc_count = 0;
+			for (int b = 1; b < BVH_BINS; b++) {
+				acc.expand(bins[b - 1].box);
+				acc_count += bins[b - 1].count;
+				if (acc_count == 0 || right_count[b] == 0) {
+					continue;
+				}
+				float cost = acc.surfaceArea() * acc_count + right_area[b] * right_count[b];
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_split = b;
+				}
+			}
+
+			if (best_split > 0) {
+				uint* split = std::partition(&this->refs[first], &this->refs[first] + count, [&](uint ref) { return binOf(ref) < best_split; });
+				mid = split - &this->refs[0];
+			}
+		}
+
+		// everything in one bin (or on one point), fall back to a median split
+		if (mid == first || mid == first + count) {
+			mid = first + count / 2;
+			std::nth_element(&this->refs[first], &this->refs[mid], &this->refs[first] + count, [&](uint a, uint b) {
+				return this->boxes[a].center()[axis] < this->boxes[b].center()[axis];
+			});
+		}
+
+		uint left = n_nodes.fetch_add(2);
+		this->nodes[i].first = left;
+		this->nodes[i].count = 0;
+		this->parent[left] = i;
+		this->parent[left + 1] = i;
+
+		if (par_depth > 0 && count >= BVH_PARALLEL_MIN) {
+			std::thread t([&, this] { this->buildNode(n_nodes, max_depth, left, first, mid - first, depth + 1, par_depth - 1); });
+			this->buildNode(n_nodes, max_depth, left + 1, mid, first + count - mid, depth + 1, par_depth - 1);
+			t.join();
+		} else {
+			this->buildNode(n_nodes, max_depth, left, first, mid - first, depth + 1, 0);
+			this->buildNode(n_nodes, max_depth, left + 1, mid, first + count - mid, depth + 1, 0);
+		}
+	}
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+/* Per-frame engine counters with a rolling history */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <types.hpp>
+
+// frames of history kept, older ones are overwritten
+#define COUNTERS_HISTORY 512
+
+// build with -DCOUNTERS_DISABLE to compile every increment out, arguments included
+#ifndef COUNTERS_DISABLE
+#define COUNTER_ADD(counter, n) counters.add(counter, n)
+#else
+#define COUNTER_ADD(counter, n)
+#endif
+
+enum Counter {
+	COUNTER_DRAW_CALLS,
+	COUNTER_TRIANGLES,
+	COUNTER_VERTICES,
+	COUNTER_UBO_BYTES,
+	COUNTER_BONE_PALETTE_BYTES,
+	COUNTER_TEXTURE_BINDS,
+	COUNTER_SHADER_SWITCHES,
+	COUNTER_SKELETONS,
+	COUNTER_KEYFRAME_SEARCHES,
+	COUNTER_COLLISION_TESTS,
+	COUNTER_COUNT,
+};
+
+const std::array<const char*, COUNTER_COUNT> counter_names = {
+	"draw_calls",
+	"triangles",
+	"vertices",
+	"ubo_bytes",
+	"bone_palette_bytes",
+	"texture_binds",
+	"shader_switches",
+	"skeletons",
+	"keyframe_searches",
+	"collision_tests",
+};
+
+typedef std::array<uint64_t, COUNTER_COUNT> CounterFrame;
+
+struct Counters {
+	// the frame in progress, atomic so worker threads can count too
+	std::array<std::atomic<uint64_t>, COUNTER_COUNT> current;
+	std::array<CounterFrame, COUNTERS_HISTORY> history;
+	// frames finished so far, the newest is history[(frames - 1) % COUNTERS_HISTORY]
+	usize frames;
+
+	void add(Counter counter, uint64_t n) {
+		this->current[counter].fetch_add(n, std::memory_order_relaxed);
+	}
+
+	void endFrame() {
+		CounterFrame& frame = this->history[this->frames % COUNTERS_HISTORY];
+		for (usize i = 0; i < COUNTER_COUNT; i++) {
+			frame[i] = this->current[i].exchange(0, std::memory_order_relaxed);
+		}
+		this->frames++;
+	}
+
+	usize size() const {
+		return std::min<usize>(this->frames, COUNTERS_HISTORY);
+	}
+
+	// 0 is the last finished frame, up to size() - 1
+	const CounterFrame& frame(usize ago) const {
+		return this->history[(this->frames - 1 - ago) % COUNTERS_HISTORY];
+	}
+
+	uint64_t last(Counter counter) const {
+		return this->frames > 0 ? this->frame(0)[counter] : 0;
+	}
+
+	// over the last n frames, or fewer if the history doesn't go back that far
+	double average(Counter counter, usize n) const {
+		n = std::min(n, this->size());
+		uint64_t sum = 0;
+		for (usize i = 0; i < n; i++) {
+			sum += this->frame(i)[counter];
+		}
+		return n > 0 ? (double)sum / n : 0.0;
+	}
+
+	// oldest frame first. JSON if the path ends in .json, CSV otherwise
+	bool write(const std::string& path) const {
+		std::ofstream file(path);
+		if (!file) {
+			std::cerr << "counters(error): can't write " << path << std::endl;
+			return false;
+		}
+		const bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+		const usize n = this->size();
+		if (json) {
+			file << "[";
+		} else {
+			file << "frame";
+			for (const char *name : counter_names) {
+				file << "," << name;
+			}
+			file << "\n";
+		}
+		for (usize i = 0; i < n; i++) {
+			const usize ago = n - 1 - i;
+			const usize index = this->frames - 1 - ago;
+			const CounterFrame& frame = this->frame(ago);
+			if (json) {
+				file << (i > 0 ? ",\n" : "\n") << "{\"frame\":" << index;
+				for (usize c = 0; c < COUNTER_COUNT; c++) {
+					file << ",\"" << counter_names[c] << "\":" << frame[c];
+				}
+				file << "}";
+			} else {
+				file << index;
+				for (usize c = 0; c < COUNTER_COUNT; c++) {
+					file << "," << frame[c];
+				}
+				file << "\n";
+			}
+		}
+		if (json) {
+			file << "\n]\n";
+		}
+		std::cerr << "counters(info): wrote " << n << " frames to " << path << std::endl;
+		return true;
+	}
+
+	void print(std::ostream& out) const {
+		out << "counters(info):";
+		for (usize c = 0; c < COUNTER_COUNT; c++) {
+			out << " " << counter_names[c] << "=" << this->last(static_cast<Counter>(c));
+		}
+		out << std::endl;
+	}
+};
+
+inline Counters counters;
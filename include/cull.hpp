@@ -0,0 +1,225 @@
+#pragma once
+
+/* Frustum culling of world space boxes, 8 at a time */
+
+#include <array>
+#include <vector>
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include <types.hpp>
+
+enum Containment {
+	OUTSIDE,
+	INTERSECTING,
+	INSIDE,
+};
+
+struct Frustum {
+	// xyz = inward normal, w = distance. inside when dot(xyz, p) + w >= 0
+	std::array<vec4, 6> planes;
+
+	// Gribb/Hartmann, planes come straight out of the rows of view_proj
+	static Frustum init(const mat4& view_proj) {
+		auto row = [&](int i) { return vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]); };
+
+		Frustum frustum = {};
+		frustum.planes[0] = row(3) + row(0); // left
+		frustum.planes[1] = row(3) - row(0); // right
+		frustum.planes[2] = row(3) + row(1); // bottom
+		frustum.planes[3] = row(3) - row(1); // top
+		frustum.planes[4] = row(3) + row(2); // near
+		frustum.planes[5] = row(3) - row(2); // far
+		for (auto& p : frustum.planes) {
+			p /= glm::length(vec3(p.x, p.y, p.z));
+		}
+		return frustum;
+	}
+
+	bool testBox(vec3 center, vec3 extent) const {
+		for (const auto& p : this->planes) {
+			float d = p.x*center.x + p.y*center.y + p.z*center.z + p.w;
+			float r = std::abs(p.x)*extent.x + std::abs(p.y)*extent.y + std::abs(p.z)*extent.z;
+			if (d + r < 0.0f) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// like testBox() but also tells apart boxes that don't touch any plane,
+	// so hierarchy traversal can accept whole subtrees without testing them
+	Containment classifyBox(vec3 center, vec3 extent) const {
+		Containment result = INSIDE;
+		for (const auto& p : this->planes) {
+			float d = p.x*center.x + p.y*center.y + p.z*center.z + p.w;
+			float r = std::abs(p.x)*extent.x + std::abs(p.y)*extent.y + std::abs(p.z)*extent.z;
+			if (d + r < 0.0f) {
+				return OUTSIDE;
+			}
+			if (d - r < 0.0f) {
+				result = INTERSECTING;
+			}
+		}
+		return result;
+	}
+};
+
+// world space boxes as center/extent, one array per component so the kernel can load 8 lanes at once
+struct CullBoxes {
+	std::vector<float> cx, cy, cz;
+	std::vector<float> ex, ey, ez;
+
+	usize size() const {
+		return this->cx.size();
+	}
+
+	void clear() {
+		this->cx.clear(); this->cy.clear(); this->cz.clear();
+		this->ex.clear(); this->ey.clear(); this->ez.clear();
+	}
+
+	void reserve(usize n) {
+		this->cx.reserve(n); this->cy.reserve(n); this->cz.reserve(n);
+		this->ex.reserve(n); this->ey.reserve(n); this->ez.reserve(n);
+	}
+
+	void push(const Box& box) {
+		vec3 c = box.center(), e = box.extent();
+		this->cx.push_back(c.x); this->cy.push_back(c.y); this->cz.push_back(c.z);
+		this->ex.push_back(e.x); this->ey.push_back(e.y); this->ez.push_back(e.z);
+	}
+
+	void push(const Box& local, const mat4& model) {
+		this->push(local.transform(model));
+	}
+};
+
+struct CullStats {
+	usize tested;
+	// outside the frustum
+	usize culled;
+	// inside the frustum but hidden behind occluders
+	usize occluded;
+	// too small on screen to be worth drawing, see RenderQueue::cullSmall()
+	usize small;
+
+	usize submitted() const {
+		return this->tested - this->culled - this->occluded - this->small;
+	}
+
+	float rejectedFraction() const {
+		return this->tested > 0 ? (float)(this->culled + this->occluded + this->small) / this->tested : 0.0f;
+	}
+};
+
+// one bit per box, box i is bit (i % 8) of byte (i / 8)
+inline bool isVisible(const std::vector<uchar>& visible, usize i) {
+	return (visible[i >> 3] >> (i & 7)) & 1;
+}
+
+// reference path, also handles whatever doesn't fill a full batch of 8
+void cullBoxesScalar(const Frustum& frustum, const CullBoxes& boxes, usize first, usize last, std::vector<uchar>& visible) {
+	for (usize i = first; i < last; i++) {
+		vec3 c = vec3(boxes.cx[i], boxes.cy[i], boxes.cz[i]);
+		vec3 e = vec3(boxes.ex[i], boxes.ey[i], boxes.ez[i]);
+		if (frustum.testBox(c, e)) {
+			visible[i >> 3] |= 1 << (i & 7);
+		} else {
+			visible[i >> 3] &= ~(1 << (i & 7));
+		}
+	}
+}
+
+void cullBoxesScalar(const Frustum& frustum, const CullBoxes& boxes, usize first, std::vector<uchar>& visible) {
+	cullBoxesScalar(frustum, boxes, first, boxes.size(), visible);
+}
+
+#if defined(__AVX__)
+// returns the 8 bit visibility mask of boxes [i, i + 8)
+inline uint cullBatch8(const Frustum& frustum, const CullBoxes& boxes, usize i) {
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	const __m256 cx = _mm256_loadu_ps(&boxes.cx[i]), cy = _mm256_loadu_ps(&boxes.cy[i]), cz = _mm256_loadu_ps(&boxes.cz[i]);
+	const __m256 ex = _mm256_loadu_ps(&boxes.ex[i]), ey = _mm256_loadu_ps(&boxes.ey[i]), ez = _mm256_loadu_ps(&boxes.ez[i]);
+
+	__m256 outside = _mm256_setzero_ps();
+	for (const auto& p : frustum.planes) {
+		const __m256 nx = _mm256_set1_ps(p.x), ny = _mm256_set1_ps(p.y), nz = _mm256_set1_ps(p.z);
+		__m256 d = _mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_set1_ps(p.w));
+		d = _mm256_add_ps(d, _mm256_mul_ps(ny, cy));
+		d = _mm256_add_ps(d, _mm256_mul_ps(nz, cz));
+		__m256 r = _mm256_mul_ps(_mm256_andnot_ps(sign, nx), ex);
+		r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_andnot_ps(sign, ny), ey));
+		r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_andnot_ps(sign, nz), ez));
+		outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_LT_OQ));
+	}
+	return ~_mm256_movemask_ps(outside) & 0xff;
+}
+#elif defined(__SSE2__)
+inline uint cullBatch4(const Frustum& frustum, const CullBoxes& boxes, usize i) {
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 cx = _mm_loadu_ps(&boxes.cx[i]), cy = _mm_loadu_ps(&boxes.cy[i]), cz = _mm_loadu_ps(&boxes.cz[i]);
+	const __m128 ex = _mm_loadu_ps(&boxes.ex[i]), ey = _mm_loadu_ps(&boxes.ey[i]), ez = _mm_loadu_ps(&boxes.ez[i]);
+
+	__m128 outside = _mm_setzero_ps();
+	for (const auto& p : frustum.planes) {
+		const __m128 nx = _mm_set1_ps(p.x), ny = _mm_set1_ps(p.y), nz = _mm_set1_ps(p.z);
+		__m128 d = _mm_add_ps(_mm_mul_ps(nx, cx), _mm_set1_ps(p.w));
+		d = _mm_add_ps(d, _mm_mul_ps(ny, cy));
+		d = _mm_add_ps(d, _mm_mul_ps(nz, cz));
+		__m128 r = _mm_mul_ps(_mm_andnot_ps(sign, nx), ex);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_andnot_ps(sign, ny), ey));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_andnot_ps(sign, nz), ez));
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+	}
+	return ~_mm_movemask_ps(outside) & 0xf;
+}
+
+// no AVX, two SSE halves per batch
+inline uint cullBatch8(const Frustum& frustum, const CullBoxes& boxes, usize i) {
+	return cullBatch4(frustum, boxes, i) | (cullBatch4(frustum, boxes, i + 4) << 4);
+}
+#endif
+
+// boxes [first, last) only, `visible` has to be big enough already. with `first` a multiple of 8
+// ranges never share a byte, so they can be culled from different threads
+void cullBoxRange(const Frustum& frustum, const CullBoxes& boxes, usize first, usize last, std::vector<uchar>& visible) {
+	usize i = first;
+#if defined(__AVX__) || defined(__SSE2__)
+	for (; i + 8 <= last; i += 8) {
+		visible[i >> 3] = cullBatch8(frustum, boxes, i);
+	}
+#endif
+	cullBoxesScalar(frustum, boxes, i, last, visible);
+}
+
+CullStats cullStats(const std::vector<uchar>& visible, usize n) {
+	usize n_visible = 0;
+	for (usize j = 0; j < n; j += 8) {
+		uint bits = visible[j >> 3];
+		if (n - j < 8) {
+			bits &= (1u << (n - j)) - 1;
+		}
+		n_visible += __builtin_popcount(bits);
+	}
+
+	return {
+		.tested = n,
+		.culled = n - n_visible,
+		.occluded = 0,
+		.small = 0,
+	};
+}
+
+// fills `visible` (resized to hold one bit per box) and returns the stats
+CullStats cullBoxes(const Frustum& frustum, const CullBoxes& boxes, std::vector<uchar>& visible) {
+	const usize n = boxes.size();
+	visible.resize((n + 7) / 8);
+	cullBoxRange(frustum, boxes, 0, n, visible);
+	return cullStats(visible, n);
+}
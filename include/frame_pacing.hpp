@@ -0,0 +1,171 @@
+#pragma once
+
+/* Frame pacing: a frame rate cap with a precise wait, and fences that bound how many frames the GPU has queued */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include <glad/gl.h>
+
+#include <types.hpp>
+
+// more than this and the fences stop being worth it, drivers queue about 3 on their own
+#define FRAME_FENCES_MAX 4
+// glClientWaitSync() gives up after this, a hung GPU shouldn't hang the loop with it
+#define FRAME_FENCES_TIMEOUT_NS 1000000000ull
+
+// sleep_for() wakes up late by a varying amount. the wait sleeps 1ms at a time while more than
+// the expected oversleep (mean + stddev of the sleeps so far) is left, then spins out the rest
+struct FramePacer {
+	// 0 for no cap
+	double period_ms;
+	chrono::steady_clock::time_point next;
+	// running mean and variance of how long sleep_for(1ms) actually takes, Welford's method
+	double sleep_mean_ms;
+	double sleep_m2;
+	usize sleeps;
+	// totals since init()
+	double slept_ms;
+	double spun_ms;
+	// frames that were already past their slot, they don't wait
+	usize missed;
+
+	static FramePacer init(float fps_cap) {
+		return {
+			.period_ms = fps_cap > 0.0f ? 1000.0 / fps_cap : 0.0,
+			.next = chrono::steady_clock::now(),
+			// a guess until there are real numbers
+			.sleep_mean_ms = 1.0,
+			.sleep_m2 = 0.0,
+			.sleeps = 1,
+			.slept_ms = 0.0,
+			.spun_ms = 0.0,
+			.missed = 0,
+		};
+	}
+
+	bool capped() const {
+		return this->period_ms > 0.0;
+	}
+
+	double oversleep() const {
+		const double stddev = this->sleeps > 1 ? std::sqrt(this->sleep_m2 / (this->sleeps - 1)) : 0.0;
+		return this->sleep_mean_ms + stddev;
+	}
+
+	// blocks until the next frame's slot. slots are period_ms apart, a frame that misses its slot
+	// starts the schedule over instead of the next few rushing to catch up
+	void wait() {
+		if (!this->capped()) {
+			return;
+		}
+		auto ms = [](auto d) { return chrono::duration<double, std::milli>(d).count(); };
+		auto now = chrono::steady_clock::now();
+		if (now >= this->next) {
+			this->missed++;
+			this->next = now + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, std::milli>(this->period_ms));
+			return;
+		}
+		while (ms(this->next - now) > this->oversleep()) {
+			std::this_thread::sleep_for(chrono::milliseconds(1));
+			auto woke = chrono::steady_clock::now();
+			const double took = ms(woke - now);
+			this->sleeps++;
+			const double delta = took - this->sleep_mean_ms;
+			this->sleep_mean_ms += delta / this->sleeps;
+			this->sleep_m2 += delta * (took - this->sleep_mean_ms);
+			this->slept_ms += took;
+			now = woke;
+		}
+		const auto spin_start = now;
+		while (now < this->next) {
+			std::this_thread::yield();
+			now = chrono::steady_clock::now();
+		}
+		this->spun_ms += ms(now - spin_start);
+		this->next += chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, std::milli>(this->period_ms));
+	}
+};
+
+// a fence after every frame, and before starting a new one a wait on the one from max_in_flight frames
+// ago. without it the driver lets the CPU run a few frames ahead of the GPU, and under vsync each of
+// those is a frame of input latency
+struct FrameFences {
+	std::array<GLsync, FRAME_FENCES_MAX> fences;
+	// 0 for no limit
+	uint max_in_flight;
+	usize frame;
+	double waited_ms;
+	// waits that hit FRAME_FENCES_TIMEOUT_NS
+	usize timeouts;
+
+	static FrameFences init(uint max_in_flight) {
+		return {
+			.fences = {},
+			.max_in_flight = std::min<uint>(max_in_flight, FRAME_FENCES_MAX),
+			.frame = 0,
+			.waited_ms = 0.0,
+			.timeouts = 0,
+		};
+	}
+
+	// before the frame's first GL call
+	void wait() {
+		if (this->max_in_flight == 0) {
+			return;
+		}
+		GLsync& fence = this->fences[this->frame % this->max_in_flight];
+		if (fence == nullptr) {
+			return;
+		}
+		auto start = chrono::steady_clock::now();
+		if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FRAME_FENCES_TIMEOUT_NS) == GL_TIMEOUT_EXPIRED) {
+			this->timeouts++;
+		}
+		this->waited_ms += chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	// after present()
+	void insert() {
+		if (this->max_in_flight == 0) {
+			return;
+		}
+		this->fences[this->frame % this->max_in_flight] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		this->frame++;
+	}
+
+	void deinit() {
+		for (GLsync& fence : this->fences) {
+			if (fence != nullptr) {
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+		}
+	}
+};
+
+void printPacing(std::ostream& out, const FramePacer& pacer, const FrameFences& fences) {
+	out << std::fixed << std::setprecision(2) << "pacing(info): ";
+	if (pacer.capped()) {
+		out << "capped at " << 1000.0 / pacer.period_ms << " fps, " << pacer.slept_ms << "ms slept, "
+		    << pacer.spun_ms << "ms spun, " << pacer.missed << " frames missed their slot";
+	} else {
+		out << "uncapped";
+	}
+	if (fences.max_in_flight > 0) {
+		out << ", at most " << fences.max_in_flight << " frames in flight (" << fences.waited_ms << "ms waiting on fences";
+		if (fences.timeouts > 0) {
+			out << ", " << fences.timeouts << " timed out";
+		}
+		out << ")";
+	} else {
+		out << ", frames in flight up to the driver";
+	}
+	out << std::endl << std::defaultfloat;
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+/* Per-frame CPU/GPU times and a percentile report over a whole run */
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include <types.hpp>
+
+// frames between issuing a timer query and reading it back, enough that reading never stalls
+#define GPU_TIMER_LATENCY 4
+#define FRAME_TIMES_WORST 5
+
+// GL_TIMESTAMP before and after a frame's GL work, read back GPU_TIMER_LATENCY frames later.
+// timestamps rather than GL_TIME_ELAPSED so the profiler's GPU zones can still nest inside
+struct GpuTimer {
+	std::array<uint, GPU_TIMER_LATENCY> begin_queries;
+	std::array<uint, GPU_TIMER_LATENCY> end_queries;
+	usize frame;
+
+	static GpuTimer init() {
+		GpuTimer timer = {};
+		glCreateQueries(GL_TIMESTAMP, timer.begin_queries.size(), timer.begin_queries.data());
+		glCreateQueries(GL_TIMESTAMP, timer.end_queries.size(), timer.end_queries.data());
+		return timer;
+	}
+
+	float read(usize slot) const {
+		uint64_t begin = 0, end = 0;
+		glGetQueryObjectui64v(this->begin_queries[slot], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(this->end_queries[slot], GL_QUERY_RESULT, &end);
+		return (end - begin) / 1e6f;
+	}
+
+	// returns the frame whose result is now in `ms`, or SIZE_MAX if there's none yet.
+	// call before begin(), it reads the slot begin() is about to reuse
+	usize collect(float& ms) {
+		if (this->frame < GPU_TIMER_LATENCY) {
+			return SIZE_MAX;
+		}
+		ms = this->read(this->frame % GPU_TIMER_LATENCY);
+		return this->frame - GPU_TIMER_LATENCY;
+	}
+
+	void begin() const {
+		glQueryCounter(this->begin_queries[this->frame % GPU_TIMER_LATENCY], GL_TIMESTAMP);
+	}
+
+	void end() {
+		glQueryCounter(this->end_queries[this->frame % GPU_TIMER_LATENCY], GL_TIMESTAMP);
+		this->frame++;
+	}
+
+	void deinit() {
+		glDeleteQueries(this->begin_queries.size(), this->begin_queries.data());
+		glDeleteQueries(this->end_queries.size(), this->end_queries.data());
+	}
+};
+
+struct FrameTimes {
+	// the render thread's part of a frame
+	std::vector<float> cpu_ms;
+	// negative until the query comes back
+	std::vector<float> gpu_ms;
+	// the sim tick that produced the frame, on whichever thread ran it
+	std::vector<float> sim_ms;
+	// from the sim sampling input to present() returning
+	std::vector<float> latency_ms;
+	// the newest GPU time that has come back, GPU_TIMER_LATENCY frames old. negative before the first
+	float last_gpu_ms;
+	GpuTimer gpu_timer;
+
+	static FrameTimes init() {
+		FrameTimes times = {};
+		times.last_gpu_ms = -1.0f;
+		times.gpu_timer = GpuTimer::init();
+		return times;
+	}
+
+	void beginFrame() {
+		float ms;
+		usize frame = this->gpu_timer.collect(ms);
+		if (frame != SIZE_MAX) {
+			this->gpu_ms[frame] = ms;
+			this->last_gpu_ms = ms;
+		}
+		this->gpu_timer.begin();
+	}
+
+	void endFrame(float cpu_ms, float sim_ms) {
+		this->gpu_timer.end();
+		this->cpu_ms.push_back(cpu_ms);
+		this->gpu_ms.push_back(-1.0f);
+		this->sim_ms.push_back(sim_ms);
+	}
+
+	// after present(), for the frame endFrame() just finished
+	void presented(float latency_ms) {
+		this->latency_ms.push_back(latency_ms);
+	}
+
+	// blocks on whatever queries are still in flight
+	void finish() {
+		const usize n = this->gpu_ms.size();
+		for (usize f = n - std::min<usize>(n, GPU_TIMER_LATENCY); f < n; f++) {
+			this->gpu_ms[f] = this->gpu_timer.read(f % GPU_TIMER_LATENCY);
+		}
+	}
+
+	// nearest rank
+	static float percentile(const std::vector<float>& sorted, float p) {
+		if (sorted.empty()) {
+			return 0.0f;
+		}
+		usize rank = std::min<usize>(p / 100.0f * sorted.size(), sorted.size() - 1);
+		return sorted[rank];
+	}
+
+	static void reportOne(std::ostream& out, const char *name, const std::vector<float>& ms) {
+		std::vector<float> sorted;
+		std::copy_if(ms.begin(), ms.end(), std::back_inserter(sorted), [](float t) { return t >= 0.0f; });
+		std::sort(sorted.begin(), sorted.end());
+		out << "  " << name << " ms: p50 " << percentile(sorted, 50.0f)
+		    << ", p95 " << percentile(sorted, 95.0f)
+		    << ", p99 " << percentile(sorted, 99.0f)
+		    << ", max " << (sorted.empty() ? 0.0f : sorted.back()) << std::endl;
+
+		std::vector<usize> frames(ms.size());
+		std::iota(frames.begin(), frames.end(), 0);
+		usize n_worst = std::min<usize>(FRAME_TIMES_WORST, frames.size());
+		std::partial_sort(frames.begin(), frames.begin() + n_worst, frames.end(), [&](usize a, usize b) { return ms[a] > ms[b]; });
+		out << "  worst " << name << " frames:";
+		for (usize i = 0; i < n_worst; i++) {
+			out << " #" << frames[i] << " (" << ms[frames[i]] << "ms)";
+		}
+		out << std::endl;
+	}
+
+	void report(std::ostream& out) const {
+		out << "frames(info): " << this->cpu_ms.size() << " frames" << std::endl;
+		reportOne(out, "cpu", this->cpu_ms);
+		reportOne(out, "gpu", this->gpu_ms);
+		reportOne(out, "sim", this->sim_ms);
+		reportOne(out, "latency", this->latency_ms);
+	}
+};
@@ -0,0 +1,233 @@
+#pragma once
+
+/* Shadow copy of the GL state we touch, so redundant calls never reach the driver */
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include <types.hpp>
+#include <counters.hpp>
+
+#define GL_STATE_TEXTURE_UNITS 16
+#define GL_STATE_UNIFORM_BUFFERS 16
+
+struct GLStateStats {
+	usize issued;
+	usize avoided;
+};
+
+// per vertex array, binding point 0 only since that's all Vertex::setupVAO() uses
+struct VAOBindings {
+	uint vbo;
+	GLsizei stride;
+	uint ebo;
+};
+
+// Everything here mirrors what we last told GL, it's never read back from the driver, so every call that
+// touches this state has to go through here. Framebuffers and the viewport aren't tracked, raw GL is fine for those.
+struct GLState {
+	uint program;
+	uint vao;
+	std::array<uint, GL_STATE_TEXTURE_UNITS> textures;
+	std::array<uint, GL_STATE_UNIFORM_BUFFERS> uniform_buffers;
+	// indexed by vao name, names are small and dense
+	std::vector<VAOBindings> vao_bindings;
+
+	bool depth_test_enabled;
+	bool cull_face_enabled;
+	bool blend_enabled;
+	bool depth_mask;
+	GLenum cull_face_mode;
+	GLenum depth_func;
+	GLenum blend_src;
+	GLenum blend_dst;
+
+	// (program << 32 | location) -> value
+	std::unordered_map<uint64_t, int> uniform_ints;
+	std::unordered_map<uint64_t, std::vector<float>> uniform_floats;
+
+	GLStateStats stats;
+
+	// GL's defaults for a fresh context
+	static GLState init() {
+		GLState gl = {};
+		gl.depth_mask = true;
+		gl.cull_face_mode = GL_BACK;
+		gl.depth_func = GL_LESS;
+		gl.blend_src = GL_ONE;
+		gl.blend_dst = GL_ZERO;
+		return gl;
+	}
+
+	// returns the counts since the last call
+	GLStateStats frame() {
+		GLStateStats stats = this->stats;
+		this->stats = {};
+		return stats;
+	}
+
+	bool filter(bool changed) {
+		if (changed) {
+			this->stats.issued++;
+		} else {
+			this->stats.avoided++;
+		}
+		return changed;
+	}
+
+	void useProgram(uint program) {
+		if (this->filter(this->program != program)) {
+			glUseProgram(program);
+			COUNTER_ADD(COUNTER_SHADER_SWITCHES, 1);
+			this->program = program;
+		}
+	}
+
+	void bindVertexArray(uint vao) {
+		if (this->filter(this->vao != vao)) {
+			glBindVertexArray(vao);
+			this->vao = vao;
+		}
+	}
+
+	void bindTextureUnit(uint unit, uint texture) {
+		if (unit >= GL_STATE_TEXTURE_UNITS) {
+			glBindTextureUnit(unit, texture);
+			COUNTER_ADD(COUNTER_TEXTURE_BINDS, 1);
+			return;
+		}
+		if (this->filter(this->textures[unit] != texture)) {
+			glBindTextureUnit(unit, texture);
+			COUNTER_ADD(COUNTER_TEXTURE_BINDS, 1);
+			this->textures[unit] = texture;
+		}
+	}
+
+	void bindUniformBuffer(uint index, uint buffer) {
+		if (index >= GL_STATE_UNIFORM_BUFFERS) {
+			glBindBufferBase(GL_UNIFORM_BUFFER, index, buffer);
+			return;
+		}
+		if (this->filter(this->uniform_buffers[index] != buffer)) {
+			glBindBufferBase(GL_UNIFORM_BUFFER, index, buffer);
+			this->uniform_buffers[index] = buffer;
+		}
+	}
+
+	VAOBindings& bindings(uint vao) {
+		if (vao >= this->vao_bindings.size()) {
+			// unknown until set
+			this->vao_bindings.resize(vao + 1, { .vbo = UINT32_MAX, .stride = 0, .ebo = UINT32_MAX });
+		}
+		return this->vao_bindings[vao];
+	}
+
+	void vertexBuffer(uint vao, uint vbo, GLsizei stride) {
+		VAOBindings& b = this->bindings(vao);
+		if (this->filter(b.vbo != vbo || b.stride != stride)) {
+			glVertexArrayVertexBuffer(vao, 0, vbo, 0, stride);
+			b.vbo = vbo;
+			b.stride = stride;
+		}
+	}
+
+	void elementBuffer(uint vao, uint ebo) {
+		VAOBindings& b = this->bindings(vao);
+		if (this->filter(b.ebo != ebo)) {
+			glVertexArrayElementBuffer(vao, ebo);
+			b.ebo = ebo;
+		}
+	}
+
+	void enable(GLenum cap, bool& current, bool enabled) {
+		if (this->filter(current != enabled)) {
+			if (enabled) {
+				glEnable(cap);
+			} else {
+				glDisable(cap);
+			}
+			current = enabled;
+		}
+	}
+
+	void depthTest(bool enabled) {
+		this->enable(GL_DEPTH_TEST, this->depth_test_enabled, enabled);
+	}
+
+	void cullFace(bool enabled) {
+		this->enable(GL_CULL_FACE, this->cull_face_enabled, enabled);
+	}
+
+	void blend(bool enabled) {
+		this->enable(GL_BLEND, this->blend_enabled, enabled);
+	}
+
+	void depthMask(bool enabled) {
+		if (this->filter(this->depth_mask != enabled)) {
+			glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+			this->depth_mask = enabled;
+		}
+	}
+
+	void cullFaceMode(GLenum mode) {
+		if (this->filter(this->cull_face_mode != mode)) {
+			glCullFace(mode);
+			this->cull_face_mode = mode;
+		}
+	}
+
+	void depthFunc(GLenum func) {
+		if (this->filter(this->depth_func != func)) {
+			glDepthFunc(func);
+			this->depth_func = func;
+		}
+	}
+
+	void blendFunc(GLenum src, GLenum dst) {
+		if (this->filter(this->blend_src != src || this->blend_dst != dst)) {
+			glBlendFunc(src, dst);
+			this->blend_src = src;
+			this->blend_dst = dst;
+		}
+	}
+
+	static uint64_t uniformKey(uint program, int location) {
+		return (uint64_t)program << 32 | (uint)location;
+	}
+
+	void uniform1i(uint program, int location, int value) {
+		auto [it, inserted] = this->uniform_ints.try_emplace(uniformKey(program, location), value);
+		if (this->filter(inserted || it->second != value)) {
+			glProgramUniform1i(program, location, value);
+			it->second = value;
+		}
+	}
+
+	void uniform1f(uint program, int location, float value) {
+		this->uniformfv(program, location, &value, 1, [&] { glProgramUniform1f(program, location, value); });
+	}
+
+	// only used for bone palettes
+	void uniformMatrix4fv(uint program, int location, GLsizei count, const float* value) {
+		this->uniformfv(program, location, value, 16 * count, [&] {
+			glProgramUniformMatrix4fv(program, location, count, GL_FALSE, value);
+			COUNTER_ADD(COUNTER_BONE_PALETTE_BYTES, count * sizeof(mat4));
+		});
+	}
+
+	// compares the whole array, still a lot cheaper than pushing it through the driver again
+	template <typename F>
+	void uniformfv(uint program, int location, const float* value, usize n, F upload) {
+		auto& cached = this->uniform_floats[uniformKey(program, location)];
+		bool changed = cached.size() != n || std::memcmp(cached.data(), value, n * sizeof(float)) != 0;
+		if (this->filter(changed)) {
+			upload();
+			cached.assign(value, value + n);
+		}
+	}
+};
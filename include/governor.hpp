@@ -0,0 +1,145 @@
+#pragma once
+
+/* Frame budget governor: steps quality down when frames run over budget and back up once there's headroom */
+
+#include <array>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <types.hpp>
+
+// frames averaged before comparing against the budget
+#define GOVERNOR_WINDOW 30
+// over budget: the average is above budget * GOVERNOR_OVER for GOVERNOR_DOWN_FRAMES frames in a row
+#define GOVERNOR_OVER 1.05f
+#define GOVERNOR_DOWN_FRAMES 10
+// headroom: below budget * GOVERNOR_UNDER for GOVERNOR_UP_FRAMES in a row. the gap between the two
+// thresholds and the slower way up is what keeps it from flipping between two levels
+#define GOVERNOR_UNDER 0.75f
+#define GOVERNOR_UP_FRAMES 120
+// ignored after a change, until the new level's times (GPU ones come in late) fill the window
+#define GOVERNOR_SETTLE_FRAMES 30
+
+struct QualityLevel {
+	// of the output resolution, the scene is upscaled to it
+	float resolution_scale;
+	// bone palettes are recomputed every this many frames
+	uint animation_interval;
+	// far plane of the culling frustum, the projection's is 100
+	float cull_distance;
+	// meshes whose bounding radius over distance is below this are skipped. there are no LODs to bias,
+	// this is the last one
+	float min_screen_size;
+	bool skybox;
+};
+
+// best first, each level gives up a little more than the one before
+const std::array<QualityLevel, 6> quality_levels = {{
+	{ .resolution_scale = 1.0f,  .animation_interval = 1, .cull_distance = 100.0f, .min_screen_size = 0.0f,   .skybox = true },
+	{ .resolution_scale = 0.85f, .animation_interval = 1, .cull_distance = 100.0f, .min_screen_size = 0.0f,   .skybox = true },
+	{ .resolution_scale = 0.85f, .animation_interval = 2, .cull_distance = 100.0f, .min_screen_size = 0.005f, .skybox = true },
+	{ .resolution_scale = 0.7f,  .animation_interval = 2, .cull_distance = 75.0f,  .min_screen_size = 0.01f,  .skybox = true },
+	{ .resolution_scale = 0.7f,  .animation_interval = 3, .cull_distance = 60.0f,  .min_screen_size = 0.02f,  .skybox = false },
+	{ .resolution_scale = 0.5f,  .animation_interval = 4, .cull_distance = 40.0f,  .min_screen_size = 0.03f,  .skybox = false },
+}};
+
+// what changed between two levels, for the log
+std::string qualityChange(const QualityLevel& a, const QualityLevel& b) {
+	std::ostringstream s;
+	auto knob = [&](const char *name, auto from, auto to) {
+		if (from != to) {
+			s << (s.tellp() > 0 ? ", " : "") << name << " " << from << " -> " << to;
+		}
+	};
+	knob("resolution", a.resolution_scale, b.resolution_scale);
+	knob("animation interval", a.animation_interval, b.animation_interval);
+	knob("cull distance", a.cull_distance, b.cull_distance);
+	knob("min screen size", a.min_screen_size, b.min_screen_size);
+	knob("skybox", a.skybox ? "on" : "off", b.skybox ? "on" : "off");
+	return s.str();
+}
+
+// observe() runs on the render thread, the sim reads the level once per tick
+struct Governor {
+	// 0 turns it off, the level then stays where init() put it
+	float budget_ms;
+	std::atomic<uint> level;
+	std::array<float, GOVERNOR_WINDOW> window;
+	usize n_window;
+	usize over;
+	usize under;
+	usize settle;
+	usize changes;
+
+	// not movable, so it's set up in place
+	void init(float budget_ms, uint level) {
+		this->budget_ms = budget_ms;
+		this->level.store(std::min<uint>(level, quality_levels.size() - 1));
+		this->n_window = 0;
+		this->over = 0;
+		this->under = 0;
+		this->settle = 0;
+		this->changes = 0;
+	}
+
+	const QualityLevel& quality() const {
+		return quality_levels[this->level.load(std::memory_order_relaxed)];
+	}
+
+	// `ms` is what limits the frame rate: the slowest of the sim, render and GPU when they overlap
+	void observe(usize frame, float ms) {
+		if (this->budget_ms <= 0.0f) {
+			return;
+		}
+		if (this->settle > 0) {
+			this->settle--;
+			return;
+		}
+		this->window[this->n_window++ % GOVERNOR_WINDOW] = ms;
+		if (this->n_window < GOVERNOR_WINDOW) {
+			return;
+		}
+		float mean = 0.0f;
+		for (float t : this->window) {
+			mean += t;
+		}
+		mean /= GOVERNOR_WINDOW;
+
+		this->over = mean > this->budget_ms * GOVERNOR_OVER ? this->over + 1 : 0;
+		this->under = mean < this->budget_ms * GOVERNOR_UNDER ? this->under + 1 : 0;
+		const uint level = this->level.load(std::memory_order_relaxed);
+		if (this->over >= GOVERNOR_DOWN_FRAMES && level + 1 < quality_levels.size()) {
+			this->change(frame, mean, level + 1);
+		} else if (this->under >= GOVERNOR_UP_FRAMES && level > 0) {
+			this->change(frame, mean, level - 1);
+		}
+	}
+
+	void change(usize frame, float mean, uint to) {
+		const uint from = this->level.load(std::memory_order_relaxed);
+		std::cerr << std::fixed << std::setprecision(2) << "governor(info): frame " << frame << ", " << mean << "ms against a "
+		          << this->budget_ms << "ms budget, quality " << from << " -> " << to << " ("
+		          << qualityChange(quality_levels[from], quality_levels[to]) << ")" << std::endl << std::defaultfloat;
+		this->level.store(to, std::memory_order_relaxed);
+		this->n_window = 0;
+		this->over = 0;
+		this->under = 0;
+		this->settle = GOVERNOR_SETTLE_FRAMES;
+		this->changes++;
+	}
+
+	void print(std::ostream& out) const {
+		if (this->budget_ms <= 0.0f) {
+			out << "governor(info): off, quality " << this->level.load() << std::endl;
+			return;
+		}
+		out << std::fixed << std::setprecision(2) << "governor(info): " << this->budget_ms << "ms budget, "
+		    << this->changes << " changes, ended at quality " << this->level.load() << " of " << quality_levels.size() - 1
+		    << std::endl << std::defaultfloat;
+	}
+};
+
+inline Governor governor;
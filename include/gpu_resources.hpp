@@ -0,0 +1,217 @@
+#pragma once
+
+/* Every live GL buffer, texture and renderbuffer with its size and owning asset, for VRAM budgets and leak checks */
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include <types.hpp>
+#include <load_stats.hpp>
+
+enum GpuResourceKind {
+	GPU_BUFFER,
+	GPU_TEXTURE,
+	GPU_RENDERBUFFER,
+	GPU_RESOURCE_KIND_COUNT,
+};
+
+const std::array<const char*, GPU_RESOURCE_KIND_COUNT> gpu_resource_kind_names = {
+	"buffer",
+	"texture",
+	"renderbuffer",
+};
+
+struct GpuResource {
+	GpuResourceKind kind;
+	uint id;
+	// whatever LoadAsset was loading when it was created, "engine" otherwise
+	std::string owner;
+	// internal format, 0 for buffers
+	GLenum format;
+	// width, height and layers (cube faces count as layers), buffers only use x
+	ivec3 size;
+	int mips;
+	// estimated from the format, drivers are free to pad
+	uint64_t bytes;
+};
+
+// bytes per texel as drivers tend to store it, RGB8 usually ends up padded to 4
+uint64_t texelBytes(GLenum format) {
+	switch (format) {
+	case GL_R8:                 return 1;
+	case GL_RG8:                return 2;
+	case GL_RGB8:               return 4;
+	case GL_RGBA8:              return 4;
+	case GL_SRGB8_ALPHA8:       return 4;
+	case GL_R32F:               return 4;
+	case GL_DEPTH_COMPONENT24:  return 4;
+	case GL_DEPTH24_STENCIL8:   return 4;
+	case GL_DEPTH_COMPONENT32F: return 4;
+	case GL_RGBA16F:            return 8;
+	case GL_RGBA32F:            return 16;
+	default:                    return 4;
+	}
+}
+
+// only touched from the GL thread
+struct GpuResources {
+	std::vector<GpuResource> resources;
+	uint64_t peak_bytes;
+
+	static std::string currentOwner() {
+		return load_stats.asset.empty() ? "engine" : load_stats.asset;
+	}
+
+	GpuResource* find(GpuResourceKind kind, uint id) {
+		auto iter = std::find_if(this->resources.begin(), this->resources.end(), [&](const GpuResource& r) {
+			return r.kind == kind && r.id == id;
+		});
+		return iter == this->resources.end() ? nullptr : &(*iter);
+	}
+
+	void add(const GpuResource& resource) {
+		if (GpuResource *r = this->find(resource.kind, resource.id)) {
+			// respecified, e.g. glNamedBufferData() on a buffer that already had storage
+			*r = resource;
+		} else {
+			this->resources.push_back(resource);
+		}
+		this->peak_bytes = std::max(this->peak_bytes, this->totalBytes());
+	}
+
+	// after glNamedBufferData()/glNamedBufferStorage()
+	void buffer(uint id, uint64_t bytes) {
+		this->add({
+			.kind = GPU_BUFFER,
+			.id = id,
+			.owner = currentOwner(),
+			.format = 0,
+			.size = ivec3(bytes, 1, 1),
+			.mips = 1,
+			.bytes = bytes,
+		});
+	}
+
+	// after glTextureStorage*(), each mip is a quarter of the one above it
+	void texture(uint id, GLenum format, int width, int height, int layers, int mips) {
+		uint64_t bytes = 0;
+		for (int m = 0; m < mips; m++) {
+			bytes += (uint64_t)std::max(width >> m, 1) * std::max(height >> m, 1) * layers * texelBytes(format);
+		}
+		this->add({
+			.kind = GPU_TEXTURE,
+			.id = id,
+			.owner = currentOwner(),
+			.format = format,
+			.size = ivec3(width, height, layers),
+			.mips = mips,
+			.bytes = bytes,
+		});
+	}
+
+	void renderbuffer(uint id, GLenum format, int width, int height) {
+		this->add({
+			.kind = GPU_RENDERBUFFER,
+			.id = id,
+			.owner = currentOwner(),
+			.format = format,
+			.size = ivec3(width, height, 1),
+			.mips = 1,
+			.bytes = (uint64_t)width * height * texelBytes(format),
+		});
+	}
+
+	void remove(GpuResourceKind kind, uint id) {
+		std::erase_if(this->resources, [&](const GpuResource& r) { return r.kind == kind && r.id == id; });
+	}
+
+	void deleteBuffers(usize n, const uint *ids) {
+		for (usize i = 0; i < n; i++) {
+			this->remove(GPU_BUFFER, ids[i]);
+		}
+		glDeleteBuffers(n, ids);
+	}
+
+	void deleteTextures(usize n, const uint *ids) {
+		for (usize i = 0; i < n; i++) {
+			this->remove(GPU_TEXTURE, ids[i]);
+		}
+		glDeleteTextures(n, ids);
+	}
+
+	void deleteRenderbuffers(usize n, const uint *ids) {
+		for (usize i = 0; i < n; i++) {
+			this->remove(GPU_RENDERBUFFER, ids[i]);
+		}
+		glDeleteRenderbuffers(n, ids);
+	}
+
+	uint64_t totalBytes() const {
+		uint64_t bytes = 0;
+		for (const auto& r : this->resources) {
+			bytes += r.bytes;
+		}
+		return bytes;
+	}
+
+	uint64_t totalBytes(GpuResourceKind kind) const {
+		uint64_t bytes = 0;
+		for (const auto& r : this->resources) {
+			bytes += r.kind == kind ? r.bytes : 0;
+		}
+		return bytes;
+	}
+
+	// owner -> bytes, biggest first
+	std::vector<std::pair<std::string, uint64_t>> perOwner() const {
+		std::map<std::string, uint64_t> owners;
+		for (const auto& r : this->resources) {
+			owners[r.owner] += r.bytes;
+		}
+		std::vector<std::pair<std::string, uint64_t>> sorted(owners.begin(), owners.end());
+		std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+		return sorted;
+	}
+
+	// budget_mb 0 for none
+	void print(std::ostream& out, double budget_mb) const {
+		const double mb = 1024.0 * 1024.0;
+		out << std::fixed << std::setprecision(2)
+		    << "gpu(info): " << this->resources.size() << " resources, " << this->totalBytes() / mb << " MB live ("
+		    << this->totalBytes(GPU_BUFFER) / mb << " buffers, "
+		    << this->totalBytes(GPU_TEXTURE) / mb << " textures, "
+		    << this->totalBytes(GPU_RENDERBUFFER) / mb << " renderbuffers), peak " << this->peak_bytes / mb << " MB" << std::endl;
+		for (const auto& [owner, bytes] : this->perOwner()) {
+			out << "  " << std::setw(10) << bytes / mb << " MB  " << owner << std::endl;
+		}
+		if (budget_mb > 0.0 && this->totalBytes() / mb > budget_mb) {
+			out << "gpu(warning): " << this->totalBytes() / mb << " MB is over the " << budget_mb << " MB budget" << std::endl;
+		}
+		out << std::defaultfloat;
+	}
+
+	// call once everything has been deleted, whatever is left leaked. returns the number of leaks
+	usize reportLeaks(std::ostream& out) const {
+		for (const auto& r : this->resources) {
+			out << "gpu(leak): " << gpu_resource_kind_names[r.kind] << " " << r.id << " (" << r.bytes << " B";
+			if (r.kind != GPU_BUFFER) {
+				out << ", " << r.size.x << "x" << r.size.y << "x" << r.size.z << ", " << r.mips << " mips, format 0x" << std::hex << r.format << std::dec;
+			}
+			out << ") from " << r.owner << std::endl;
+		}
+		if (this->resources.empty()) {
+			out << "gpu(info): no leaks" << std::endl;
+		}
+		return this->resources.size();
+	}
+};
+
+inline GpuResources gpu_resources;
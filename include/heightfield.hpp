@@ -0,0 +1,294 @@
+#pragma once
+
+/* Terrain baked at load time into a regular heightfield: constant time height/normal lookups and ray marching */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <types.hpp>
+#include <mesh_bvh.hpp>
+
+// a bake bigger than this gets a coarser cell instead, 16MiB of heights
+#define HEIGHTFIELD_MAX_SAMPLES (1 << 22)
+
+// heights at the corners of square cells, bilinear in between. the topmost surface wins where
+// triangles overlap, anything under an overhang is lost
+struct Heightfield {
+	// world xz of sample (0, 0)
+	vec2 origin;
+	float cell_size;
+	float inv_cell_size;
+	// samples are one more each way
+	ivec2 cells;
+	// row-major, x fastest
+	std::vector<float> heights;
+	// min and max of each cell's corners, which bound the bilinear patch over it
+	std::vector<vec2> bounds;
+	// outside the grid and wherever nothing was baked
+	float floor;
+	// how far the bake is off at the terrain's own vertices
+	float mean_error;
+	float max_error;
+	float bake_ms;
+
+	// `corners` 3 per triangle in world space, only the ones facing up are baked. `cell_size`
+	// is the memory/accuracy knob, 4 bytes per sample plus 8 per cell
+	static Heightfield init(const std::vector<vec3>& corners, float cell_size, float floor) {
+		auto start = chrono::steady_clock::now();
+		Heightfield field = {};
+		field.floor = floor;
+
+		Box box = Box::empty();
+		for (const auto& c : corners) {
+			box.expand(c);
+		}
+		if (corners.empty()) {
+			box = { .min = vec3(0.0f), .max = vec3(0.0f) };
+		}
+		const vec2 extent = glm::max(vec2(box.max.x - box.min.x, box.max.z - box.min.z), vec2(cell_size));
+		const float min_cell = std::sqrt(extent.x * extent.y / HEIGHTFIELD_MAX_SAMPLES);
+		if (cell_size < min_cell) {
+			std::cerr << "heightfield(warning): " << cell_size << " cells would take more than " << HEIGHTFIELD_MAX_SAMPLES
+			          << " samples, using " << min_cell << std::endl;
+			cell_size = min_cell;
+		}
+		field.origin = vec2(box.min.x, box.min.z);
+		field.cell_size = cell_size;
+		field.inv_cell_size = 1.0f / cell_size;
+		field.cells = glm::max(ivec2(std::ceil(extent.x * field.inv_cell_size), std::ceil(extent.y * field.inv_cell_size)), ivec2(1));
+		const usize stride = field.cells.x + 1;
+		field.heights.assign(stride * (field.cells.y + 1), std::numeric_limits<float>::lowest());
+
+		// every sample inside a triangle's xz footprint gets its height there
+		for (usize i = 0; i + 2 < corners.size(); i += 3) {
+			const vec3 a = corners[i], b = corners[i + 1], c = corners[i + 2];
+			// twice the xz footprint's area, minus the normal's y. facing down or edge on isn't ground
+			const float area = (b.x - a.x) * (c.z - a.z) - (c.x - a.x) * (b.z - a.z);
+			if (area > -1e-12f) {
+				continue;
+			}
+			// the samples under its xz bounds
+			const vec2 min = (vec2(std::min({ a.x, b.x, c.x }), std::min({ a.z, b.z, c.z })) - field.origin) * field.inv_cell_size;
+			const vec2 max = (vec2(std::max({ a.x, b.x, c.x }), std::max({ a.z, b.z, c.z })) - field.origin) * field.inv_cell_size;
+			const ivec2 lo = glm::max(ivec2(std::ceil(min.x), std::ceil(min.y)), ivec2(0));
+			const ivec2 hi = glm::min(ivec2(std::floor(max.x), std::floor(max.y)), field.cells);
+			const float inv_area = 1.0f / area;
+			for (int z = lo.y; z <= hi.y; z++) {
+				for (int x = lo.x; x <= hi.x; x++) {
+					const vec2 p = field.origin + vec2(x, z) * cell_size;
+					const float wb = ((p.x - a.x) * (c.z - a.z) - (c.x - a.x) * (p.y - a.z)) * inv_area;
+					const float wc = ((b.x - a.x) * (p.y - a.z) - (p.x - a.x) * (b.z - a.z)) * inv_area;
+					const float wa = 1.0f - wb - wc;
+					// a little slack so samples on a shared edge aren't missed by both sides
+					if (wa < -1e-5f || wb < -1e-5f || wc < -1e-5f) {
+						continue;
+					}
+					float& h = field.heights[z * stride + x];
+					h = std::max(h, wa * a.y + wb * b.y + wc * c.y);
+				}
+			}
+		}
+		for (float& h : field.heights) {
+			if (h == std::numeric_limits<float>::lowest()) {
+				h = floor;
+			}
+		}
+
+		field.bounds.resize(field.cells.x * field.cells.y);
+		for (int z = 0; z < field.cells.y; z++) {
+			for (int x = 0; x < field.cells.x; x++) {
+				const float* row0 = &field.heights[z * stride + x];
+				const float* row1 = row0 + stride;
+				field.bounds[z * field.cells.x + x] = vec2(std::min({ row0[0], row0[1], row1[0], row1[1] }), std::max({ row0[0], row0[1], row1[0], row1[1] }));
+			}
+		}
+
+		double error_sum = 0.0;
+		usize n_checked = 0;
+		for (const auto& c : corners) {
+			const float h = field.height(c.x, c.z);
+			// vertices under something else don't count, the bake never saw them
+			if (h > c.y + 4.0f * cell_size) {
+				continue;
+			}
+			const float e = std::abs(h - c.y);
+			error_sum += e;
+			field.max_error = std::max(field.max_error, e);
+			n_checked++;
+		}
+		field.mean_error = n_checked > 0 ? error_sum / n_checked : 0.0f;
+		field.bake_ms = chrono::duration<float, std::milli>(chrono::steady_clock::now() - start).count();
+		return field;
+	}
+
+	// cell `c` and where in it `p` is, false outside the grid
+	bool locate(vec2 p, ivec2& c, vec2& f) const {
+		const vec2 g = (p - this->origin) * this->inv_cell_size;
+		if (!(g.x >= 0.0f && g.y >= 0.0f && g.x <= this->cells.x && g.y <= this->cells.y)) {
+			return false;
+		}
+		c = glm::min(ivec2(g), this->cells - ivec2(1));
+		f = g - vec2(c);
+		return true;
+	}
+
+	float height(float x, float z) const {
+		ivec2 c;
+		vec2 f;
+		if (!this->locate(vec2(x, z), c, f)) {
+			return this->floor;
+		}
+		const float* row0 = &this->heights[c.y * (this->cells.x + 1) + c.x];
+		const float* row1 = row0 + this->cells.x + 1;
+		return glm::mix(glm::mix(row0[0], row0[1], f.x), glm::mix(row1[0], row1[1], f.x), f.y);
+	}
+
+	// of the bilinear surface, up outside the grid
+	vec3 normal(float x, float z) const {
+		ivec2 c;
+		vec2 f;
+		if (!this->locate(vec2(x, z), c, f)) {
+			return vec3(0.0f, 1.0f, 0.0f);
+		}
+		const float* row0 = &this->heights[c.y * (this->cells.x + 1) + c.x];
+		const float* row1 = row0 + this->cells.x + 1;
+		const float dx = glm::mix(row0[1] - row0[0], row1[1] - row1[0], f.y) * this->inv_cell_size;
+		const float dz = glm::mix(row1[0] - row0[0], row1[1] - row0[1], f.x) * this->inv_cell_size;
+		return glm::normalize(vec3(-dx, 1.0f, -dz));
+	}
+
+	// first t in [t0, t1] where the ray meets the bilinear patch over cell `c`. the ray's height minus
+	// the patch's along it is a quadratic in t
+	bool hitCell(const Ray& ray, ivec2 c, float t0, float t1, float& t_hit) const {
+		const float* row0 = &this->heights[c.y * (this->cells.x + 1) + c.x];
+		const float* row1 = row0 + this->cells.x + 1;
+		const float h00 = row0[0], a = row0[1] - h00, b = row1[0] - h00, k = h00 - row0[1] - row1[0] + row1[1];
+		const vec2 corner = this->origin + vec2(c) * this->cell_size;
+		const float u0 = (ray.origin.x + ray.dir.x * t0 - corner.x) * this->inv_cell_size;
+		const float v0 = (ray.origin.z + ray.dir.z * t0 - corner.y) * this->inv_cell_size;
+		const float du = ray.dir.x * this->inv_cell_size, dv = ray.dir.z * this->inv_cell_size;
+
+		// f(s) = qa s^2 + qb s + qc, s = t - t0
+		const float qc = ray.origin.y + ray.dir.y * t0 - (h00 + a * u0 + b * v0 + k * u0 * v0);
+		const float qb = ray.dir.y - (a * du + b * dv + k * (u0 * dv + v0 * du));
+		const float qa = -k * du * dv;
+		const float s1 = t1 - t0;
+		if (qc <= 0.0f) {
+			// starts under it
+			t_hit = t0;
+			return true;
+		}
+		float s = std::numeric_limits<float>::infinity();
+		if (std::abs(qa) < 1e-12f) {
+			if (qb < 0.0f) {
+				s = -qc / qb;
+			}
+		} else {
+			const float disc = qb * qb - 4.0f * qa * qc;
+			if (disc >= 0.0f) {
+				const float root = std::sqrt(disc);
+				// the numerically stable pair
+				const float q = -0.5f * (qb + (qb < 0.0f ? -root : root));
+				const float r0 = q / qa, r1 = q != 0.0f ? qc / q : std::numeric_limits<float>::infinity();
+				for (float r : { r0, r1 }) {
+					if (r >= 0.0f && r < s) {
+						s = r;
+					}
+				}
+			}
+		}
+		if (s > s1) {
+			return false;
+		}
+		t_hit = t0 + s;
+		return true;
+	}
+
+	// first hit within ray.max_t, the floor plane counts outside the grid. walks the cells the ray
+	// crosses in order and only solves for the ones it dips under the highest corner of
+	bool raycast(const Ray& ray, float& t_hit, vec3& normal) const {
+		const vec2 o = vec2(ray.origin.x, ray.origin.z), d = vec2(ray.dir.x, ray.dir.z);
+		const vec2 lo = this->origin, hi = this->origin + vec2(this->cells) * this->cell_size;
+		float t0 = 0.0f, t1 = ray.max_t;
+		for (int axis = 0; axis < 2; axis++) {
+			if (std::abs(d[axis]) < 1e-12f) {
+				if (o[axis] < lo[axis] || o[axis] > hi[axis]) {
+					t1 = -1.0f;
+				}
+				continue;
+			}
+			const float ta = (lo[axis] - o[axis]) / d[axis], tb = (hi[axis] - o[axis]) / d[axis];
+			t0 = std::max(t0, std::min(ta, tb));
+			t1 = std::min(t1, std::max(ta, tb));
+		}
+
+		if (t0 <= t1) {
+			const vec2 start = (o + d * t0 - this->origin) * this->inv_cell_size;
+			ivec2 c = glm::clamp(ivec2(glm::floor(start)), ivec2(0), this->cells - ivec2(1));
+			const ivec2 step = ivec2(d.x > 0.0f ? 1 : -1, d.y > 0.0f ? 1 : -1);
+			vec2 t_next, t_delta;
+			for (int axis = 0; axis < 2; axis++) {
+				if (std::abs(d[axis]) < 1e-12f) {
+					t_next[axis] = t_delta[axis] = std::numeric_limits<float>::infinity();
+					continue;
+				}
+				const float boundary = this->origin[axis] + (c[axis] + (step[axis] > 0 ? 1 : 0)) * this->cell_size;
+				t_next[axis] = (boundary - o[axis]) / d[axis];
+				t_delta[axis] = this->cell_size / std::abs(d[axis]);
+			}
+
+			float t = t0;
+			while (true) {
+				const float t_exit = std::min({ t_next.x, t_next.y, t1 });
+				const float y0 = ray.origin.y + ray.dir.y * t, y1 = ray.origin.y + ray.dir.y * t_exit;
+				// only the top bound, a ray all the way under a cell came in through the grid's side or started
+				// under it, and that's a hit where it is
+				const vec2 b = this->bounds[c.y * this->cells.x + c.x];
+				if (std::min(y0, y1) <= b.y && this->hitCell(ray, c, t, t_exit, t_hit)) {
+					const vec3 p = ray.origin + ray.dir * t_hit;
+					normal = this->normal(p.x, p.z);
+					return true;
+				}
+				if (t_exit >= t1) {
+					break;
+				}
+				const int axis = t_next.x < t_next.y ? 0 : 1;
+				c[axis] += step[axis];
+				if (c[axis] < 0 || c[axis] >= this->cells[axis]) {
+					break;
+				}
+				t = t_exit;
+				t_next[axis] += t_delta[axis];
+			}
+		}
+
+		if (ray.dir.y < 0.0f) {
+			const float t = (this->floor - ray.origin.y) / ray.dir.y;
+			const vec3 p = ray.origin + ray.dir * t;
+			ivec2 c;
+			vec2 f;
+			if (t >= 0.0f && t <= ray.max_t && !this->locate(vec2(p.x, p.z), c, f)) {
+				t_hit = t;
+				normal = vec3(0.0f, 1.0f, 0.0f);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void print(std::ostream& out) const {
+		const usize bytes = this->heights.size() * sizeof(float) + this->bounds.size() * sizeof(vec2);
+		const std::streamsize precision = out.precision();
+		out << std::fixed << std::setprecision(3) << "heightfield(info): " << this->cells.x << "x" << this->cells.y << " cells of "
+		    << this->cell_size << ", " << bytes / 1024 << "KiB, off by " << this->mean_error << " on average and "
+		    << this->max_error << " at most, baked in " << std::setprecision(1) << this->bake_ms << "ms"
+		    << std::endl << std::defaultfloat << std::setprecision(precision);
+	}
+};
@@ -0,0 +1,384 @@
+#pragma once
+
+/* Work-stealing job system: a Chase-Lev deque per worker, counters to wait on, parallelFor and a task graph */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <types.hpp>
+#include <allocations.hpp>
+#include <profiler.hpp>
+
+// jobs queued per worker, spawning more than that runs them inline instead
+#define JOB_QUEUE_SIZE 4096
+// captures bigger than this don't fit in a Job, capture a pointer to them instead
+#define JOB_DATA_BYTES 48
+// failed steal rounds before an idle worker goes to sleep
+#define JOB_SPIN_ROUNDS 64
+
+// what a spawner waits on, one per batch of jobs
+struct JobCounter {
+	std::atomic<int> pending;
+};
+
+// copied around by value, the deque holds the jobs themselves so nothing outlives its slot
+struct Job {
+	// calls whatever was captured in `data`
+	void (*run)(const uchar *data);
+	JobCounter *counter;
+	// the spawner's, so allocations made by the job are charged to the same subsystem
+	AllocTag tag;
+	alignas(16) uchar data[JOB_DATA_BYTES];
+};
+
+// Chase-Lev, after Lê et al. "Correct and Efficient Work-Stealing for Weak Memory Models" (2013),
+// with a fixed buffer so it never allocates. only the owner pushes and pops, at the bottom, anyone steals from the top
+struct JobDeque {
+	alignas(64) std::atomic<int64_t> top;
+	alignas(64) std::atomic<int64_t> bottom;
+	std::unique_ptr<Job[]> buffer;
+
+	static constexpr int64_t mask = JOB_QUEUE_SIZE - 1;
+	static_assert((JOB_QUEUE_SIZE & mask) == 0, "JOB_QUEUE_SIZE has to be a power of 2");
+
+	void init() {
+		this->top.store(0, std::memory_order_relaxed);
+		this->bottom.store(0, std::memory_order_relaxed);
+		this->buffer = std::make_unique<Job[]>(JOB_QUEUE_SIZE);
+	}
+
+	// false when full
+	bool push(const Job& job) {
+		const int64_t b = this->bottom.load(std::memory_order_relaxed);
+		const int64_t t = this->top.load(std::memory_order_acquire);
+		if (b - t >= JOB_QUEUE_SIZE) {
+			return false;
+		}
+		this->buffer[b & mask] = job;
+		// publishes the job to whoever steals it
+		this->bottom.store(b + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(Job& job) {
+		const int64_t b = this->bottom.load(std::memory_order_relaxed) - 1;
+		this->bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = this->top.load(std::memory_order_relaxed);
+		if (t > b) {
+			this->bottom.store(b + 1, std::memory_order_relaxed);
+			return false;
+		}
+		job = this->buffer[b & mask];
+		bool won = true;
+		if (t == b) {
+			// the last one, race the thieves for it
+			won = this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			this->bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return won;
+	}
+
+	bool steal(Job& job) {
+		int64_t t = this->top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t b = this->bottom.load(std::memory_order_acquire);
+		if (t >= b) {
+			return false;
+		}
+		// copied before claiming it: once top moves on the owner is free to overwrite the slot.
+		// if it already has, the CAS fails and the torn copy is thrown away
+		job = this->buffer[t & mask];
+		return this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+	}
+};
+
+struct JobWorker {
+	JobDeque deque;
+	// xorshift state for picking who to steal from
+	uint32_t rng;
+	// stats, since the last JobSystem::resetStats()
+	std::atomic<uint64_t> executed;
+	std::atomic<uint64_t> stolen;
+};
+
+// index into JobSystem.workers, 0 is the thread that called init(). -1 on threads that aren't workers
+inline thread_local int job_worker = -1;
+
+struct JobSystem {
+	std::vector<std::unique_ptr<JobWorker>> workers;
+	std::vector<std::thread> threads;
+	// bumped on every push, idle workers sleep on it
+	std::atomic<uint32_t> epoch;
+	std::atomic<int> sleeping;
+	std::atomic<bool> quit;
+
+	// n_threads counts the calling thread, 0 for one per core
+	void init(uint n_threads) {
+		if (n_threads == 0) {
+			n_threads = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+		this->quit.store(false);
+		for (uint i = 0; i < n_threads; i++) {
+			std::unique_ptr<JobWorker> w = std::make_unique<JobWorker>();
+			w->deque.init();
+			w->rng = 0x9e3779b9u * (i + 1);
+			this->workers.push_back(std::move(w));
+		}
+		job_worker = 0;
+		for (uint i = 1; i < n_threads; i++) {
+			this->threads.emplace_back([this, i] { this->workerLoop(i); });
+		}
+	}
+
+	void deinit() {
+		this->quit.store(true);
+		this->epoch.fetch_add(1);
+		this->epoch.notify_all();
+		for (auto& t : this->threads) {
+			t.join();
+		}
+		this->threads.clear();
+		this->workers.clear();
+		job_worker = -1;
+	}
+
+	uint size() const {
+		return this->workers.size();
+	}
+
+	// hands worker 0 from the thread that called init() to another one: release() on the old thread
+	// once it's done spawning, adopt() on the new one before it starts
+	void release() {
+		job_worker = -1;
+	}
+
+	void adopt() {
+		job_worker = 0;
+	}
+
+	// `f` is copied into the job and runs on whichever worker gets to it first. only callable from workers.
+	// jobs get copied bytewise, so captures have to be trivially copyable: pointers, references, numbers
+	template <typename F>
+	void spawn(JobCounter& counter, const F& f) {
+		static_assert(sizeof(F) <= JOB_DATA_BYTES, "capture less, or capture a pointer");
+		static_assert(alignof(F) <= 16);
+		static_assert(std::is_trivially_copyable_v<F> && std::is_trivially_destructible_v<F>);
+		assert(job_worker >= 0 && "spawn() from a thread that isn't a worker");
+
+		JobWorker& w = *this->workers[job_worker];
+		counter.pending.fetch_add(1, std::memory_order_relaxed);
+		Job job;
+		std::memcpy(job.data, &f, sizeof(F));
+		job.run = [](const uchar *data) {
+			(*std::launder(reinterpret_cast<const F*>(data)))();
+		};
+		job.counter = &counter;
+		job.tag = alloc_tag;
+		if (!w.deque.push(job)) {
+			this->execute(w, job);
+			return;
+		}
+		this->epoch.fetch_add(1);
+		if (this->sleeping.load() > 0) {
+			this->epoch.notify_all();
+		}
+	}
+
+	// runs other jobs while it waits, so waiting from inside a job doesn't block a worker
+	void wait(JobCounter& counter) {
+		JobWorker& w = *this->workers[job_worker];
+		Job job;
+		while (counter.pending.load(std::memory_order_acquire) > 0) {
+			if (this->find(w, job)) {
+				this->execute(w, job);
+			} else {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	// f(begin, end) over [0, n) in chunks of `grain`, returns once all of them are done.
+	// the caller runs the last chunk itself, and all of them if it isn't a worker (or there are none)
+	template <typename F>
+	void parallelFor(usize n, usize grain, const F& f) {
+		if (n == 0) {
+			return;
+		}
+		if (job_worker < 0) {
+			f(0, n);
+			return;
+		}
+		grain = std::max<usize>(grain, 1);
+		JobCounter counter = {};
+		usize begin = 0;
+		for (; begin + grain < n; begin += grain) {
+			const usize end = begin + grain;
+			this->spawn(counter, [&f, begin, end] { f(begin, end); });
+		}
+		f(begin, n);
+		this->wait(counter);
+	}
+
+	bool find(JobWorker& w, Job& job) {
+		if (w.deque.pop(job)) {
+			return true;
+		}
+		const uint n = this->workers.size();
+		if (n == 1) {
+			return false;
+		}
+		w.rng ^= w.rng << 13;
+		w.rng ^= w.rng >> 17;
+		w.rng ^= w.rng << 5;
+		// everyone once, starting somewhere random so thieves don't all pile onto worker 0
+		const uint start = w.rng % n;
+		for (uint i = 0; i < n; i++) {
+			JobWorker& victim = *this->workers[(start + i) % n];
+			if (&victim == &w) {
+				continue;
+			}
+			if (victim.deque.steal(job)) {
+				w.stolen.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void execute(JobWorker& w, const Job& job) {
+		{
+			ALLOC_SCOPE(job.tag);
+			job.run(job.data);
+		}
+		w.executed.fetch_add(1, std::memory_order_relaxed);
+		job.counter->pending.fetch_sub(1, std::memory_order_release);
+	}
+
+	void workerLoop(uint index) {
+		job_worker = index;
+		JobWorker& w = *this->workers[index];
+		uint idle = 0;
+		Job job;
+		while (!this->quit.load(std::memory_order_relaxed)) {
+			if (this->find(w, job)) {
+				this->execute(w, job);
+				idle = 0;
+				continue;
+			}
+			if (++idle < JOB_SPIN_ROUNDS) {
+				std::this_thread::yield();
+				continue;
+			}
+			// spawn() bumps the epoch after pushing and only then checks `sleeping`, so either it sees
+			// us here or we see its job in the second look
+			this->sleeping.fetch_add(1);
+			const uint32_t e = this->epoch.load();
+			if (this->find(w, job)) {
+				this->sleeping.fetch_sub(1);
+				this->execute(w, job);
+				idle = 0;
+				continue;
+			}
+			if (!this->quit.load()) {
+				this->epoch.wait(e);
+			}
+			this->sleeping.fetch_sub(1);
+			idle = 0;
+		}
+		job_worker = -1;
+	}
+
+	void resetStats() {
+		for (auto& w : this->workers) {
+			w->executed.store(0, std::memory_order_relaxed);
+			w->stolen.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	void print(std::ostream& out) const {
+		out << "jobs(info): " << this->workers.size() << " workers, executed/stolen:";
+		for (const auto& w : this->workers) {
+			out << " " << w->executed.load(std::memory_order_relaxed) << "/" << w->stolen.load(std::memory_order_relaxed);
+		}
+		out << std::endl;
+	}
+};
+
+inline JobSystem job_system;
+
+struct TaskNode {
+	// a string literal, it's also the profiler zone
+	const char *name;
+	AllocTag tag;
+	std::function<void()> fn;
+	std::vector<uint> successors;
+	uint n_deps;
+};
+
+// a DAG of tasks, built once and run as many times as needed (once per frame). a task starts as
+// soon as everything it depends on is done, tasks with nothing in between run at the same time
+struct TaskGraph {
+	std::vector<TaskNode> nodes;
+	// dependencies left per node in the current run()
+	std::unique_ptr<std::atomic<uint>[]> remaining;
+
+	// deps have to be added first, so the graph can't have cycles. returns the task's id
+	uint add(const char *name, AllocTag tag, std::initializer_list<uint> deps, std::function<void()> fn) {
+		const uint id = this->nodes.size();
+		this->nodes.push_back({
+			.name = name,
+			.tag = tag,
+			.fn = std::move(fn),
+			.successors = {},
+			.n_deps = (uint)deps.size(),
+		});
+		for (uint d : deps) {
+			assert(d < id);
+			this->nodes[d].successors.push_back(id);
+		}
+		this->remaining = std::make_unique<std::atomic<uint>[]>(this->nodes.size());
+		return id;
+	}
+
+	// blocks, helping out, until every task has run
+	void run(JobSystem& jobs) {
+		for (usize i = 0; i < this->nodes.size(); i++) {
+			this->remaining[i].store(this->nodes[i].n_deps, std::memory_order_relaxed);
+		}
+		JobCounter counter = {};
+		for (usize i = 0; i < this->nodes.size(); i++) {
+			if (this->nodes[i].n_deps == 0) {
+				this->spawn(jobs, counter, i);
+			}
+		}
+		jobs.wait(counter);
+	}
+
+	void spawn(JobSystem& jobs, JobCounter& counter, uint id) {
+		jobs.spawn(counter, [this, &jobs, &counter, id] {
+			const TaskNode& node = this->nodes[id];
+			{
+				PROFILE_ZONE(node.name);
+				ALLOC_SCOPE(node.tag);
+				node.fn();
+			}
+			// counter still has this job pending, so it can't hit 0 before the successors are spawned
+			for (uint s : node.successors) {
+				if (this->remaining[s].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					this->spawn(jobs, counter, s);
+				}
+			}
+		});
+	}
+};
@@ -0,0 +1,261 @@
+#pragma once
+
+/* Where startup goes: time and bytes per asset and load phase, printed sorted and exported as JSON */
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+#include <assimp/Importer.hpp>
+
+#include <types.hpp>
+
+enum LoadPhase {
+	LOAD_FILE_READ,
+	// assimp's own work, minus its file reads
+	LOAD_PARSE,
+	LOAD_VERTICES,
+	// vertex weights, bone ids, animation channels and the node tree
+	LOAD_BONES,
+	LOAD_IMAGE_DECODE,
+	// CPU side only, the driver may still be copying after the call returns
+	LOAD_UPLOAD,
+	LOAD_SHADER,
+	LOAD_PHASE_COUNT,
+};
+
+const std::array<const char*, LOAD_PHASE_COUNT> load_phase_names = {
+	"file_read",
+	"parse",
+	"vertices",
+	"bones",
+	"image_decode",
+	"upload",
+	"shader",
+};
+
+struct LoadEntry {
+	std::string asset;
+	LoadPhase phase;
+	double ms;
+	uint64_t bytes;
+	// times the phase ran for this asset
+	usize count;
+};
+
+// only touched from the loading thread
+struct LoadStats {
+	// one per asset and phase, in the order they first showed up
+	std::vector<LoadEntry> entries;
+	// what phases are charged to, see LoadAsset
+	std::string asset;
+	chrono::steady_clock::time_point start;
+	// from begin() to finish(), everything not in `entries` is unaccounted
+	double total_ms;
+
+	void begin() {
+		this->start = chrono::steady_clock::now();
+	}
+
+	void finish() {
+		this->total_ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - this->start).count();
+	}
+
+	void add(LoadPhase phase, double ms, uint64_t bytes) {
+		const std::string& asset = this->asset.empty() ? "(none)" : this->asset;
+		auto iter = std::find_if(this->entries.begin(), this->entries.end(), [&](const LoadEntry& e) {
+			return e.phase == phase && e.asset == asset;
+		});
+		if (iter == this->entries.end()) {
+			this->entries.push_back({ .asset = asset, .phase = phase, .ms = 0.0, .bytes = 0, .count = 0 });
+			iter = this->entries.end() - 1;
+		}
+		iter->ms += ms;
+		iter->bytes += bytes;
+		iter->count++;
+	}
+
+	std::array<double, LOAD_PHASE_COUNT> phaseMs() const {
+		std::array<double, LOAD_PHASE_COUNT> ms = {};
+		for (const auto& e : this->entries) {
+			ms[e.phase] += e.ms;
+		}
+		return ms;
+	}
+
+	// slowest first, phase totals then every asset/phase pair
+	void print(std::ostream& out) const {
+		std::array<double, LOAD_PHASE_COUNT> phase_ms = this->phaseMs();
+		double accounted = 0.0;
+		for (double ms : phase_ms) {
+			accounted += ms;
+		}
+		std::array<usize, LOAD_PHASE_COUNT> phases;
+		for (usize i = 0; i < LOAD_PHASE_COUNT; i++) {
+			phases[i] = i;
+		}
+		std::sort(phases.begin(), phases.end(), [&](usize a, usize b) { return phase_ms[a] > phase_ms[b]; });
+
+		out << std::fixed << std::setprecision(2)
+		    << "load(info): " << this->total_ms << " ms startup, " << accounted << " ms accounted for" << std::endl;
+		for (usize p : phases) {
+			if (phase_ms[p] > 0.0) {
+				out << "  " << std::left << std::setw(14) << load_phase_names[p] << std::right << std::setw(10) << phase_ms[p] << " ms" << std::endl;
+			}
+		}
+
+		std::vector<const LoadEntry*> sorted;
+		for (const auto& e : this->entries) {
+			sorted.push_back(&e);
+		}
+		std::sort(sorted.begin(), sorted.end(), [](const LoadEntry *a, const LoadEntry *b) { return a->ms > b->ms; });
+		for (const LoadEntry *e : sorted) {
+			out << "  " << std::setw(10) << e->ms << " ms  " << std::left << std::setw(14) << load_phase_names[e->phase] << std::right
+			    << std::setw(12) << e->bytes << " B  " << e->asset;
+			if (e->count > 1) {
+				out << " (x" << e->count << ")";
+			}
+			out << std::endl;
+		}
+		out << std::defaultfloat;
+	}
+
+	bool writeJson(const std::string& path) const {
+		std::ofstream file(path);
+		if (!file) {
+			std::cerr << "load(error): can't write " << path << std::endl;
+			return false;
+		}
+		file << "{\"total_ms\":" << this->total_ms << ",\"phases\":{";
+		std::array<double, LOAD_PHASE_COUNT> phase_ms = this->phaseMs();
+		for (usize p = 0; p < LOAD_PHASE_COUNT; p++) {
+			file << (p > 0 ? "," : "") << "\"" << load_phase_names[p] << "\":" << phase_ms[p];
+		}
+		file << "},\"entries\":[";
+		for (usize i = 0; i < this->entries.size(); i++) {
+			const LoadEntry& e = this->entries[i];
+			file << (i > 0 ? ",\n" : "\n")
+			     << "{\"asset\":\"" << e.asset << "\",\"phase\":\"" << load_phase_names[e.phase]
+			     << "\",\"ms\":" << e.ms << ",\"bytes\":" << e.bytes << ",\"count\":" << e.count << "}";
+		}
+		file << "\n]}" << std::endl;
+		std::cerr << "load(info): wrote " << this->entries.size() << " entries to " << path << std::endl;
+		return true;
+	}
+};
+
+inline LoadStats load_stats;
+
+// charges every phase in its scope to `asset`, nests
+struct LoadAsset {
+	std::string prev;
+
+	explicit LoadAsset(const std::string& asset) : prev(load_stats.asset) {
+		load_stats.asset = asset;
+	}
+
+	~LoadAsset() {
+		load_stats.asset = this->prev;
+	}
+};
+
+// records on stop() or at the end of the scope, whichever comes first
+struct LoadTimer {
+	LoadPhase phase;
+	chrono::steady_clock::time_point start;
+	bool stopped;
+
+	explicit LoadTimer(LoadPhase phase) : phase(phase), start(chrono::steady_clock::now()), stopped(false) {}
+
+	double stop(uint64_t bytes = 0) {
+		if (this->stopped) {
+			return 0.0;
+		}
+		this->stopped = true;
+		const double ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - this->start).count();
+		load_stats.add(this->phase, ms, bytes);
+		return ms;
+	}
+
+	~LoadTimer() {
+		this->stop();
+	}
+};
+
+// assimp does its own file reads in the middle of parsing, these time them so they can be
+// taken back out of LOAD_PARSE
+struct TimedIOStream : public Assimp::IOStream {
+	Assimp::IOStream *inner;
+	double& read_ms;
+	uint64_t& read_bytes;
+
+	TimedIOStream(Assimp::IOStream *inner, double& read_ms, uint64_t& read_bytes) : inner(inner), read_ms(read_ms), read_bytes(read_bytes) {}
+
+	size_t Read(void *buffer, size_t size, size_t count) override {
+		auto start = chrono::steady_clock::now();
+		size_t n = this->inner->Read(buffer, size, count);
+		this->read_ms += chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+		this->read_bytes += n * size;
+		return n;
+	}
+
+	size_t Write(const void *buffer, size_t size, size_t count) override {
+		return this->inner->Write(buffer, size, count);
+	}
+
+	aiReturn Seek(size_t offset, aiOrigin origin) override {
+		return this->inner->Seek(offset, origin);
+	}
+
+	size_t Tell() const override {
+		return this->inner->Tell();
+	}
+
+	size_t FileSize() const override {
+		return this->inner->FileSize();
+	}
+
+	void Flush() override {
+		this->inner->Flush();
+	}
+};
+
+struct TimedIOSystem : public Assimp::DefaultIOSystem {
+	double read_ms = 0.0;
+	uint64_t read_bytes = 0;
+
+	Assimp::IOStream* Open(const char *file, const char *mode = "rb") override {
+		auto start = chrono::steady_clock::now();
+		Assimp::IOStream *inner = Assimp::DefaultIOSystem::Open(file, mode);
+		this->read_ms += chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+		return inner ? new TimedIOStream(inner, this->read_ms, this->read_bytes) : nullptr;
+	}
+
+	void Close(Assimp::IOStream *stream) override {
+		TimedIOStream *timed = static_cast<TimedIOStream*>(stream);
+		Assimp::DefaultIOSystem::Close(timed->inner);
+		delete timed;
+	}
+};
+
+// imp.ReadFile() with its time split into LOAD_FILE_READ and LOAD_PARSE
+const aiScene* readScene(Assimp::Importer& imp, const std::string& path, uint flags) {
+	// the importer owns and deletes it
+	TimedIOSystem *io = new TimedIOSystem();
+	imp.SetIOHandler(io);
+	auto start = chrono::steady_clock::now();
+	const aiScene *scene = imp.ReadFile(path, flags);
+	const double ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+	load_stats.add(LOAD_FILE_READ, io->read_ms, io->read_bytes);
+	load_stats.add(LOAD_PARSE, std::max(ms - io->read_ms, 0.0), 0);
+	return scene;
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <string>
 #include <limits>
 #include <vector>
@@ -9,8 +10,13 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <assimp/scene.h>
+#include <assimp/GltfMaterial.h>
 
 #include <utils.hpp>
+#include <gl_state.hpp>
+#include <load_stats.hpp>
+#include <gpu_resources.hpp>
+#include <shader_variants.hpp>
 
 struct Texture {
 	// from glCreateTextures()
@@ -24,6 +30,14 @@ struct TextureInfo {
 	std::string path;
 };
 
+// which pass a mesh is drawn in, in drawing order
+enum AlphaMode {
+	ALPHA_OPAQUE,
+	// alpha tested, still writes depth
+	ALPHA_MASK,
+	ALPHA_BLEND,
+};
+
 void loadMaterialTextures(
 	std::vector<Texture>& textures,
 	std::vector<TextureInfo>& textures_loaded,
@@ -32,22 +46,45 @@ void loadMaterialTextures(
 	const std::string& directory
 );
 
+AlphaMode alphaModeFromMaterial(const aiMaterial *mat, float& opacity, float& alpha_cutoff);
+
 struct Mesh {
 	std::vector<Vertex> vertices;
 	std::vector<uint> indices;
 	std::vector<Texture> textures;
+	// local space, computed once at load for culling
+	Box bounds;
+	Sphere sphere;
+	AlphaMode alpha_mode;
+	float opacity;
+	// only used by ALPHA_MASK
+	float alpha_cutoff;
+	// what its data needs, picked at load time
+	ShaderVariant variant;
+	// the program for `variant`, set by Model::init()
+	uint shader;
 	uint vbo;
 	uint ebo;
 
 	static Mesh init(aiMesh *mesh, const aiScene *scene, std::vector<TextureInfo>& textures_loaded, std::map<std::string, BoneInfo>& bone_info_map, const std::string& directory) {
+		Mesh m = Mesh::fromAssimp(mesh, scene, textures_loaded, bone_info_map, directory);
+		m.upload();
+		return m;
+	}
+
+	// everything but the GL buffers. textures that aren't in textures_loaded yet still get loaded
+	static Mesh fromAssimp(aiMesh *mesh, const aiScene *scene, std::vector<TextureInfo>& textures_loaded, std::map<std::string, BoneInfo>& bone_info_map, const std::string& directory) {
+		LoadTimer vertices_timer(LOAD_VERTICES);
 		std::vector<Vertex> vertices;
 		vertices.reserve(mesh->mNumVertices);
+		Box bounds = Box::empty();
 		for (uint i = 0; i < mesh->mNumVertices; i++) {
 			Vertex vertex = {};
 			vertex.bone_ids.fill(-1);
 			vertex.weights.fill(0);
 
 			vertex.pos = vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+			bounds.expand(vertex.pos);
 
 			if (mesh->HasVertexColors(0)) {
 				vertex.clr = glmFromAssimpVec4(mesh->mColors[0][i]);
@@ -77,6 +114,7 @@ struct Mesh {
 				indices.push_back(face.mIndices[j]);
 			}
 		}
+		vertices_timer.stop(vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint));
 
 		std::vector<Texture> textures;
 		textures.reserve(4);
@@ -86,6 +124,11 @@ struct Mesh {
 		loadMaterialTextures(textures, textures_loaded, material, aiTextureType_NORMALS, directory);
 		loadMaterialTextures(textures, textures_loaded, material, aiTextureType_HEIGHT, directory);
 
+		float opacity, alpha_cutoff;
+		AlphaMode alpha_mode = alphaModeFromMaterial(material, opacity, alpha_cutoff);
+
+		LoadTimer bones_timer(LOAD_BONES);
+		uint64_t n_weights = 0;
 		for (uint bone_index = 0; bone_index < mesh->mNumBones; bone_index++) {
 			// bone_id is guaranteed to be initialized. if only c++ had a return block ._.
 			int bone_id;
@@ -101,6 +144,7 @@ struct Mesh {
 			}
 
 			auto weights = mesh->mBones[bone_index]->mWeights;
+			n_weights += mesh->mBones[bone_index]->mNumWeights;
 			for (uint weight_index = 0; weight_index < mesh->mBones[bone_index]->mNumWeights; weight_index++) {
 				uint vertex_id = weights[weight_index].mVertexId;
 				assert(vertex_id <= vertices.size());
@@ -115,21 +159,80 @@ struct Mesh {
 			}
 		}
 
-		uint b[2];
-		glCreateBuffers(2, b);
-		uint vbo = b[0], ebo = b[1];
-		glNamedBufferData(vbo, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
-		glNamedBufferData(ebo, indices.size() * sizeof(uint), indices.data(), GL_STATIC_DRAW);
+		// slots fill in order, so this is also how many the shader has to read
+		int influences = 0;
+		if (mesh->mNumBones > 0) {
+			for (auto& v : vertices) {
+				int n = 0;
+				for (int i = 0; i < MAX_BONE_INFLUENCE; i++) {
+					if (v.bone_ids[i] < 0) {
+						// weight 0, but -1 would still index out of boneMatrices
+						v.bone_ids[i] = 0;
+					} else {
+						n = i + 1;
+					}
+				}
+				influences = std::max(influences, n);
+			}
+		}
+		bones_timer.stop(n_weights * sizeof(aiVertexWeight));
+
+		const bool textured = mesh->HasTextureCoords(0) && std::any_of(textures.begin(), textures.end(), [](const Texture& t) {
+			return t.type == aiTextureType_DIFFUSE;
+		});
+		const ShaderVariant variant = ShaderVariant::init(mesh->mNumBones > 0, influences, textured, mesh->HasVertexColors(0));
+
+		if (vertices.empty()) {
+			bounds = { .min = vec3(0.0f), .max = vec3(0.0f) };
+		}
+		Sphere sphere = { .center = bounds.center(), .radius = 0.0f };
+		for (const auto& v : vertices) {
+			sphere.radius = std::max(sphere.radius, glm::length(v.pos - sphere.center));
+		}
+		// bind pose only tells us so much once the skeleton starts moving limbs around,
+		// so grow skinned meshes to the cube around their bounding sphere
+		if (mesh->mNumBones > 0) {
+			bounds.min = sphere.center - vec3(sphere.radius);
+			bounds.max = sphere.center + vec3(sphere.radius);
+		}
 
 		return {
 			.vertices = vertices,
 			.indices = indices,
 			.textures = textures,
-			.vbo = vbo,
-			.ebo = ebo,
+			.bounds = bounds,
+			.sphere = sphere,
+			.alpha_mode = alpha_mode,
+			.opacity = opacity,
+			.alpha_cutoff = alpha_cutoff,
+			.variant = variant,
+			.shader = 0,
+			.vbo = 0,
+			.ebo = 0,
 		};
 	}
 
+	void upload() {
+		LoadTimer timer(LOAD_UPLOAD);
+		uint b[2];
+		glCreateBuffers(2, b);
+		this->vbo = b[0];
+		this->ebo = b[1];
+		glNamedBufferData(this->vbo, this->vertices.size() * sizeof(Vertex), this->vertices.data(), GL_STATIC_DRAW);
+		glNamedBufferData(this->ebo, this->indices.size() * sizeof(uint), this->indices.data(), GL_STATIC_DRAW);
+		timer.stop(this->vertices.size() * sizeof(Vertex) + this->indices.size() * sizeof(uint));
+		gpu_resources.buffer(this->vbo, this->vertices.size() * sizeof(Vertex));
+		gpu_resources.buffer(this->ebo, this->indices.size() * sizeof(uint));
+	}
+
+	// textures belong to the model, see Model::deinit()
+	void deinit() {
+		const uint b[2] = { this->vbo, this->ebo };
+		gpu_resources.deleteBuffers(2, b);
+		this->vbo = 0;
+		this->ebo = 0;
+	}
+
 	// TODO:
 	//  - test
 	//  - handle multiple textures
@@ -137,12 +240,14 @@ struct Mesh {
 	// NOTE: assuming we're using 1 VAO for the whole program
 	//
 	// BUG: BREAKS IF THERE MUITIPLE TEXTURES OF THE SAME TYPE (unimplemented lol)
-	void draw(uint vao, uint shader) const {
-		glUseProgram(shader);
-		glBindVertexArray(vao);
+	void draw(GLState& gl, uint vao, uint shader) const {
+		gl.useProgram(shader);
+		gl.bindVertexArray(vao);
 
 		// THUNK: does this really need to be an array? can't a struct suffice?
-		for (usize i = 0; i < this->textures.size(); i++) {
+		// untextured variants don't have the samplers at all
+		const usize n_textures = this->variant.features & SHADER_TEXTURED ? this->textures.size() : 0;
+		for (usize i = 0; i < n_textures; i++) {
 			int loc = 0;
 			switch (this->textures[i].type) {
 			case aiTextureType_DIFFUSE:
@@ -161,13 +266,19 @@ struct Mesh {
 				loc = 0;
 				break;
 			}
-			glBindTextureUnit(i, this->textures[i].id);
-			glProgramUniform1i(shader, loc, i);
+			gl.bindTextureUnit(i, this->textures[i].id);
+			gl.uniform1i(shader, loc, i);
 		}
+		// a cutoff of 0 never discards
+		gl.uniform1f(shader, 4, this->alpha_mode == ALPHA_MASK ? this->alpha_cutoff : 0.0f);
+		gl.uniform1f(shader, 5, this->opacity);
 
-		glVertexArrayVertexBuffer(vao, 0, this->vbo, 0, sizeof(Vertex));
-		glVertexArrayElementBuffer(vao, this->ebo);
+		gl.vertexBuffer(vao, this->vbo, sizeof(Vertex));
+		gl.elementBuffer(vao, this->ebo);
 		glDrawElements(GL_TRIANGLES, static_cast<uint>(indices.size()), GL_UNSIGNED_INT, 0);
+		COUNTER_ADD(COUNTER_DRAW_CALLS, 1);
+		COUNTER_ADD(COUNTER_TRIANGLES, this->indices.size() / 3);
+		COUNTER_ADD(COUNTER_VERTICES, this->vertices.size());
 	}
 };
 
@@ -202,3 +313,32 @@ void loadMaterialTextures(
 		}
 	}
 }
+
+// gltf says what it wants outright, everything else gets guessed from opacity
+AlphaMode alphaModeFromMaterial(const aiMaterial *mat, float& opacity, float& alpha_cutoff) {
+	opacity = 1.0f;
+	alpha_cutoff = 0.5f;
+	mat->Get(AI_MATKEY_OPACITY, opacity);
+
+	aiString gltf_mode;
+	if (mat->Get(AI_MATKEY_GLTF_ALPHAMODE, gltf_mode) == aiReturn_SUCCESS) {
+		if (std::strcmp(gltf_mode.C_Str(), "MASK") == 0) {
+			mat->Get(AI_MATKEY_GLTF_ALPHACUTOFF, alpha_cutoff);
+			return ALPHA_MASK;
+		}
+		if (std::strcmp(gltf_mode.C_Str(), "BLEND") == 0) {
+			return ALPHA_BLEND;
+		}
+		// OPAQUE ignores alpha entirely
+		opacity = 1.0f;
+		return ALPHA_OPAQUE;
+	}
+
+	if (opacity < 1.0f) {
+		return ALPHA_BLEND;
+	}
+	if (mat->GetTextureCount(aiTextureType_OPACITY) > 0) {
+		return ALPHA_MASK;
+	}
+	return ALPHA_OPAQUE;
+}
@@ -0,0 +1,656 @@
+#pragma once
+
+/* Static triangle BVH over level geometry: closest-hit ray casts and swept capsule queries */
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <types.hpp>
+#include <model.hpp>
+
+#define MESH_BVH_BINS 16
+#define MESH_BVH_MAX_LEAF 4
+// traversal stack slots, the build stops splitting 2 levels short of this
+#define MESH_BVH_STACK 64
+// subtrees smaller than this aren't worth a thread
+#define MESH_BVH_PARALLEL_MIN 16384
+// rays traversed together by the batched raycast(), one bit each in a uint mask
+#define MESH_BVH_PACKET 8
+// sweeps stop this far short of what they hit, so the next one doesn't start out touching it
+#define CAPSULE_SKIN 0.001f
+// conservative advancement steps per triangle before settling for where it got to
+#define CAPSULE_SWEEP_STEPS 32
+// hits slide() follows along before giving up on the rest of the move
+#define CAPSULE_SLIDES 4
+// a hit whose normal is at least this much up is ground rather than wall
+#define CAPSULE_GROUND_Y 0.7f
+
+// 32 bytes, two to a cache line
+struct MeshBVHNode {
+	vec3 min;
+	// leaf: first triangle. inner: the left child, the right one follows it
+	uint first;
+	vec3 max;
+	// 0 for inner nodes
+	uint count;
+
+	bool isLeaf() const {
+		return this->count > 0;
+	}
+};
+
+// a corner and the two edges out of it, what the ray test wants
+struct Triangle {
+	vec3 v0;
+	vec3 e1;
+	vec3 e2;
+};
+
+struct Ray {
+	vec3 origin;
+	// doesn't have to be normalized, t is in units of it
+	vec3 dir;
+	float max_t;
+};
+
+struct TriHit {
+	// UINT32_MAX on a miss
+	uint tri;
+	float t;
+	// facing back along the ray
+	vec3 normal;
+};
+
+// the points within `radius` of the segment a-b
+struct Capsule {
+	vec3 a;
+	vec3 b;
+	float radius;
+};
+
+struct CapsuleHit {
+	// fraction of the sweep's delta
+	float t;
+	// away from the triangle, toward the capsule
+	vec3 normal;
+};
+
+// the triangles of every mesh in `model`, 3 world space corners each
+void meshTriangles(const Model& model, const mat4& transform, std::vector<vec3>& out) {
+	for (const auto& mesh : model.meshes) {
+		for (uint i = 0; i + 2 < mesh.indices.size(); i += 3) {
+			for (uint j = 0; j < 3; j++) {
+				out.push_back(vec3(transform * vec4(mesh.vertices[mesh.indices[i + j]].pos, 1.0f)));
+			}
+		}
+	}
+}
+
+// closest point to p on triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+vec3 closestOnTriangle(vec3 p, vec3 a, vec3 b, vec3 c) {
+	const vec3 ab = b - a, ac = c - a, ap = p - a;
+	const float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) return a;
+	const vec3 bp = p - b;
+	const float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) return b;
+	const float vc = d1*d4 - d3*d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+	const vec3 cp = p - c;
+	const float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) return c;
+	const float vb = d5*d2 - d1*d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+	const float va = d3*d6 - d5*d4;
+	if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	const float denom = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// closest points between segments p1-q1 and p2-q2 (Ericson 5.1.9)
+void closestOnSegments(vec3 p1, vec3 q1, vec3 p2, vec3 q2, vec3& c1, vec3& c2) {
+	const vec3 d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+	const float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+	const float eps = 1e-12f;
+	float s, t;
+	if (a <= eps && e <= eps) {
+		s = t = 0.0f;
+	} else if (a <= eps) {
+		s = 0.0f;
+		t = std::clamp(f / e, 0.0f, 1.0f);
+	} else {
+		const float c = glm::dot(d1, r);
+		if (e <= eps) {
+			t = 0.0f;
+			s = std::clamp(-c / a, 0.0f, 1.0f);
+		} else {
+			const float b = glm::dot(d1, d2);
+			const float denom = a*e - b*b;
+			s = denom != 0.0f ? std::clamp((b*f - c*e) / denom, 0.0f, 1.0f) : 0.0f;
+			t = (b*s + f) / e;
+			if (t < 0.0f) {
+				t = 0.0f;
+				s = std::clamp(-c / a, 0.0f, 1.0f);
+			} else if (t > 1.0f) {
+				t = 1.0f;
+				s = std::clamp((b - c) / a, 0.0f, 1.0f);
+			}
+		}
+	}
+	c1 = p1 + d1 * s;
+	c2 = p2 + d2 * t;
+}
+
+struct MeshBVH {
+	std::vector<MeshBVHNode> nodes;
+	// in leaf order
+	std::vector<Triangle> tris;
+	// index into the corners init() was given, per triangle in leaf order
+	std::vector<uint> source;
+	// of the deepest leaf, the root is 0
+	uint max_depth;
+	float build_ms;
+
+	// `corners` 3 per triangle, in world space
+	static MeshBVH init(const std::vector<vec3>& corners, uint n_threads) {
+		auto start = chrono::steady_clock::now();
+		MeshBVH bvh = {};
+		const uint n = corners.size() / 3;
+
+		// only the build needs these
+		std::vector<Box> boxes(n);
+		std::vector<vec3> centroids(n);
+		bvh.source.resize(n);
+		for (uint i = 0; i < n; i++) {
+			Box box = Box::empty();
+			box.expand(corners[3*i]);
+			box.expand(corners[3*i + 1]);
+			box.expand(corners[3*i + 2]);
+			boxes[i] = box;
+			centroids[i] = box.center();
+			bvh.source[i] = i;
+		}
+
+		bvh.nodes.resize(std::max(2 * n, 1u));
+		std::atomic<uint> n_nodes = n > 0 ? 1 : 0;
+		std::atomic<uint> max_depth = 0;
+		if (n > 0) {
+			int par_depth = 0;
+			while ((1u << par_depth) < std::max(n_threads, 1u)) {
+				par_depth++;
+			}
+			bvh.buildNode(boxes, centroids, n_nodes, max_depth, 0, 0, n, 0, par_depth);
+		}
+		bvh.max_depth = max_depth;
+		bvh.nodes.resize(n_nodes);
+		bvh.nodes.shrink_to_fit();
+
+		bvh.tris.resize(n);
+		for (uint i = 0; i < n; i++) {
+			const vec3* c = &corners[3 * bvh.source[i]];
+			bvh.tris[i] = { .v0 = c[0], .e1 = c[1] - c[0], .e2 = c[2] - c[0] };
+		}
+		bvh.build_ms = chrono::duration<float, std::milli>(chrono::steady_clock::now() - start).count();
+		return bvh;
+	}
+
+	void buildNode(const std::vector<Box>& boxes, const std::vector<vec3>& centroids, std::atomic<uint>& n_nodes, std::atomic<uint>& max_depth,
+	               uint i, uint first, uint count, uint depth, int par_depth) {
+		Box box = Box::empty(), bounds = Box::empty();
+		for (uint j = first; j < first + count; j++) {
+			box.expand(boxes[this->source[j]]);
+			bounds.expand(centroids[this->source[j]]);
+		}
+		MeshBVHNode& node = this->nodes[i];
+		node.min = box.min;
+		node.max = box.max;
+
+		// lopsided geometry gets a big leaf at the bottom rather than a tree too deep to traverse
+		if (count <= MESH_BVH_MAX_LEAF || depth + 2 >= MESH_BVH_STACK) {
+			node.first = first;
+			node.count = count;
+			uint deepest = max_depth.load(std::memory_order_relaxed);
+			while (depth > deepest && !max_depth.compare_exchange_weak(deepest, depth, std::memory_order_relaxed)) {}
+			return;
+		}
+
+		const vec3 size = bounds.max - bounds.min;
+		const int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+		uint mid = first;
+		if (size[axis] > 0.0f) {
+			// SAH over MESH_BVH_BINS equal bins of centroids along the widest axis, same as SceneBVH
+			struct Bin {
+				Box box;
+				uint count;
+			};
+			Bin bins[MESH_BVH_BINS];
+			for (auto& bin : bins) {
+				bin = { .box = Box::empty(), .count = 0 };
+			}
+			const float scale = MESH_BVH_BINS / size[axis];
+			auto binOf = [&](uint tri) {
+				return std::min((int)((centroids[tri][axis] - bounds.min[axis]) * scale), MESH_BVH_BINS - 1);
+			};
+			for (uint j = first; j < first + count; j++) {
+				Bin& bin = bins[binOf(this->source[j])];
+				bin.box.expand(boxes[this->source[j]]);
+				bin.count++;
+			}
+
+			float right_area[MESH_BVH_BINS];
+			uint right_count[MESH_BVH_BINS];
+			Box acc = Box::empty();
+			uint acc_count = 0;
+			for (int b = MESH_BVH_BINS - 1; b > 0; b--) {
+				acc.expand(bins[b].box);
+				acc_count += bins[b].count;
+				right_area[b] = acc.surfaceArea();
+				right_count[b] = acc_count;
+			}
+
+			int best_split = -1;
+			float best_cost = std::numeric_limits<float>::max();
+			acc = Box::empty();
+			acc_count = 0;
+			for (int b = 1; b < MESH_BVH_BINS; b++) {
+				acc.expand(bins[b - 1].box);
+				acc_count += bins[b - 1].count;
+				if (acc_count == 0 || right_count[b] == 0) {
+					continue;
+				}
+				float cost = acc.surfaceArea() * acc_count + right_area[b] * right_count[b];
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_split = b;
+				}
+			}
+
+			if (best_split > 0) {
+				uint* split = std::partition(&this->source[first], &this->source[first] + count, [&](uint tri) { return binOf(tri) < best_split; });
+				mid = split - &this->source[0];
+			}
+		}
+
+		if (mid == first || mid == first + count) {
+			mid = first + count / 2;
+			std::nth_element(&this->source[first], &this->source[mid], &this->source[first] + count, [&](uint a, uint b) {
+				return centroids[a][axis] < centroids[b][axis];
+			});
+		}
+
+		const uint left = n_nodes.fetch_add(2);
+		node.first = left;
+		node.count = 0;
+
+		if (par_depth > 0 && count >= MESH_BVH_PARALLEL_MIN) {
+			std::thread t([&, this] { this->buildNode(boxes, centroids, n_nodes, max_depth, left, first, mid - first, depth + 1, par_depth - 1); });
+			this->buildNode(boxes, centroids, n_nodes, max_depth, left + 1, mid, first + count - mid, depth + 1, par_depth - 1);
+			t.join();
+		} else {
+			this->buildNode(boxes, centroids, n_nodes, max_depth, left, first, mid - first, depth + 1, 0);
+			this->buildNode(boxes, centroids, n_nodes, max_depth, left + 1, mid, first + count - mid, depth + 1, 0);
+		}
+	}
+
+	// slab test, entry t or infinity on a miss
+	static float rayNode(vec3 origin, vec3 inv_dir, const MeshBVHNode& node, float max_t) {
+		const vec3 t0 = (node.min - origin) * inv_dir;
+		const vec3 t1 = (node.max - origin) * inv_dir;
+		const vec3 t_near = glm::min(t0, t1), t_far = glm::max(t0, t1);
+		const float t_enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+		const float t_exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, max_t));
+		return t_enter <= t_exit ? t_enter : std::numeric_limits<float>::infinity();
+	}
+
+	// Möller-Trumbore, both sides count. t or infinity
+	static float rayTriangle(vec3 origin, vec3 dir, const Triangle& tri) {
+		const vec3 p = glm::cross(dir, tri.e2);
+		const float det = glm::dot(tri.e1, p);
+		if (std::abs(det) < 1e-12f) {
+			return std::numeric_limits<float>::infinity();
+		}
+		const float inv_det = 1.0f / det;
+		const vec3 s = origin - tri.v0;
+		const float u = glm::dot(s, p) * inv_det;
+		if (u < 0.0f || u > 1.0f) {
+			return std::numeric_limits<float>::infinity();
+		}
+		const vec3 q = glm::cross(s, tri.e1);
+		const float v = glm::dot(dir, q) * inv_det;
+		if (v < 0.0f || u + v > 1.0f) {
+			return std::numeric_limits<float>::infinity();
+		}
+		const float t = glm::dot(tri.e2, q) * inv_det;
+		return t >= 0.0f ? t : std::numeric_limits<float>::infinity();
+	}
+
+	// closest hit within ray.max_t
+	bool raycast(const Ray& ray, TriHit& hit) const {
+		hit = { .tri = UINT32_MAX, .t = ray.max_t, .normal = vec3(0.0f) };
+		if (this->nodes.empty()) {
+			return false;
+		}
+		this->descend(ray, 1.0f / ray.dir, 0, hit);
+		if (hit.tri == UINT32_MAX) {
+			return false;
+		}
+		const Triangle& tri = this->tris[hit.tri];
+		hit.normal = glm::normalize(glm::cross(tri.e1, tri.e2));
+		if (glm::dot(hit.normal, ray.dir) > 0.0f) {
+			hit.normal = -hit.normal;
+		}
+		return true;
+	}
+
+	// one ray through the subtree under `root`, shrinking hit.t to the closest triangle it finds. no normal
+	void descend(const Ray& ray, const vec3& inv_dir, uint root, TriHit& hit) const {
+		uint stack[MESH_BVH_STACK];
+		int sp = 0;
+		stack[sp++] = root;
+		while (sp > 0) {
+			const MeshBVHNode& node = this->nodes[stack[--sp]];
+			if (node.isLeaf()) {
+				for (uint i = node.first; i < node.first + node.count; i++) {
+					const float t = rayTriangle(ray.origin, ray.dir, this->tris[i]);
+					if (t <= hit.t) {
+						hit.tri = i;
+						hit.t = t;
+					}
+				}
+				continue;
+			}
+			// near child last so it's popped first and shrinks hit.t early
+			uint l = node.first, r = node.first + 1;
+			float tl = rayNode(ray.origin, inv_dir, this->nodes[l], hit.t);
+			float tr = rayNode(ray.origin, inv_dir, this->nodes[r], hit.t);
+			if (tl < tr) {
+				std::swap(l, r);
+				std::swap(tl, tr);
+			}
+			assert(sp + 2 <= MESH_BVH_STACK);
+			if (tl <= hit.t) stack[sp++] = l;
+			if (tr <= hit.t) stack[sp++] = r;
+		}
+	}
+
+	// up to MESH_BVH_PACKET rays down the tree together: each stack entry carries the mask of rays that reached
+	// it, so a node is fetched once for all of them and only the rays that got there are tested against it.
+	// once a ray is on its own below some node it finishes that subtree through descend(), so rays that go
+	// their separate ways (scattered picks) don't drag the mask bookkeeping all the way down
+	usize raycastPacket(const Ray* rays, TriHit* hits, uint n) const {
+		assert(n <= MESH_BVH_PACKET);
+		vec3 inv_dir[MESH_BVH_PACKET];
+		for (uint k = 0; k < n; k++) {
+			hits[k] = { .tri = UINT32_MAX, .t = rays[k].max_t, .normal = vec3(0.0f) };
+			inv_dir[k] = 1.0f / rays[k].dir;
+		}
+		if (this->nodes.empty() || n == 0) {
+			return 0;
+		}
+		struct Entry {
+			uint node;
+			uint mask;
+		};
+		Entry stack[MESH_BVH_STACK];
+		int sp = 0;
+		stack[sp++] = { .node = 0, .mask = (1u << n) - 1 };
+		while (sp > 0) {
+			const Entry entry = stack[--sp];
+			if (std::has_single_bit(entry.mask)) {
+				const uint k = std::countr_zero(entry.mask);
+				this->descend(rays[k], inv_dir[k], entry.node, hits[k]);
+				continue;
+			}
+			const MeshBVHNode& node = this->nodes[entry.node];
+			if (node.isLeaf()) {
+				for (uint i = node.first; i < node.first + node.count; i++) {
+					for (uint mask = entry.mask; mask != 0; mask &= mask - 1) {
+						const uint k = std::countr_zero(mask);
+						const float t = rayTriangle(rays[k].origin, rays[k].dir, this->tris[i]);
+						if (t <= hits[k].t) {
+							hits[k].tri = i;
+							hits[k].t = t;
+						}
+					}
+				}
+				continue;
+			}
+			uint l = node.first, r = node.first + 1;
+			uint mask_l = 0, mask_r = 0;
+			float tl = std::numeric_limits<float>::infinity(), tr = tl;
+			for (uint mask = entry.mask; mask != 0; mask &= mask - 1) {
+				const uint k = std::countr_zero(mask);
+				const float kl = rayNode(rays[k].origin, inv_dir[k], this->nodes[l], hits[k].t);
+				const float kr = rayNode(rays[k].origin, inv_dir[k], this->nodes[r], hits[k].t);
+				if (kl <= hits[k].t) {
+					mask_l |= 1u << k;
+					tl = std::min(tl, kl);
+				}
+				if (kr <= hits[k].t) {
+					mask_r |= 1u << k;
+					tr = std::min(tr, kr);
+				}
+			}
+			// the child nearest to any of the rays last, so it's popped first
+			if (tl < tr) {
+				std::swap(l, r);
+				std::swap(mask_l, mask_r);
+			}
+			assert(sp + 2 <= MESH_BVH_STACK);
+			if (mask_l != 0) stack[sp++] = { .node = l, .mask = mask_l };
+			if (mask_r != 0) stack[sp++] = { .node = r, .mask = mask_r };
+		}
+		usize n_hits = 0;
+		for (uint k = 0; k < n; k++) {
+			if (hits[k].tri == UINT32_MAX) {
+				continue;
+			}
+			const Triangle& tri = this->tris[hits[k].tri];
+			hits[k].normal = glm::normalize(glm::cross(tri.e1, tri.e2));
+			if (glm::dot(hits[k].normal, rays[k].dir) > 0.0f) {
+				hits[k].normal = -hits[k].normal;
+			}
+			n_hits++;
+		}
+		return n_hits;
+	}
+
+	// MESH_BVH_PACKET consecutive rays at a time through raycastPacket(), so callers should keep the ones
+	// that go the same way next to each other. returns the number of hits
+	usize raycast(const Ray* rays, TriHit* hits, usize n) const {
+		usize n_hits = 0;
+		for (usize i = 0; i < n; i += MESH_BVH_PACKET) {
+			n_hits += this->raycastPacket(rays + i, hits + i, std::min<usize>(n - i, MESH_BVH_PACKET));
+		}
+		return n_hits;
+	}
+
+	// distance between segment p-q and a triangle, and the direction from the triangle to the segment
+	static float segmentDistance(vec3 p, vec3 q, const Triangle& tri, vec3& normal) {
+		const vec3 a = tri.v0, b = tri.v0 + tri.e1, c = tri.v0 + tri.e2;
+		const vec3 face = glm::normalize(glm::cross(tri.e1, tri.e2));
+
+		// crossing the plane inside the triangle
+		const float dp = glm::dot(p - a, face), dq = glm::dot(q - a, face);
+		if ((dp <= 0.0f) != (dq <= 0.0f)) {
+			const vec3 x = p + (q - p) * (dp / (dp - dq));
+			const vec3 off = closestOnTriangle(x, a, b, c) - x;
+			if (glm::dot(off, off) < 1e-12f) {
+				normal = dp >= 0.0f ? face : -face;
+				return 0.0f;
+			}
+		}
+
+		vec3 on_seg = p, on_tri = closestOnTriangle(p, a, b, c);
+		float best = glm::dot(on_seg - on_tri, on_seg - on_tri);
+		auto consider = [&](vec3 s, vec3 t) {
+			const float d = glm::dot(s - t, s - t);
+			if (d < best) {
+				best = d;
+				on_seg = s;
+				on_tri = t;
+			}
+		};
+		consider(q, closestOnTriangle(q, a, b, c));
+		const vec3 edges[3][2] = { { a, b }, { b, c }, { c, a } };
+		for (const auto& edge : edges) {
+			vec3 s, t;
+			closestOnSegments(p, q, edge[0], edge[1], s, t);
+			consider(s, t);
+		}
+		const float dist = std::sqrt(best);
+		if (dist > 1e-6f) {
+			normal = (on_seg - on_tri) / dist;
+		} else {
+			normal = dp >= 0.0f ? face : -face;
+		}
+		return dist;
+	}
+
+	// how far along `delta` the capsule gets before touching `tri`, conservative advancement: the
+	// distance can't shrink faster than the capsule moves, so stepping by it never passes through
+	static bool sweepTriangle(const Capsule& capsule, vec3 delta, float delta_len, const Triangle& tri, CapsuleHit& hit) {
+		float t = 0.0f;
+		for (uint step = 0; step < CAPSULE_SWEEP_STEPS; step++) {
+			vec3 normal;
+			const float dist = segmentDistance(capsule.a + delta * t, capsule.b + delta * t, tri, normal);
+			if (dist <= capsule.radius + CAPSULE_SKIN) {
+				// already touching at the start only counts when moving further in, not along it
+				if (step == 0 && glm::dot(delta, normal) > -1e-3f * delta_len) {
+					return false;
+				}
+				hit = { .t = t, .normal = normal };
+				return true;
+			}
+			t += (dist - capsule.radius - 0.5f * CAPSULE_SKIN) / delta_len;
+			if (t >= hit.t) {
+				return false;
+			}
+		}
+		// grazing along it the whole way, stopping here is safe
+		vec3 normal;
+		segmentDistance(capsule.a + delta * t, capsule.b + delta * t, tri, normal);
+		hit = { .t = t, .normal = normal };
+		return true;
+	}
+
+	// first contact moving `capsule` by `delta`, hit.t is a fraction of it
+	bool sweepCapsule(const Capsule& capsule, vec3 delta, CapsuleHit& hit) const {
+		hit = { .t = 1.0f, .normal = vec3(0.0f) };
+		const float delta_len = glm::length(delta);
+		if (this->nodes.empty() || delta_len < 1e-9f) {
+			return false;
+		}
+		Box sweep = Box::empty();
+		sweep.expand(capsule.a);
+		sweep.expand(capsule.b);
+		sweep.expand(capsule.a + delta);
+		sweep.expand(capsule.b + delta);
+		sweep.min -= vec3(capsule.radius + CAPSULE_SKIN);
+		sweep.max += vec3(capsule.radius + CAPSULE_SKIN);
+
+		bool found = false;
+		uint stack[MESH_BVH_STACK];
+		int sp = 0;
+		stack[sp++] = 0;
+		while (sp > 0) {
+			const MeshBVHNode& node = this->nodes[stack[--sp]];
+			if (!sweep.overlaps({ .min = node.min, .max = node.max })) {
+				continue;
+			}
+			if (!node.isLeaf()) {
+				assert(sp + 2 <= MESH_BVH_STACK);
+				stack[sp++] = node.first;
+				stack[sp++] = node.first + 1;
+				continue;
+			}
+			for (uint i = node.first; i < node.first + node.count; i++) {
+				CapsuleHit tri_hit = hit;
+				if (sweepTriangle(capsule, delta, delta_len, this->tris[i], tri_hit) && tri_hit.t < hit.t) {
+					hit = tri_hit;
+					found = true;
+				}
+			}
+		}
+		return found;
+	}
+
+	// the part of `rest` that goes into none of `planes`: along one of them if that's enough, else along
+	// the crease of two. nothing when it's boxed in
+	static vec3 clipToPlanes(vec3 rest, const vec3* planes, uint n) {
+		auto clear = [&](vec3 d, uint a, uint b) {
+			for (uint k = 0; k < n; k++) {
+				if (k != a && k != b && glm::dot(d, planes[k]) < -1e-7f) {
+					return false;
+				}
+			}
+			return true;
+		};
+		for (uint i = 0; i < n; i++) {
+			const vec3 d = rest - planes[i] * std::min(glm::dot(rest, planes[i]), 0.0f);
+			if (clear(d, i, i)) {
+				return d;
+			}
+		}
+		for (uint i = 0; i < n; i++) {
+			for (uint j = i + 1; j < n; j++) {
+				const vec3 crease = glm::cross(planes[i], planes[j]);
+				const float len2 = glm::dot(crease, crease);
+				if (len2 < 1e-12f) {
+					continue;
+				}
+				const vec3 d = crease * (glm::dot(rest, crease) / len2);
+				if (clear(d, i, j)) {
+					return d;
+				}
+			}
+		}
+		return vec3(0.0f);
+	}
+
+	// moves `capsule` by as much of `delta` as it can, sliding along what it runs into. returns the
+	// distance actually moved, `grounded` if it ended up resting on something facing up
+	vec3 slide(Capsule capsule, vec3 delta, bool& grounded) const {
+		grounded = false;
+		vec3 moved = vec3(0.0f);
+		// everything hit so far this move. sliding off one straight into another would bounce between
+		// them, so the rest of the move is kept out of all of them
+		vec3 planes[CAPSULE_SLIDES];
+		for (uint i = 0; i < CAPSULE_SLIDES; i++) {
+			CapsuleHit hit;
+			if (!this->sweepCapsule(capsule, delta, hit)) {
+				moved += delta;
+				break;
+			}
+			const vec3 step = delta * hit.t;
+			moved += step;
+			capsule.a += step;
+			capsule.b += step;
+			grounded = grounded || hit.normal.y >= CAPSULE_GROUND_Y;
+			planes[i] = hit.normal;
+
+			delta = clipToPlanes(delta - step, planes, i + 1);
+			if (glm::dot(delta, delta) < 1e-12f) {
+				break;
+			}
+		}
+		return moved;
+	}
+
+	void print(std::ostream& out) const {
+		out << "bvh(info): " << this->tris.size() << " level triangles, " << this->nodes.size() << " nodes " << this->max_depth << " deep ("
+		    << (this->nodes.size() * sizeof(MeshBVHNode) + this->tris.size() * sizeof(Triangle)) / 1024 << "KiB), built in "
+		    << this->build_ms << "ms" << std::endl;
+	}
+};
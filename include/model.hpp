@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <map>
@@ -10,34 +11,26 @@
 #include <utils.hpp>
 #include "./mesh.hpp"
 
-struct Box {
-	vec3 min;
-	vec3 max;
-
-	Box translate(vec3 x) const {
-		Box box = *this;
-		box.min += x;
-		box.max += x;
-		return box;
-	}
-};
-
 struct Model {
 	std::vector<TextureInfo> textures_loaded;
 	std::vector<Mesh> meshes;
-	vec3 velocity;
 	vec3 pos;
+	// where the last sim step started, renderPos() interpolates from here
+	vec3 prev_pos;
 	Box hitbox;
+	// local space, union of the meshes' bounds
+	Box bounds;
 	std::map<std::string, BoneInfo> bone_info_map;
 	uint vao;
-	uint shader;
+	// distinct programs of the skinned meshes, they all need the bone matrices
+	std::vector<uint> skinned_programs;
 
 	// vec3 front; // follow cam
 
-	static Model init(const std::string& path, uint vao, uint shader) {
+	// every mesh gets the variant of `variants` that matches its data
+	static Model init(const std::string& path, uint vao, ShaderVariants& variants) {
 		Model model = {};
 		model.vao = vao;
-		model.shader = shader;
 
 		uint flags = 0;
 		flags |= aiProcess_Triangulate;
@@ -45,8 +38,9 @@ struct Model {
 		// flags |= aiProcess_CalcTangentSpace;
 
 		std::cerr << "assimp(info): loading " << path << std::endl;
+		LoadAsset asset(path);
 		Assimp::Importer imp;
-		const aiScene *scene = imp.ReadFile(path, flags);
+		const aiScene *scene = readScene(imp, path, flags);
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
 			std::cerr << "assimp(error): " << imp.GetErrorString() << std::endl;
 			return {}; // TODO: handle error
@@ -54,9 +48,39 @@ struct Model {
 		auto directory = path.substr(0, path.find_last_of('/')); // doesn't work if a basename/dirname has '/'
 		model.processNode(scene->mRootNode, scene, directory);
 
+		std::vector<ShaderVariant> used;
+		for (const auto& mesh : model.meshes) {
+			used.push_back(mesh.variant);
+		}
+		variants.build(used);
+		for (auto& mesh : model.meshes) {
+			mesh.shader = variants.get(mesh.variant);
+			if (mesh.variant.features & SHADER_SKINNED && std::find(model.skinned_programs.begin(), model.skinned_programs.end(), mesh.shader) == model.skinned_programs.end()) {
+				model.skinned_programs.push_back(mesh.shader);
+			}
+		}
+
+		model.bounds = Box::empty();
+		for (const auto& mesh : model.meshes) {
+			model.bounds.expand(mesh.bounds);
+		}
+		if (model.meshes.empty()) {
+			model.bounds = { .min = vec3(0.0f), .max = vec3(0.0f) };
+		}
+
 		return model;
 	}
 
+	void deinit() {
+		for (auto& mesh : this->meshes) {
+			mesh.deinit();
+		}
+		for (const auto& t : this->textures_loaded) {
+			gpu_resources.deleteTextures(1, &t.texture.id);
+		}
+		this->textures_loaded.clear();
+	}
+
 	void processNode(aiNode* node, const aiScene* scene, const std::string& directory) {
 		for (uint i = 0; i < node->mNumMeshes; i++) {
 			aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
@@ -67,13 +91,27 @@ struct Model {
 		}
 	}
 
-	void draw() const {
-		for (auto m : this->meshes) {
-			m.draw(this->vao, this->shader);
+	void draw(GLState& gl) const {
+		for (const auto& m : this->meshes) {
+			m.draw(gl, this->vao, m.shader);
 		}
 	}
 
-	bool detectObj(vec3& new_pos, Model obj) {
+	// what the scene BVH stores for this instance: drawn bounds and hitbox together
+	Box worldBounds(const mat4& transform) const {
+		Box box = this->bounds.transform(transform);
+		box.expand(this->hitbox.translate(this->pos));
+		return box;
+	}
+
+	// between the last two sim steps, SimClock::alpha() of the way
+	vec3 renderPos(float alpha) const {
+		return glm::mix(this->prev_pos, this->pos, alpha);
+	}
+
+	// stops a fall onto `obj`, `velocity` is whatever moved this from pos to new_pos
+	bool detectObj(vec3& new_pos, vec3& velocity, const Model& obj) {
+		COUNTER_ADD(COUNTER_COLLISION_TESTS, 1);
 		bool collision = true;
 
 		Box new_box = this->hitbox.translate(new_pos);
@@ -95,7 +133,7 @@ struct Model {
 				// if was on top
 				if (old_box.min.y >= obj_box.max.y) {
 					new_pos.y = obj_box.max.y;
-					this->velocity.y = 0;
+					velocity.y = 0;
 				}
 			}
 		}
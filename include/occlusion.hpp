@@ -0,0 +1,293 @@
+#pragma once
+
+/* Software occlusion culling against a low resolution hierarchical depth buffer */
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include <types.hpp>
+#include <jobs.hpp>
+#include <model.hpp>
+
+// 8 pixels per SIMD row, tiles are the coarse level of the hierarchy
+#define OCCLUSION_TILE 8
+
+// Triangles that stand in for a model in the depth buffer. They have to be a subset of the real
+// surface so they never hide something that's actually visible, which is why this keeps the biggest
+// triangles up to a budget instead of simplifying (simplified meshes bulge out of the original).
+struct Occluder {
+	std::vector<vec3> positions;
+	std::vector<uint> indices;
+
+	static Occluder init(const Model& model, usize max_triangles) {
+		struct Tri {
+			const Mesh* mesh;
+			uint first;
+			float area;
+		};
+		std::vector<Tri> tris;
+		for (const auto& mesh : model.meshes) {
+			// alpha tested and blended surfaces can be seen through
+			if (mesh.alpha_mode != ALPHA_OPAQUE) {
+				continue;
+			}
+			for (uint i = 0; i + 2 < mesh.indices.size(); i += 3) {
+				vec3 a = mesh.vertices[mesh.indices[i]].pos;
+				vec3 b = mesh.vertices[mesh.indices[i + 1]].pos;
+				vec3 c = mesh.vertices[mesh.indices[i + 2]].pos;
+				tris.push_back({ .mesh = &mesh, .first = i, .area = glm::length(glm::cross(b - a, c - a)) });
+			}
+		}
+		if (tris.size() > max_triangles) {
+			std::nth_element(tris.begin(), tris.begin() + max_triangles, tris.end(), [](const Tri& a, const Tri& b) {
+				return a.area > b.area;
+			});
+			tris.resize(max_triangles);
+		}
+
+		Occluder occluder = {};
+		occluder.positions.reserve(tris.size() * 3);
+		occluder.indices.reserve(tris.size() * 3);
+		for (const auto& tri : tris) {
+			for (uint j = 0; j < 3; j++) {
+				occluder.indices.push_back(occluder.positions.size());
+				occluder.positions.push_back(tri.mesh->vertices[tri.mesh->indices[tri.first + j]].pos);
+			}
+		}
+		return occluder;
+	}
+};
+
+// screen space triangle ready for rasterization, edge i is inside when a*x + b*y + c >= 0
+struct OccluderTri {
+	vec3 a, b, c;
+	ivec2 min;
+	ivec2 max;
+	// depth of the farthest vertex, written for every covered pixel so the buffer never claims
+	// anything is nearer than it really is
+	float z;
+};
+
+struct OcclusionBuffer {
+	int width;
+	int height;
+	// [0, 1] like the GL depth buffer, 1 = nothing drawn
+	std::vector<float> depth;
+	// farthest depth per OCCLUSION_TILE^2 tile
+	std::vector<float> tile_max;
+	std::vector<OccluderTri> tris;
+	// bands of tile rows rasterize() splits the buffer into, one per job worker is plenty
+	uint n_threads;
+
+	// width and height are rounded up to whole tiles
+	static OcclusionBuffer init(int width, int height, uint n_threads) {
+		OcclusionBuffer buffer = {};
+		buffer.width = (width + OCCLUSION_TILE - 1) / OCCLUSION_TILE * OCCLUSION_TILE;
+		buffer.height = (height + OCCLUSION_TILE - 1) / OCCLUSION_TILE * OCCLUSION_TILE;
+		buffer.depth.resize(buffer.width * buffer.height);
+		buffer.tile_max.resize(buffer.depth.size() / (OCCLUSION_TILE * OCCLUSION_TILE));
+		buffer.n_threads = std::max(n_threads, 1u);
+		buffer.clear();
+		return buffer;
+	}
+
+	int tilesX() const {
+		return this->width / OCCLUSION_TILE;
+	}
+
+	void clear() {
+		std::fill(this->depth.begin(), this->depth.end(), 1.0f);
+		std::fill(this->tile_max.begin(), this->tile_max.end(), 1.0f);
+		this->tris.clear();
+	}
+
+	vec3 toScreen(const vec4& clip) const {
+		return vec3(
+			(clip.x / clip.w * 0.5f + 0.5f) * this->width,
+			(clip.y / clip.w * 0.5f + 0.5f) * this->height,
+			clip.z / clip.w * 0.5f + 0.5f
+		);
+	}
+
+	// Edge p -> q, positive on its left. Always computed from the same end so the two triangles
+	// sharing an edge get exactly negated coefficients, otherwise rounding leaves pixel holes along it.
+	static void setupEdge(vec3 p, vec3 q, float& a, float& b, float& c) {
+		bool swap = p.x > q.x || (p.x == q.x && p.y > q.y);
+		if (swap) {
+			std::swap(p, q);
+		}
+		a = p.y - q.y;
+		b = q.x - p.x;
+		c = p.x*q.y - p.y*q.x;
+		if (swap) {
+			a = -a;
+			b = -b;
+			c = -c;
+		}
+	}
+
+	// transforms and sets up an occluder's triangles, nothing is drawn until rasterize()
+	void addOccluder(const Occluder& occluder, const mat4& mvp) {
+		for (usize i = 0; i + 2 < occluder.indices.size(); i += 3) {
+			vec4 clip[3];
+			bool behind = false;
+			for (int j = 0; j < 3; j++) {
+				clip[j] = mvp * vec4(occluder.positions[occluder.indices[i + j]], 1.0f);
+				behind |= clip[j].w < 1e-4f || clip[j].z < -clip[j].w;
+			}
+			// no clipping, dropping an occluder only ever makes us cull less
+			if (behind) {
+				continue;
+			}
+			vec3 v0 = this->toScreen(clip[0]), v1 = this->toScreen(clip[1]), v2 = this->toScreen(clip[2]);
+
+			OccluderTri tri = {};
+			setupEdge(v0, v1, tri.a.x, tri.b.x, tri.c.x);
+			setupEdge(v1, v2, tri.a.y, tri.b.y, tri.c.y);
+			setupEdge(v2, v0, tri.a.z, tri.b.z, tri.c.z);
+			float area = (v1.x - v0.x)*(v2.y - v0.y) - (v1.y - v0.y)*(v2.x - v0.x);
+			if (area == 0.0f) {
+				continue;
+			}
+			// both windings occlude
+			if (area < 0.0f) {
+				tri.a = -tri.a;
+				tri.b = -tri.b;
+				tri.c = -tri.c;
+			}
+			tri.z = std::max(std::max(v0.z, v1.z), v2.z);
+			if (tri.z > 1.0f) {
+				continue;
+			}
+			tri.min = ivec2(
+				std::max((int)std::floor(std::min(std::min(v0.x, v1.x), v2.x)), 0),
+				std::max((int)std::floor(std::min(std::min(v0.y, v1.y), v2.y)), 0)
+			);
+			tri.max = ivec2(
+				std::min((int)std::ceil(std::max(std::max(v0.x, v1.x), v2.x)), this->width - 1),
+				std::min((int)std::ceil(std::max(std::max(v0.y, v1.y), v2.y)), this->height - 1)
+			);
+			if (tri.min.x > tri.max.x || tri.min.y > tri.max.y) {
+				continue;
+			}
+			this->tris.push_back(tri);
+		}
+	}
+
+	// each thread owns a band of tile rows, so the result doesn't depend on the thread count
+	void rasterize() {
+		const int tile_rows = this->height / OCCLUSION_TILE;
+		const int n_bands = std::min<int>(this->n_threads, tile_rows);
+		auto band = [&](int i) {
+			int y0 = tile_rows * i / n_bands * OCCLUSION_TILE;
+			int y1 = tile_rows * (i + 1) / n_bands * OCCLUSION_TILE;
+			this->rasterizeRows(y0, y1);
+		};
+
+		job_system.parallelFor(n_bands, 1, [&](usize begin, usize end) {
+			for (usize i = begin; i < end; i++) {
+				band(i);
+			}
+		});
+	}
+
+	void rasterizeRows(int y0, int y1) {
+		for (const auto& tri : this->tris) {
+			int ty0 = std::max(tri.min.y, y0), ty1 = std::min(tri.max.y, y1 - 1);
+			// rows start on a multiple of 8 so the SIMD loop never straddles the right edge
+			int tx0 = tri.min.x & ~7, tx1 = tri.max.x;
+			for (int y = ty0; y <= ty1; y++) {
+				float* row = &this->depth[y * this->width];
+				const float py = y + 0.5f;
+				int x = tx0;
+#if defined(__AVX__)
+				const __m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+				const __m256 z = _mm256_set1_ps(tri.z);
+				const __m256 a0 = _mm256_set1_ps(tri.a.x), a1 = _mm256_set1_ps(tri.a.y), a2 = _mm256_set1_ps(tri.a.z);
+				const __m256 r0 = _mm256_set1_ps(tri.b.x*py + tri.c.x), r1 = _mm256_set1_ps(tri.b.y*py + tri.c.y), r2 = _mm256_set1_ps(tri.b.z*py + tri.c.z);
+				for (; x <= tx1; x += 8) {
+					const __m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), offsets);
+					__m256 e0 = _mm256_add_ps(_mm256_mul_ps(a0, px), r0);
+					__m256 e1 = _mm256_add_ps(_mm256_mul_ps(a1, px), r1);
+					__m256 e2 = _mm256_add_ps(_mm256_mul_ps(a2, px), r2);
+					__m256 out = _mm256_cmp_ps(e0, _mm256_setzero_ps(), _CMP_LT_OQ);
+					out = _mm256_or_ps(out, _mm256_cmp_ps(e1, _mm256_setzero_ps(), _CMP_LT_OQ));
+					out = _mm256_or_ps(out, _mm256_cmp_ps(e2, _mm256_setzero_ps(), _CMP_LT_OQ));
+					__m256 d = _mm256_loadu_ps(row + x);
+					__m256 nearer = _mm256_min_ps(d, z);
+					_mm256_storeu_ps(row + x, _mm256_blendv_ps(nearer, d, out));
+				}
+#endif
+				for (; x <= tx1; x++) {
+					float px = x + 0.5f;
+					if (tri.a.x*px + (tri.b.x*py + tri.c.x) >= 0.0f
+					 && tri.a.y*px + (tri.b.y*py + tri.c.y) >= 0.0f
+					 && tri.a.z*px + (tri.b.z*py + tri.c.z) >= 0.0f) {
+						row[x] = std::min(row[x], tri.z);
+					}
+				}
+			}
+		}
+
+		for (int ty = y0 / OCCLUSION_TILE; ty < y1 / OCCLUSION_TILE; ty++) {
+			for (int tx = 0; tx < this->tilesX(); tx++) {
+				float m = 0.0f;
+				for (int y = ty * OCCLUSION_TILE; y < (ty + 1) * OCCLUSION_TILE; y++) {
+					for (int x = tx * OCCLUSION_TILE; x < (tx + 1) * OCCLUSION_TILE; x++) {
+						m = std::max(m, this->depth[y * this->width + x]);
+					}
+				}
+				this->tile_max[ty * this->tilesX() + tx] = m;
+			}
+		}
+	}
+
+	// false only if every pixel the box could cover already has something nearer in it
+	bool testBox(const Box& box, const mat4& view_proj) const {
+		vec2 lo = vec2(std::numeric_limits<float>::max()), hi = vec2(std::numeric_limits<float>::lowest());
+		float z = std::numeric_limits<float>::max();
+		for (int i = 0; i < 8; i++) {
+			vec3 corner = vec3(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z);
+			vec4 clip = view_proj * vec4(corner, 1.0f);
+			// crosses the near plane, too close to bother
+			if (clip.w < 1e-4f || clip.z < -clip.w) {
+				return true;
+			}
+			vec3 s = this->toScreen(clip);
+			lo = glm::min(lo, vec2(s.x, s.y));
+			hi = glm::max(hi, vec2(s.x, s.y));
+			z = std::min(z, s.z);
+		}
+
+		int x0 = std::max((int)std::floor(lo.x), 0), y0 = std::max((int)std::floor(lo.y), 0);
+		int x1 = std::min((int)std::ceil(hi.x), this->width - 1), y1 = std::min((int)std::ceil(hi.y), this->height - 1);
+		if (x0 > x1 || y0 > y1) {
+			return true;
+		}
+
+		for (int ty = y0 / OCCLUSION_TILE; ty <= y1 / OCCLUSION_TILE; ty++) {
+			for (int tx = x0 / OCCLUSION_TILE; tx <= x1 / OCCLUSION_TILE; tx++) {
+				if (this->tile_max[ty * this->tilesX() + tx] < z) {
+					continue;
+				}
+				// tile isn't fully in front, look at the pixels the box actually covers
+				int px0 = std::max(x0, tx * OCCLUSION_TILE), px1 = std::min(x1, (tx + 1) * OCCLUSION_TILE - 1);
+				int py0 = std::max(y0, ty * OCCLUSION_TILE), py1 = std::min(y1, (ty + 1) * OCCLUSION_TILE - 1);
+				for (int y = py0; y <= py1; y++) {
+					for (int x = px0; x <= px1; x++) {
+						if (this->depth[y * this->width + x] >= z) {
+							return true;
+						}
+					}
+				}
+			}
+		}
+		return false;
+	}
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+/* Hand-off between the sim and render threads: a lock-free triple buffer of frames and the input queue feeding the sim */
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <types.hpp>
+#include <replay.hpp>
+
+// TripleBuffer.shared: the middle slot's index in the low bits, plus flags
+#define TRIPLE_BUFFER_INDEX 0x3u
+// published since the reader last took one
+#define TRIPLE_BUFFER_FRESH 0x4u
+// either side has stopped
+#define TRIPLE_BUFFER_CLOSED 0x8u
+
+// the writer fills back(), publish() swaps it with the middle slot, read() swaps the middle one with
+// the reader's. neither side ever touches a slot the other one holds, so there are no locks and no copies.
+// waitConsumed() and read() block on the shared word, that's what keeps the writer a frame ahead and no more
+template <typename T>
+struct TripleBuffer {
+	std::array<T, 3> slots;
+	std::atomic<uint32_t> shared;
+	// writer only
+	uint back;
+	// reader only
+	uint front;
+
+	// not movable, so it's set up in place
+	void init() {
+		this->back = 0;
+		this->shared.store(1);
+		this->front = 2;
+	}
+
+	T& write() {
+		return this->slots[this->back];
+	}
+
+	void publish() {
+		uint32_t s = this->shared.load(std::memory_order_relaxed);
+		while (!this->shared.compare_exchange_weak(s, this->back | TRIPLE_BUFFER_FRESH | (s & TRIPLE_BUFFER_CLOSED), std::memory_order_acq_rel)) {}
+		// an unread frame in the middle gets overwritten next time, waitConsumed() first if that matters
+		this->back = s & TRIPLE_BUFFER_INDEX;
+		this->shared.notify_all();
+	}
+
+	// until the reader has taken the last published frame. false once closed
+	bool waitConsumed() {
+		uint32_t s = this->shared.load(std::memory_order_acquire);
+		while ((s & TRIPLE_BUFFER_FRESH) && !(s & TRIPLE_BUFFER_CLOSED)) {
+			this->shared.wait(s, std::memory_order_acquire);
+			s = this->shared.load(std::memory_order_acquire);
+		}
+		return !(s & TRIPLE_BUFFER_CLOSED);
+	}
+
+	// the newest published frame, blocking until there is one. the reader owns it until the next read().
+	// nullptr once closed and everything published has been read
+	T* read() {
+		uint32_t s = this->shared.load(std::memory_order_acquire);
+		for (;;) {
+			if (s & TRIPLE_BUFFER_FRESH) {
+				if (this->shared.compare_exchange_weak(s, this->front | (s & TRIPLE_BUFFER_CLOSED), std::memory_order_acq_rel)) {
+					break;
+				}
+				continue;
+			}
+			if (s & TRIPLE_BUFFER_CLOSED) {
+				return nullptr;
+			}
+			this->shared.wait(s, std::memory_order_acquire);
+			s = this->shared.load(std::memory_order_acquire);
+		}
+		this->front = s & TRIPLE_BUFFER_INDEX;
+		this->shared.notify_all();
+		return &this->slots[this->front];
+	}
+
+	// wakes up both sides for good
+	void close() {
+		this->shared.fetch_or(TRIPLE_BUFFER_CLOSED, std::memory_order_acq_rel);
+		this->shared.notify_all();
+	}
+};
+
+// filled by the GLFW callbacks on the main thread, drained by the sim once per tick
+struct InputQueue {
+	std::mutex mutex;
+	std::vector<InputEvent> events;
+	// the latest window size, if it changed since the last drain()
+	ivec2 size;
+	bool resized;
+	// the newest cursor position pushed, drained or not
+	double cursor_x;
+	double cursor_y;
+	bool has_cursor;
+
+	void push(const InputEvent& event) {
+		std::lock_guard lock(this->mutex);
+		this->events.push_back(event);
+		if (event.type == INPUT_CURSOR_POS) {
+			this->cursor_x = event.x;
+			this->cursor_y = event.y;
+			this->has_cursor = true;
+		}
+	}
+
+	// false until the cursor has moved at all
+	bool latestCursor(double& x, double& y) {
+		std::lock_guard lock(this->mutex);
+		x = this->cursor_x;
+		y = this->cursor_y;
+		return this->has_cursor;
+	}
+
+	void resize(ivec2 size) {
+		std::lock_guard lock(this->mutex);
+		this->size = size;
+		this->resized = true;
+	}
+
+	// swaps everything queued so far into `out`, which keeps the capacity the queue had.
+	// true if the window was resized, with the new size in `size`
+	bool drain(std::vector<InputEvent>& out, ivec2& size) {
+		out.clear();
+		std::lock_guard lock(this->mutex);
+		std::swap(out, this->events);
+		const bool resized = this->resized;
+		size = this->size;
+		this->resized = false;
+		return resized;
+	}
+};
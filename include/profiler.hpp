@@ -0,0 +1,269 @@
+#pragma once
+
+/* Scoped CPU/GPU profiling zones, exported as a Chrome trace (loads in chrome://tracing and Perfetto) */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include <types.hpp>
+
+// events each thread can hold before dropping, 24 bytes each
+#define PROFILER_EVENTS_PER_THREAD (1 << 18)
+#define PROFILER_MAX_THREADS 64
+// GPU zones are read back this many frames later, by then they're done and reading never stalls
+#define PROFILER_GPU_FRAMES 2
+
+// build with -DPROFILER_DISABLE to compile every zone out
+#ifndef PROFILER_DISABLE
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+// name has to outlive the export, a string literal is best
+#define PROFILE_ZONE(name) ProfileScope PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+// same but also times the GL commands issued inside it. GL_TIME_ELAPSED queries can't nest,
+// so neither can these
+#define PROFILE_GPU_ZONE(name) \
+	ProfileScope PROFILE_CONCAT(profile_zone_, __LINE__)(name); \
+	GpuProfileScope PROFILE_CONCAT(profile_gpu_zone_, __LINE__)(name)
+// once per frame on the GL thread, before any GPU zones
+#define PROFILE_FRAME() profiler.gpu.beginFrame()
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_GPU_ZONE(name)
+#define PROFILE_FRAME()
+#endif
+
+struct ProfileEvent {
+	const char *name;
+	// ns since the profiler started
+	int64_t begin;
+	int64_t end;
+};
+
+// written only by its own thread. `count` is published with release so an exporting thread
+// sees every event below it fully written
+struct ProfileThread {
+	std::unique_ptr<ProfileEvent[]> events;
+	std::atomic<usize> count;
+	usize dropped;
+	uint id;
+
+	void push(const ProfileEvent& event) {
+		usize n = this->count.load(std::memory_order_relaxed);
+		if (n == PROFILER_EVENTS_PER_THREAD) {
+			this->dropped++;
+			return;
+		}
+		this->events[n] = event;
+		this->count.store(n + 1, std::memory_order_release);
+	}
+};
+
+struct GpuProfileZone {
+	const char *name;
+	uint query;
+	// when it was submitted, the GPU track starts it no earlier than this
+	int64_t submitted;
+};
+
+// GL_TIME_ELAPSED per zone, one set of queries per frame in flight
+struct GpuProfiler {
+	std::array<std::vector<uint>, PROFILER_GPU_FRAMES> queries;
+	std::array<std::vector<GpuProfileZone>, PROFILER_GPU_FRAMES> zones;
+	// resolved zones, only touched from the GL thread
+	std::vector<ProfileEvent> events;
+	usize frame;
+	usize dropped;
+	// end of the last resolved zone, keeps the GPU track sequential
+	int64_t gpu_end;
+
+	void beginFrame();
+	void begin(const char *name);
+	void end();
+	void resolve(usize set, bool wait);
+	// waits for every zone still in flight, for the export at exit
+	void flush() {
+		for (usize i = 1; i <= PROFILER_GPU_FRAMES; i++) {
+			this->resolve((this->frame + i) % PROFILER_GPU_FRAMES, true);
+		}
+	}
+};
+
+struct Profiler {
+	std::atomic<bool> enabled;
+	chrono::steady_clock::time_point start;
+	std::array<std::atomic<ProfileThread*>, PROFILER_MAX_THREADS> threads;
+	std::atomic<uint> n_threads;
+	GpuProfiler gpu;
+
+	void enable() {
+		this->start = chrono::steady_clock::now();
+		this->enabled.store(true, std::memory_order_relaxed);
+	}
+
+	int64_t now() const {
+		return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - this->start).count();
+	}
+
+	// nullptr once PROFILER_MAX_THREADS threads have registered
+	ProfileThread* thread() {
+		thread_local ProfileThread *t = this->registerThread();
+		return t;
+	}
+
+	ProfileThread* registerThread() {
+		uint id = this->n_threads.fetch_add(1);
+		if (id >= PROFILER_MAX_THREADS) {
+			return nullptr;
+		}
+		// lives as long as the process, threads that exit leave their events behind for the export
+		ProfileThread *t = new ProfileThread();
+		t->events = std::make_unique_for_overwrite<ProfileEvent[]>(PROFILER_EVENTS_PER_THREAD);
+		t->id = id;
+		this->threads[id].store(t, std::memory_order_release);
+		return t;
+	}
+
+	bool writeChromeTrace(const std::string& path) {
+		std::ofstream file(path);
+		if (!file) {
+			std::cerr << "profiler(error): can't write " << path << std::endl;
+			return false;
+		}
+		usize n_events = 0, dropped = this->gpu.dropped;
+		// trace timestamps are in microseconds
+		auto event = [&](const ProfileEvent& e, uint tid) {
+			file << (n_events++ > 0 ? ",\n" : "\n")
+			     << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+			     << ",\"ts\":" << e.begin / 1000.0 << ",\"dur\":" << (e.end - e.begin) / 1000.0 << "}";
+		};
+		auto threadName = [&](uint tid, const std::string& name) {
+			file << (n_events++ > 0 ? ",\n" : "\n")
+			     << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+			     << ",\"args\":{\"name\":\"" << name << "\"}}";
+		};
+
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		const uint n_threads = std::min<uint>(this->n_threads.load(), PROFILER_MAX_THREADS);
+		for (uint i = 0; i < n_threads; i++) {
+			const ProfileThread *t = this->threads[i].load(std::memory_order_acquire);
+			if (t == nullptr) {
+				continue;
+			}
+			threadName(t->id, t->id == 0 ? "main" : "thread " + std::to_string(t->id));
+			const usize count = t->count.load(std::memory_order_acquire);
+			for (usize j = 0; j < count; j++) {
+				event(t->events[j], t->id);
+			}
+			dropped += t->dropped;
+		}
+		// GPU gets a track of its own past every thread id
+		threadName(PROFILER_MAX_THREADS, "gpu");
+		for (const auto& e : this->gpu.events) {
+			event(e, PROFILER_MAX_THREADS);
+		}
+		file << "\n]}" << std::endl;
+
+		std::cerr << "profiler(info): wrote " << n_events << " events to " << path;
+		if (dropped > 0) {
+			std::cerr << " (" << dropped << " dropped)";
+		}
+		std::cerr << std::endl;
+		return true;
+	}
+};
+
+inline Profiler profiler;
+
+struct ProfileScope {
+	const char *name;
+	int64_t begin;
+
+	explicit ProfileScope(const char *name) : name(name), begin(-1) {
+		if (profiler.enabled.load(std::memory_order_relaxed)) {
+			this->begin = profiler.now();
+		}
+	}
+
+	~ProfileScope() {
+		if (this->begin < 0) {
+			return;
+		}
+		// before thread(), a thread's first zone would count its registration otherwise
+		const int64_t end = profiler.now();
+		if (ProfileThread *t = profiler.thread()) {
+			t->push({ .name = this->name, .begin = this->begin, .end = end });
+		}
+	}
+};
+
+struct GpuProfileScope {
+	bool active;
+
+	explicit GpuProfileScope(const char *name) : active(profiler.enabled.load(std::memory_order_relaxed)) {
+		if (this->active) {
+			profiler.gpu.begin(name);
+		}
+	}
+
+	~GpuProfileScope() {
+		if (this->active) {
+			profiler.gpu.end();
+		}
+	}
+};
+
+inline void GpuProfiler::beginFrame() {
+	if (!profiler.enabled.load(std::memory_order_relaxed)) {
+		return;
+	}
+	this->frame++;
+	// whatever used this set PROFILER_GPU_FRAMES frames ago
+	this->resolve(this->frame % PROFILER_GPU_FRAMES, false);
+}
+
+inline void GpuProfiler::begin(const char *name) {
+	const usize set = this->frame % PROFILER_GPU_FRAMES;
+	auto& queries = this->queries[set];
+	auto& zones = this->zones[set];
+	if (zones.size() == queries.size()) {
+		uint query;
+		glCreateQueries(GL_TIME_ELAPSED, 1, &query);
+		queries.push_back(query);
+	}
+	const uint query = queries[zones.size()];
+	zones.push_back({ .name = name, .query = query, .submitted = profiler.now() });
+	glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+inline void GpuProfiler::end() {
+	glEndQuery(GL_TIME_ELAPSED);
+}
+
+inline void GpuProfiler::resolve(usize set, bool wait) {
+	for (const auto& zone : this->zones[set]) {
+		if (!wait) {
+			int available = 0;
+			glGetQueryObjectiv(zone.query, GL_QUERY_RESULT_AVAILABLE, &available);
+			// the GPU is more than PROFILER_GPU_FRAMES behind, drop it rather than stall
+			if (!available) {
+				this->dropped++;
+				continue;
+			}
+		}
+		uint64_t ns = 0;
+		glGetQueryObjectui64v(zone.query, GL_QUERY_RESULT, &ns);
+		int64_t begin = std::max(zone.submitted, this->gpu_end);
+		this->gpu_end = begin + ns;
+		this->events.push_back({ .name = zone.name, .begin = begin, .end = this->gpu_end });
+	}
+	this->zones[set].clear();
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+/* Per-frame list of mesh draws, culled before submission */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <types.hpp>
+#include <arena.hpp>
+#include <jobs.hpp>
+#include <cull.hpp>
+#include <occlusion.hpp>
+#include <model.hpp>
+
+// boxes per culling job, a multiple of 8 so no two jobs write the same byte of `visible`
+#define RENDER_QUEUE_CULL_GRAIN 256
+
+// laid out like UniformBuffer.model/model_it so it can be uploaded as is
+struct Transform {
+	mat4 model;
+	mat4 model_it;
+};
+
+struct DrawItem {
+	const Mesh* mesh;
+	// in RenderQueue.transforms
+	usize transform;
+	uint vao;
+	uint shader;
+};
+
+struct SortKey {
+	// pass in the high half, depth in the low half
+	uint64_t key;
+	uint item;
+};
+
+struct OccluderItem {
+	const Occluder* occluder;
+	usize transform;
+};
+
+struct RenderQueue {
+	std::vector<Transform> transforms;
+	std::vector<DrawItem> items;
+	std::vector<OccluderItem> occluders;
+	CullBoxes boxes;
+	// one bit per item, see isVisible()
+	std::vector<uchar> visible;
+	CullStats stats;
+	// visible items in submission order, filled by sort()
+	std::vector<uint> order;
+	// pass p is order[pass_begin[p], pass_begin[p + 1])
+	std::array<usize, ALPHA_BLEND + 2> pass_begin;
+
+	void clear() {
+		this->transforms.clear();
+		this->items.clear();
+		this->occluders.clear();
+		this->boxes.clear();
+		this->visible.clear();
+		this->order.clear();
+		this->pass_begin = {};
+		this->stats = {};
+	}
+
+	// returns the transform's index for pushOccluder()
+	usize push(const Model& model, const mat4& transform) {
+		usize t = this->transforms.size();
+		this->transforms.push_back({
+			.model = transform,
+			.model_it = glm::transpose(glm::inverse(transform)),
+		});
+		for (const auto& mesh : model.meshes) {
+			this->items.push_back({
+				.mesh = &mesh,
+				.transform = t,
+				.vao = model.vao,
+				.shader = mesh.shader,
+			});
+			this->boxes.push(mesh.bounds, transform);
+		}
+		return t;
+	}
+
+	void pushOccluder(const Occluder& occluder, usize transform) {
+		this->occluders.push_back({ .occluder = &occluder, .transform = transform });
+	}
+
+	// spread over the job system
+	void cull(const Frustum& frustum) {
+		const usize n = this->boxes.size();
+		this->visible.resize((n + 7) / 8);
+		job_system.parallelFor(n, RENDER_QUEUE_CULL_GRAIN, [&](usize first, usize last) {
+			cullBoxRange(frustum, this->boxes, first, last, this->visible);
+		});
+		this->stats = cullStats(this->visible, n);
+	}
+
+	// after cull(): hides visible items whose bounding radius over their distance from `eye` is below
+	// min_size, before testOcclusion() spends any time on them
+	void cullSmall(vec3 eye, float min_size) {
+		std::atomic<usize> small = 0;
+		job_system.parallelFor(this->items.size(), RENDER_QUEUE_CULL_GRAIN, [&](usize first, usize last) {
+			usize n = 0;
+			for (usize i = first; i < last; i++) {
+				if (!this->isVisible(i)) {
+					continue;
+				}
+				const vec3 d = vec3(this->boxes.cx[i], this->boxes.cy[i], this->boxes.cz[i]) - eye;
+				const vec3 e = vec3(this->boxes.ex[i], this->boxes.ey[i], this->boxes.ez[i]);
+				// squared on both sides, no square roots
+				if (glm::dot(e, e) < min_size * min_size * glm::dot(d, d)) {
+					this->visible[i >> 3] &= ~(1 << (i & 7));
+					n++;
+				}
+			}
+			small.fetch_add(n, std::memory_order_relaxed);
+		});
+		this->stats.small += small.load(std::memory_order_relaxed);
+	}
+
+	// doesn't touch the items, so it can run alongside cull()
+	void rasterizeOccluders(OcclusionBuffer& buffer, const mat4& view_proj) const {
+		buffer.clear();
+		for (const auto& o : this->occluders) {
+			buffer.addOccluder(*o.occluder, view_proj * this->transforms[o.transform].model);
+		}
+		buffer.rasterize();
+	}
+
+	// run after cull() and rasterizeOccluders(), only looks at items that survived the frustum
+	void testOcclusion(const OcclusionBuffer& buffer, const mat4& view_proj) {
+		std::atomic<usize> occluded = 0;
+		job_system.parallelFor(this->items.size(), RENDER_QUEUE_CULL_GRAIN, [&](usize first, usize last) {
+			usize n = 0;
+			for (usize i = first; i < last; i++) {
+				if (!this->isVisible(i)) {
+					continue;
+				}
+				vec3 c = vec3(this->boxes.cx[i], this->boxes.cy[i], this->boxes.cz[i]);
+				vec3 e = vec3(this->boxes.ex[i], this->boxes.ey[i], this->boxes.ez[i]);
+				if (!buffer.testBox({ .min = c - e, .max = c + e }, view_proj)) {
+					this->visible[i >> 3] &= ~(1 << (i & 7));
+					n++;
+				}
+			}
+			occluded.fetch_add(n, std::memory_order_relaxed);
+		});
+		this->stats.occluded += occluded.load(std::memory_order_relaxed);
+	}
+
+	void cullOcclusion(OcclusionBuffer& buffer, const mat4& view_proj) {
+		this->rasterizeOccluders(buffer, view_proj);
+		this->testOcclusion(buffer, view_proj);
+	}
+
+	// groups visible items by pass: opaque and alpha tested front to back so early-Z rejects as much as
+	// it can, blended back to front so they composite correctly
+	void sort(const mat4& view) {
+		// only needed until order is filled in
+		SortKey *keys = frame_arena.alloc<SortKey>(this->items.size());
+		usize n_keys = 0;
+		for (usize i = 0; i < this->items.size(); i++) {
+			if (!this->isVisible(i)) {
+				continue;
+			}
+			const AlphaMode pass = this->items[i].mesh->alpha_mode;
+			// view looks down -z
+			const vec4 row = vec4(view[0][2], view[1][2], view[2][2], view[3][2]);
+			float depth = -(row.x*this->boxes.cx[i] + row.y*this->boxes.cy[i] + row.z*this->boxes.cz[i] + row.w);
+			// bits of a non negative float sort like the float itself
+			uint32_t bits = std::bit_cast<uint32_t>(std::max(depth, 0.0f));
+			if (pass == ALPHA_BLEND) {
+				bits = ~bits;
+			}
+			keys[n_keys++] = { .key = (uint64_t)pass << 32 | bits, .item = (uint)i };
+		}
+		std::sort(keys, keys + n_keys, [](const SortKey& a, const SortKey& b) { return a.key < b.key; });
+
+		this->order.resize(n_keys);
+		this->pass_begin = {};
+		for (usize k = 0; k < n_keys; k++) {
+			this->order[k] = keys[k].item;
+			this->pass_begin[(keys[k].key >> 32) + 1]++;
+		}
+		for (usize p = 1; p < this->pass_begin.size(); p++) {
+			this->pass_begin[p] += this->pass_begin[p - 1];
+		}
+	}
+
+	bool isVisible(usize i) const {
+		return ::isVisible(this->visible, i);
+	}
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+/* Recorded input and frame times, so a session can be played back frame for frame */
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <types.hpp>
+
+// "IREC" read as a little endian uint
+#define INPUT_RECORDING_MAGIC 0x43455249
+#define INPUT_RECORDING_VERSION 1
+
+enum InputEventType : uint8_t {
+	INPUT_KEY,
+	INPUT_MOUSE_BUTTON,
+	INPUT_CURSOR_POS,
+};
+
+struct InputEvent {
+	InputEventType type;
+	// INPUT_KEY and INPUT_MOUSE_BUTTON
+	int code;
+	int action;
+	// INPUT_CURSOR_POS
+	double x;
+	double y;
+	// seconds since the recording started, informational only. replay goes by frame
+	float t;
+};
+
+struct FrameInput {
+	// microseconds, like State.dt
+	float dt;
+	// everything glfwPollEvents() delivered that frame, in order
+	std::vector<InputEvent> events;
+};
+
+// File layout, little endian:
+//   u32 magic, u32 version, u32 n_frames, f64 cursor_x, f64 cursor_y
+//   per frame: f32 dt, u32 n_events, then per event u8 type, f32 t and either
+//     i16 code, u8 action (key, mouse button) or f64 x, f64 y (cursor)
+struct InputRecording {
+	// glfwGetCursorPos() at the start, the first cursor event is relative to it
+	double cursor_x;
+	double cursor_y;
+	std::vector<FrameInput> frames;
+	chrono::steady_clock::time_point start;
+
+	static InputRecording init(double cursor_x, double cursor_y) {
+		InputRecording recording = {};
+		recording.cursor_x = cursor_x;
+		recording.cursor_y = cursor_y;
+		recording.start = chrono::steady_clock::now();
+		return recording;
+	}
+
+	void beginFrame(float dt) {
+		this->frames.push_back({ .dt = dt, .events = {} });
+	}
+
+	void push(InputEvent event) {
+		if (this->frames.empty()) {
+			this->beginFrame(0.0f);
+		}
+		event.t = chrono::duration<float>(chrono::steady_clock::now() - this->start).count();
+		this->frames.back().events.push_back(event);
+	}
+
+	// what replay steps by unless told otherwise, keeps the session's total sim time
+	float meanDt() const {
+		double sum = 0.0;
+		for (const auto& frame : this->frames) {
+			sum += frame.dt;
+		}
+		return this->frames.empty() ? 0.0f : sum / this->frames.size();
+	}
+
+	template <typename T>
+	static void write(std::ofstream& file, const T& value) {
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	static T read(std::ifstream& file) {
+		T value = {};
+		file.read(reinterpret_cast<char*>(&value), sizeof(T));
+		return value;
+	}
+
+	bool save(const std::string& path) const {
+		std::ofstream file(path, std::ios::binary);
+		if (!file) {
+			std::cerr << "replay(error): can't write " << path << std::endl;
+			return false;
+		}
+		write<uint32_t>(file, INPUT_RECORDING_MAGIC);
+		write<uint32_t>(file, INPUT_RECORDING_VERSION);
+		write<uint32_t>(file, this->frames.size());
+		write<double>(file, this->cursor_x);
+		write<double>(file, this->cursor_y);
+		for (const auto& frame : this->frames) {
+			write<float>(file, frame.dt);
+			write<uint32_t>(file, frame.events.size());
+			for (const auto& e : frame.events) {
+				write<uint8_t>(file, e.type);
+				write<float>(file, e.t);
+				if (e.type == INPUT_CURSOR_POS) {
+					write<double>(file, e.x);
+					write<double>(file, e.y);
+				} else {
+					write<int16_t>(file, e.code);
+					write<uint8_t>(file, e.action);
+				}
+			}
+		}
+		std::cerr << "replay(info): recorded " << this->frames.size() << " frames to " << path << std::endl;
+		return true;
+	}
+
+	static InputRecording load(const std::string& path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			std::cerr << "replay(error): can't read " << path << std::endl;
+			return {};
+		}
+		if (read<uint32_t>(file) != INPUT_RECORDING_MAGIC || read<uint32_t>(file) != INPUT_RECORDING_VERSION) {
+			std::cerr << "replay(error): " << path << " isn't a version " << INPUT_RECORDING_VERSION << " recording" << std::endl;
+			return {};
+		}
+		InputRecording recording = {};
+		recording.frames.resize(read<uint32_t>(file));
+		recording.cursor_x = read<double>(file);
+		recording.cursor_y = read<double>(file);
+		for (auto& frame : recording.frames) {
+			frame.dt = read<float>(file);
+			frame.events.resize(read<uint32_t>(file));
+			for (auto& e : frame.events) {
+				e.type = static_cast<InputEventType>(read<uint8_t>(file));
+				e.t = read<float>(file);
+				if (e.type == INPUT_CURSOR_POS) {
+					e.x = read<double>(file);
+					e.y = read<double>(file);
+				} else {
+					e.code = read<int16_t>(file);
+					e.action = read<uint8_t>(file);
+				}
+			}
+		}
+		if (!file) {
+			std::cerr << "replay(error): " << path << " is truncated" << std::endl;
+			return {};
+		}
+		return recording;
+	}
+};
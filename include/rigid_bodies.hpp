@@ -0,0 +1,502 @@
+#pragma once
+
+/* Dynamic boxes in structure-of-arrays: vectorized integration, ground and box contacts, islands that sleep */
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <types.hpp>
+#include <allocations.hpp>
+#include <broadphase.hpp>
+#include <heightfield.hpp>
+#include <jobs.hpp>
+
+// bodies per parallelFor() chunk, a multiple of 8 so no SIMD batch is split between two
+#define BODIES_GRAIN 2048
+// contact passes per step, each one lets support travel one more body up a stack
+#define BODIES_CONTACT_PASSES 4
+// slower than this (units/s) counts as still
+#define BODIES_SLEEP_SPEED 0.05f
+// an island goes to sleep once all of it has been still for this many steps in a row
+#define BODIES_SLEEP_STEPS 30
+// running into a sleeping body faster than this wakes its island, anything slower treats it as static
+#define BODIES_WAKE_SPEED 0.5f
+// bounces slower than this stop dead instead
+#define BODIES_REST_SPEED 0.2f
+// grid boxes are grown by this on top of how far the body moves in a step, so a pair that comes into
+// contact during the next step is already known
+#define BODIES_MARGIN 0.02f
+// in `asleep_in` for bodies that are awake
+#define BODIES_AWAKE UINT32_MAX
+
+// boxes that don't rotate, all of the same mass. awake bodies are kept at the front of every array so a
+// step is one pass over [0, n_awake), bodies that went to sleep cost nothing until something hits them
+struct RigidBodies {
+	// by slot
+	std::vector<float> px, py, pz;
+	std::vector<float> vx, vy, vz;
+	// half extents
+	std::vector<float> hx, hy, hz;
+	// steps in a row below BODIES_SLEEP_SPEED
+	std::vector<uint16_t> still;
+	// slots move as bodies fall asleep and wake up, ids are what callers keep
+	std::vector<uint> id_of;
+	usize n_awake;
+
+	// by id
+	std::vector<uint> slot_of;
+	// index into `islands`, or BODIES_AWAKE
+	std::vector<uint> asleep_in;
+	// standing on the ground, or on something that is, as of the last step
+	std::vector<uchar> supported;
+	// union-find over the awake bodies touching each other this step
+	std::vector<uint> parent;
+	// per island root while putting islands to sleep
+	std::vector<uint16_t> least_still;
+	std::vector<uint> root_island;
+
+	// ids of the bodies in each sleeping island, empty ones are on `free_islands`
+	std::vector<std::vector<uint>> islands;
+	std::vector<uint> free_islands;
+	std::vector<uint> to_sleep;
+	// ids that went to sleep since the last writeTransforms(), their last steps haven't been written yet
+	std::vector<uint> unwritten;
+
+	// ids match the bodies' ids
+	SpatialHash hash;
+	std::vector<BodyPair> pairs;
+	// one per parallelFor() chunk of the grid's dynamic bodies, appended to `pairs` in order
+	std::vector<std::vector<BodyPair>> chunk_pairs;
+
+	vec3 gravity;
+	// bounce off the ground and off each other
+	float restitution;
+	// fraction of horizontal speed lost per second while supported
+	float friction;
+	// nothing falls below this, under and around the heightfield if there is one
+	float floor;
+
+	// since init()
+	usize steps;
+	usize contacts;
+	usize slept;
+	usize woken;
+	// of the last step
+	double integrate_ms;
+	double broadphase_ms;
+	double contact_ms;
+	double sleep_ms;
+
+	// `cell_size` a bit bigger than the boxes
+	static RigidBodies init(float cell_size, float floor) {
+		RigidBodies bodies = {};
+		bodies.hash = SpatialHash::init(cell_size);
+		bodies.gravity = vec3(0.0f, -9.81f, 0.0f);
+		bodies.restitution = 0.3f;
+		bodies.friction = 4.0f;
+		bodies.floor = floor;
+		return bodies;
+	}
+
+	usize size() const {
+		return this->id_of.size();
+	}
+
+	Box box(usize slot) const {
+		const vec3 p = vec3(this->px[slot], this->py[slot], this->pz[slot]);
+		const vec3 h = vec3(this->hx[slot], this->hy[slot], this->hz[slot]);
+		return { .min = p - h, .max = p + h };
+	}
+
+	// where it can get to by the end of the next step, what the grid holds
+	Box sweptBox(usize slot, float dt) const {
+		const vec3 v = vec3(this->vx[slot], this->vy[slot], this->vz[slot]) + this->gravity * dt;
+		const vec3 reach = glm::abs(v) * dt + vec3(BODIES_MARGIN);
+		const Box b = this->box(slot);
+		return { .min = b.min - reach, .max = b.max + reach };
+	}
+
+	vec3 position(uint id) const {
+		const uint slot = this->slot_of[id];
+		return vec3(this->px[slot], this->py[slot], this->pz[slot]);
+	}
+
+	bool awake(uint id) const {
+		return this->asleep_in[id] == BODIES_AWAKE;
+	}
+
+	// awake, returns its id
+	uint add(vec3 pos, vec3 half_extent, vec3 velocity = vec3(0.0f)) {
+		const uint id = this->id_of.size();
+		this->px.push_back(pos.x);
+		this->py.push_back(pos.y);
+		this->pz.push_back(pos.z);
+		this->vx.push_back(velocity.x);
+		this->vy.push_back(velocity.y);
+		this->vz.push_back(velocity.z);
+		this->hx.push_back(half_extent.x);
+		this->hy.push_back(half_extent.y);
+		this->hz.push_back(half_extent.z);
+		this->still.push_back(0);
+		this->id_of.push_back(id);
+		this->slot_of.push_back(id);
+		this->asleep_in.push_back(BODIES_AWAKE);
+		this->supported.push_back(false);
+		this->parent.push_back(id);
+		this->least_still.push_back(0);
+		this->root_island.push_back(UINT32_MAX);
+		this->swapSlots(id, this->n_awake);
+		this->n_awake++;
+		const uint hash_id = this->hash.insert(this->sweptBox(this->slot_of[id], 1.0f / 30.0f), true);
+		assert(hash_id == id && "RigidBodies has to own its hash");
+		(void)hash_id;
+		return id;
+	}
+
+	void swapSlots(usize a, usize b) {
+		if (a == b) {
+			return;
+		}
+		for (auto* v : { &this->px, &this->py, &this->pz, &this->vx, &this->vy, &this->vz, &this->hx, &this->hy, &this->hz }) {
+			std::swap((*v)[a], (*v)[b]);
+		}
+		std::swap(this->still[a], this->still[b]);
+		std::swap(this->id_of[a], this->id_of[b]);
+		this->slot_of[this->id_of[a]] = a;
+		this->slot_of[this->id_of[b]] = b;
+	}
+
+	// the whole island it's in, a pile only moves as a whole
+	void wake(uint id) {
+		const uint island = this->asleep_in[id];
+		if (island == BODIES_AWAKE) {
+			return;
+		}
+		for (uint member : this->islands[island]) {
+			this->swapSlots(this->slot_of[member], this->n_awake);
+			this->still[this->n_awake] = 0;
+			this->n_awake++;
+			this->asleep_in[member] = BODIES_AWAKE;
+			this->supported[member] = false;
+			this->parent[member] = member;
+			this->hash.setDynamic(member, true);
+		}
+		this->islands[island].clear();
+		this->free_islands.push_back(island);
+		this->woken++;
+	}
+
+	// slots [first, last): velocity from gravity, then position from velocity
+	void integrate(usize first, usize last, float dt) {
+		const vec3 dv = this->gravity * dt;
+		usize i = first;
+#if defined(__AVX__)
+		const __m256 dt8 = _mm256_set1_ps(dt);
+		const __m256 dvx = _mm256_set1_ps(dv.x), dvy = _mm256_set1_ps(dv.y), dvz = _mm256_set1_ps(dv.z);
+		for (; i + 8 <= last; i += 8) {
+			const __m256 vx = _mm256_add_ps(_mm256_loadu_ps(&this->vx[i]), dvx);
+			const __m256 vy = _mm256_add_ps(_mm256_loadu_ps(&this->vy[i]), dvy);
+			const __m256 vz = _mm256_add_ps(_mm256_loadu_ps(&this->vz[i]), dvz);
+			_mm256_storeu_ps(&this->vx[i], vx);
+			_mm256_storeu_ps(&this->vy[i], vy);
+			_mm256_storeu_ps(&this->vz[i], vz);
+			_mm256_storeu_ps(&this->px[i], _mm256_add_ps(_mm256_loadu_ps(&this->px[i]), _mm256_mul_ps(vx, dt8)));
+			_mm256_storeu_ps(&this->py[i], _mm256_add_ps(_mm256_loadu_ps(&this->py[i]), _mm256_mul_ps(vy, dt8)));
+			_mm256_storeu_ps(&this->pz[i], _mm256_add_ps(_mm256_loadu_ps(&this->pz[i]), _mm256_mul_ps(vz, dt8)));
+		}
+#elif defined(__SSE2__)
+		const __m128 dt4 = _mm_set1_ps(dt);
+		const __m128 dvx = _mm_set1_ps(dv.x), dvy = _mm_set1_ps(dv.y), dvz = _mm_set1_ps(dv.z);
+		for (; i + 4 <= last; i += 4) {
+			const __m128 vx = _mm_add_ps(_mm_loadu_ps(&this->vx[i]), dvx);
+			const __m128 vy = _mm_add_ps(_mm_loadu_ps(&this->vy[i]), dvy);
+			const __m128 vz = _mm_add_ps(_mm_loadu_ps(&this->vz[i]), dvz);
+			_mm_storeu_ps(&this->vx[i], vx);
+			_mm_storeu_ps(&this->vy[i], vy);
+			_mm_storeu_ps(&this->vz[i], vz);
+			_mm_storeu_ps(&this->px[i], _mm_add_ps(_mm_loadu_ps(&this->px[i]), _mm_mul_ps(vx, dt4)));
+			_mm_storeu_ps(&this->py[i], _mm_add_ps(_mm_loadu_ps(&this->py[i]), _mm_mul_ps(vy, dt4)));
+			_mm_storeu_ps(&this->pz[i], _mm_add_ps(_mm_loadu_ps(&this->pz[i]), _mm_mul_ps(vz, dt4)));
+		}
+#endif
+		for (; i < last; i++) {
+			this->vx[i] += dv.x;
+			this->vy[i] += dv.y;
+			this->vz[i] += dv.z;
+			this->px[i] += this->vx[i] * dt;
+			this->py[i] += this->vy[i] * dt;
+			this->pz[i] += this->vz[i] * dt;
+		}
+	}
+
+	// slots [first, last): out of the ground, bouncing if they hit it hard enough. also resets what the
+	// contact passes build up
+	void collideGround(usize first, usize last, const Heightfield* terrain) {
+		for (usize i = first; i < last; i++) {
+			const uint id = this->id_of[i];
+			this->parent[id] = id;
+			float ground = this->floor;
+			if (terrain != nullptr) {
+				ground = std::max(ground, terrain->height(this->px[i], this->pz[i]));
+			}
+			const float bottom = this->py[i] - this->hy[i];
+			this->supported[id] = bottom <= ground;
+			if (bottom > ground) {
+				continue;
+			}
+			this->py[i] += ground - bottom;
+			if (this->vy[i] < -BODIES_REST_SPEED) {
+				this->vy[i] *= -this->restitution;
+			} else if (this->vy[i] < 0.0f) {
+				this->vy[i] = 0.0f;
+			}
+		}
+	}
+
+	float& p(int axis, usize slot) {
+		return (axis == 0 ? this->px : axis == 1 ? this->py : this->pz)[slot];
+	}
+
+	float& v(int axis, usize slot) {
+		return (axis == 0 ? this->vx : axis == 1 ? this->vy : this->vz)[slot];
+	}
+
+	float h(int axis, usize slot) const {
+		return (axis == 0 ? this->hx : axis == 1 ? this->hy : this->hz)[slot];
+	}
+
+	uint find(uint id) {
+		while (this->parent[id] != id) {
+			this->parent[id] = this->parent[this->parent[id]];
+			id = this->parent[id];
+		}
+		return id;
+	}
+
+	// `a` is awake. apart along the axis they overlap least on, then no longer moving into each other.
+	// a body resting on something that isn't going anywhere, the ground or a sleeping body, is as good
+	// as static to whatever's on top of it
+	void resolve(uint a, uint b) {
+		usize sa = this->slot_of[a], sb = this->slot_of[b];
+		int axis = 0;
+		float depth = std::numeric_limits<float>::max();
+		for (int k = 0; k < 3; k++) {
+			const float d = this->h(k, sa) + this->h(k, sb) - std::abs(this->p(k, sa) - this->p(k, sb));
+			if (d < 0.0f) {
+				return;
+			}
+			if (d < depth) {
+				depth = d;
+				axis = k;
+			}
+		}
+		// the way `a` has to go to get out
+		const float dir = this->p(axis, sa) >= this->p(axis, sb) ? 1.0f : -1.0f;
+		const float closing = (this->v(axis, sb) - this->v(axis, sa)) * dir;
+		if (!this->awake(b) && closing > BODIES_WAKE_SPEED) {
+			this->wake(b);
+			sb = this->slot_of[b];
+		}
+		const bool a_on_b = axis == 1 && dir > 0.0f, b_on_a = axis == 1 && dir < 0.0f;
+		const bool b_fixed = !this->awake(b) || (a_on_b && this->supported[b]);
+		const bool a_fixed = !b_fixed && b_on_a && this->supported[a];
+		if (b_fixed) {
+			this->p(axis, sa) += dir * depth;
+			if (closing > 0.0f) {
+				this->v(axis, sa) = this->v(axis, sb);
+			}
+			this->supported[a] = this->supported[a] || a_on_b;
+		} else if (a_fixed) {
+			this->p(axis, sb) -= dir * depth;
+			if (closing > 0.0f) {
+				this->v(axis, sb) = this->v(axis, sa);
+			}
+			this->supported[b] = true;
+		} else {
+			this->p(axis, sa) += dir * depth * 0.5f;
+			this->p(axis, sb) -= dir * depth * 0.5f;
+			if (closing > 0.0f) {
+				const float mean = (this->v(axis, sa) + this->v(axis, sb)) * 0.5f;
+				this->v(axis, sa) = mean;
+				this->v(axis, sb) = mean;
+			}
+		}
+		if (this->awake(b)) {
+			this->parent[this->find(a)] = this->find(b);
+		}
+		this->contacts++;
+	}
+
+	// slots [first, last): friction for what's standing on something, then who's been still for how long
+	void settle(usize first, usize last, float dt) {
+		const float keep = std::max(1.0f - this->friction * dt, 0.0f);
+		for (usize i = first; i < last; i++) {
+			if (this->supported[this->id_of[i]]) {
+				this->vx[i] *= keep;
+				this->vz[i] *= keep;
+			}
+			const float speed2 = this->vx[i] * this->vx[i] + this->vy[i] * this->vy[i] + this->vz[i] * this->vz[i];
+			if (speed2 < BODIES_SLEEP_SPEED * BODIES_SLEEP_SPEED) {
+				this->still[i] = std::min<int>(this->still[i] + 1, UINT16_MAX);
+			} else {
+				this->still[i] = 0;
+			}
+		}
+	}
+
+	// islands whose every member has been still for BODIES_SLEEP_STEPS go to sleep together
+	void sleepIslands() {
+		for (usize i = 0; i < this->n_awake; i++) {
+			const uint id = this->id_of[i];
+			this->least_still[id] = UINT16_MAX;
+			this->root_island[id] = UINT32_MAX;
+		}
+		for (usize i = 0; i < this->n_awake; i++) {
+			const uint root = this->find(this->id_of[i]);
+			this->least_still[root] = std::min(this->least_still[root], this->still[i]);
+		}
+		this->to_sleep.clear();
+		for (usize i = 0; i < this->n_awake; i++) {
+			const uint id = this->id_of[i];
+			const uint root = this->find(id);
+			if (this->least_still[root] < BODIES_SLEEP_STEPS) {
+				continue;
+			}
+			if (this->root_island[root] == UINT32_MAX) {
+				if (this->free_islands.empty()) {
+					this->free_islands.push_back(this->islands.size());
+					this->islands.emplace_back();
+				}
+				this->root_island[root] = this->free_islands.back();
+				this->free_islands.pop_back();
+				this->slept++;
+			}
+			this->islands[this->root_island[root]].push_back(id);
+			this->to_sleep.push_back(id);
+		}
+		this->unwritten.insert(this->unwritten.end(), this->to_sleep.begin(), this->to_sleep.end());
+		for (uint id : this->to_sleep) {
+			const usize slot = this->slot_of[id];
+			this->vx[slot] = this->vy[slot] = this->vz[slot] = 0.0f;
+			this->asleep_in[id] = this->root_island[this->find(id)];
+			this->hash.setDynamic(id, false);
+			this->n_awake--;
+			this->swapSlots(slot, this->n_awake);
+		}
+	}
+
+	// the grid's pairs, gathered in parallel. same order as SpatialHash::pairs() whatever the thread count
+	void findPairs() {
+		// the lists only grow until the biggest pile has been seen once
+		ALLOC_ALLOW();
+		const usize n_dynamic = this->hash.dynamic.size();
+		const usize n_chunks = (n_dynamic + BODIES_GRAIN - 1) / BODIES_GRAIN;
+		if (this->chunk_pairs.size() < n_chunks) {
+			this->chunk_pairs.resize(n_chunks);
+		}
+		job_system.parallelFor(n_dynamic, BODIES_GRAIN, [this](usize first, usize last) {
+			ALLOC_ALLOW();
+			std::vector<BodyPair>& out = this->chunk_pairs[first / BODIES_GRAIN];
+			out.clear();
+			this->hash.pairs(first, last, out);
+		});
+		this->pairs.clear();
+		for (usize c = 0; c < n_chunks; c++) {
+			this->pairs.insert(this->pairs.end(), this->chunk_pairs[c].begin(), this->chunk_pairs[c].end());
+		}
+	}
+
+	// one fixed step. integration and ground contacts are spread over the job system, the grid and the
+	// body contacts are serial but only ever see awake bodies and whatever they touch. the grid is
+	// brought up to date at the end, once contacts have moved everything to where it'll start the next
+	// step from
+	void step(float dt, const Heightfield* terrain) {
+		auto now = [] { return chrono::steady_clock::now(); };
+		auto ms = [](auto start, auto end) { return chrono::duration<double, std::milli>(end - start).count(); };
+		this->steps++;
+
+		auto t0 = now();
+		this->findPairs();
+
+		auto t1 = now();
+		job_system.parallelFor(this->n_awake, BODIES_GRAIN, [this, dt, terrain](usize first, usize last) {
+			this->integrate(first, last, dt);
+			this->collideGround(first, last, terrain);
+		});
+
+		auto t2 = now();
+		for (int pass = 0; pass < BODIES_CONTACT_PASSES; pass++) {
+			for (auto [a, b] : this->pairs) {
+				this->resolve(a, b);
+			}
+		}
+		job_system.parallelFor(this->n_awake, BODIES_GRAIN, [this, dt](usize first, usize last) {
+			this->settle(first, last, dt);
+		});
+
+		auto t3 = now();
+		{
+			ALLOC_ALLOW();
+			this->sleepIslands();
+		}
+
+		auto t4 = now();
+		{
+			// cells come and go as bodies move, that's the grid's business
+			ALLOC_ALLOW();
+			for (usize i = 0; i < this->n_awake; i++) {
+				this->hash.update(this->id_of[i], this->sweptBox(i, dt));
+			}
+		}
+		auto t5 = now();
+
+		this->broadphase_ms = ms(t0, t1) + ms(t4, t5);
+		this->integrate_ms = ms(t1, t2);
+		this->contact_ms = ms(t2, t3);
+		this->sleep_ms = ms(t3, t4);
+	}
+
+	// `out[id]` = the body's box, times `local` which maps whatever stands in for it into [-1, 1]. only the
+	// awake ones and those that fell asleep since the last call, the rest haven't moved since they were last written
+	void writeTransforms(std::vector<mat4>& out, const mat4& local) {
+		if (out.size() != this->size()) {
+			out.resize(this->size());
+			for (usize i = this->n_awake; i < this->size(); i++) {
+				out[this->id_of[i]] = this->transform(i, local);
+			}
+		}
+		for (uint id : this->unwritten) {
+			out[id] = this->transform(this->slot_of[id], local);
+		}
+		this->unwritten.clear();
+		job_system.parallelFor(this->n_awake, BODIES_GRAIN, [this, &out, &local](usize first, usize last) {
+			for (usize i = first; i < last; i++) {
+				out[this->id_of[i]] = this->transform(i, local);
+			}
+		});
+	}
+
+	mat4 transform(usize slot, const mat4& local) const {
+		const mat4 placed = glm::translate(mat4(1.0f), vec3(this->px[slot], this->py[slot], this->pz[slot]));
+		return glm::scale(placed, vec3(this->hx[slot], this->hy[slot], this->hz[slot])) * local;
+	}
+
+	void print(std::ostream& out) const {
+		out << "bodies(info): " << this->n_awake << " of " << this->size() << " awake, " << this->islands.size() - this->free_islands.size()
+		    << " islands asleep, " << this->slept << " fell asleep and " << this->woken << " woke up over " << this->steps << " steps, "
+		    << this->contacts << " contacts" << std::endl;
+	}
+};
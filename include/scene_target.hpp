@@ -0,0 +1,187 @@
+#pragma once
+
+/* Offscreen color/depth target the 3D scene is rendered into at a fraction of the output resolution, then upscaled and sharpened */
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include <types.hpp>
+#include <gpu_resources.hpp>
+#include <gl_state.hpp>
+#include <shader_cache.hpp>
+#include <frame_times.hpp>
+
+// scaled below this the picture isn't worth looking at
+#define SCENE_TARGET_MIN_SCALE 0.25f
+
+// allocated at the largest size it's been asked for, a scale change only moves the viewport.
+// only a window bigger than anything before reallocates
+struct SceneTarget {
+	uint framebuffer;
+	uint color;
+	uint depth;
+	ivec2 max_size;
+	// the part of it in use this frame
+	ivec2 size;
+	// upscale.vert/frag, drawn from an empty vertex array
+	uint program;
+	uint vao;
+	float sharpness;
+
+	static SceneTarget init(ivec2 max_size, float sharpness) {
+		SceneTarget target = {};
+		target.allocate(max_size);
+		target.size = max_size;
+		target.sharpness = sharpness;
+		target.program = createShader("./shaders/upscale.vert", "./shaders/upscale.frag");
+		glProgramUniform1i(target.program, 0, 0);
+		glCreateVertexArrays(1, &target.vao);
+		return target;
+	}
+
+	void allocate(ivec2 max_size) {
+		this->max_size = max_size;
+		// a texture so the upscale can sample it
+		glCreateTextures(GL_TEXTURE_2D, 1, &this->color);
+		glTextureStorage2D(this->color, 1, GL_RGBA8, max_size.x, max_size.y);
+		glTextureParameteri(this->color, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(this->color, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(this->color, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(this->color, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		gpu_resources.texture(this->color, GL_RGBA8, max_size.x, max_size.y, 1, 1);
+		glCreateRenderbuffers(1, &this->depth);
+		glNamedRenderbufferStorage(this->depth, GL_DEPTH_COMPONENT24, max_size.x, max_size.y);
+		gpu_resources.renderbuffer(this->depth, GL_DEPTH_COMPONENT24, max_size.x, max_size.y);
+		glCreateFramebuffers(1, &this->framebuffer);
+		glNamedFramebufferTexture(this->framebuffer, GL_COLOR_ATTACHMENT0, this->color, 0);
+		glNamedFramebufferRenderbuffer(this->framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depth);
+		if (glCheckNamedFramebufferStatus(this->framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			std::cerr << "gl(error): scene target framebuffer is incomplete" << std::endl;
+		}
+	}
+
+	void release() {
+		glDeleteFramebuffers(1, &this->framebuffer);
+		gpu_resources.deleteTextures(1, &this->color);
+		gpu_resources.deleteRenderbuffers(1, &this->depth);
+	}
+
+	// `scale` of `output`. grows the target if output no longer fits, which is the only reallocation
+	void resize(float scale, ivec2 output) {
+		if (output.x > this->max_size.x || output.y > this->max_size.y) {
+			this->release();
+			this->allocate(glm::max(output, this->max_size));
+		}
+		scale = std::clamp(scale, SCENE_TARGET_MIN_SCALE, 1.0f);
+		const ivec2 scaled = ivec2(std::lround(output.x * scale), std::lround(output.y * scale));
+		this->size = glm::clamp(scaled, ivec2(1), this->max_size);
+	}
+
+	// draws after this go into the scaled target
+	void bind() const {
+		glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+		glViewport(0, 0, this->size.x, this->size.y);
+	}
+
+	// upscales what was drawn over all of `output` in `dst` and leaves that bound for whatever comes next
+	void resolve(GLState& gl, uint dst, ivec2 output) const {
+		glBindFramebuffer(GL_FRAMEBUFFER, dst);
+		glViewport(0, 0, output.x, output.y);
+
+		const bool old_depth_test = gl.depth_test_enabled;
+		const bool old_blend = gl.blend_enabled;
+		gl.depthTest(false);
+		gl.blend(false);
+		gl.useProgram(this->program);
+		gl.bindVertexArray(this->vao);
+		gl.bindTextureUnit(0, this->color);
+		glProgramUniform2f(this->program, 1, (float)this->size.x / this->max_size.x, (float)this->size.y / this->max_size.y);
+		gl.uniform1f(this->program, 2, this->sharpness);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		COUNTER_ADD(COUNTER_DRAW_CALLS, 1);
+		gl.depthTest(old_depth_test);
+		gl.blend(old_blend);
+	}
+
+	void deinit() {
+		this->release();
+		glDeleteVertexArrays(1, &this->vao);
+		glDeleteProgram(this->program);
+	}
+};
+
+// --scale-sweep: steps the render scale down over the run and writes frame time against scale
+struct ScaleSweep {
+	std::vector<float> scales;
+	usize frames_per_scale;
+	// the resolution each frame rendered at
+	std::vector<ivec2> frame_size;
+
+	// 1 down to SCENE_TARGET_MIN_SCALE, `n_frames` split evenly over them
+	static ScaleSweep init(usize n_frames) {
+		ScaleSweep sweep = {};
+		for (float s = 1.0f; s >= SCENE_TARGET_MIN_SCALE - 1e-3f; s -= 0.125f) {
+			sweep.scales.push_back(s);
+		}
+		sweep.frames_per_scale = std::max<usize>(n_frames / sweep.scales.size(), 1);
+		return sweep;
+	}
+
+	float scale(usize frame) const {
+		return this->scales[std::min(frame / this->frames_per_scale, this->scales.size() - 1)];
+	}
+
+	void record(ivec2 size) {
+		this->frame_size.push_back(size);
+	}
+
+	// medians per scale, after FrameTimes::finish(). the first quarter of each step is left out while
+	// things settle. JSON if the path ends in .json, CSV otherwise
+	bool write(const std::string& path, const FrameTimes& times) const {
+		std::ofstream file(path);
+		if (!file) {
+			std::cerr << "sweep(error): can't write " << path << std::endl;
+			return false;
+		}
+		const bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+		file << (json ? "[" : "scale,width,height,frames,cpu_ms,gpu_ms\n");
+		auto median = [](std::vector<float> v) {
+			std::erase_if(v, [](float t) { return t < 0.0f; });
+			if (v.empty()) {
+				return -1.0f;
+			}
+			std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+			return v[v.size() / 2];
+		};
+		usize n_rows = 0;
+		for (usize i = 0; i < this->scales.size(); i++) {
+			const usize first = i * this->frames_per_scale + this->frames_per_scale / 4;
+			const usize last = std::min({ (i + 1) * this->frames_per_scale, this->frame_size.size(), times.cpu_ms.size() });
+			if (first >= last) {
+				break;
+			}
+			const float cpu = median(std::vector<float>(times.cpu_ms.begin() + first, times.cpu_ms.begin() + last));
+			const float gpu = median(std::vector<float>(times.gpu_ms.begin() + first, times.gpu_ms.begin() + last));
+			const ivec2 size = this->frame_size[first];
+			if (json) {
+				file << (n_rows > 0 ? ",\n" : "\n") << "{\"scale\":" << this->scales[i] << ",\"width\":" << size.x << ",\"height\":" << size.y
+				     << ",\"frames\":" << last - first << ",\"cpu_ms\":" << cpu << ",\"gpu_ms\":" << gpu << "}";
+			} else {
+				file << this->scales[i] << "," << size.x << "," << size.y << "," << last - first << "," << cpu << "," << gpu << "\n";
+			}
+			n_rows++;
+		}
+		if (json) {
+			file << "\n]" << std::endl;
+		}
+		std::cerr << "sweep(info): wrote " << n_rows << " scales to " << path << std::endl;
+		return true;
+	}
+};
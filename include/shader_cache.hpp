@@ -0,0 +1,330 @@
+#pragma once
+
+/* On-disk program binaries keyed by a hash of the sources, defines and driver, with parallel compiles for the misses */
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include <types.hpp>
+#include <load_stats.hpp>
+#include <utils.hpp>
+
+// bump when the file layout changes
+#define SHADER_CACHE_VERSION 1
+#define SHADER_CACHE_MAGIC 0x52444853 // "SHDR"
+
+struct ShaderDesc {
+	const char *vert;
+	const char *frag;
+	// "#define NAME VALUE" lines, inserted after #version in both stages
+	std::string defines;
+	// tells permutations of the same files apart in the load stats
+	std::string name;
+};
+
+// in front of every <key>.bin
+struct ShaderCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	GLenum format;
+	uint32_t length;
+};
+
+// FNV-1a, 64 bit
+uint64_t fnv1a(const std::string& s, uint64_t hash = 0xcbf29ce484222325) {
+	for (uchar c : s) {
+		hash ^= c;
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+std::string withDefines(const std::string& src, const std::string& defines) {
+	if (defines.empty()) {
+		return src;
+	}
+	// #version has to stay the first line
+	usize eol = src.find('\n');
+	if (eol == std::string::npos) {
+		return src + "\n" + defines + "\n";
+	}
+	return src.substr(0, eol + 1) + defines + "\n" + src.substr(eol + 1);
+}
+
+// false (and the log on std::cerr) if it didn't compile
+bool checkShader(uint shader, const char *stage) {
+	int result = 0, err_msg_len = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+	if (result) {
+		return true;
+	}
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &err_msg_len);
+	std::string err_msg(err_msg_len, '\0');
+	glGetShaderInfoLog(shader, err_msg.size(), nullptr, err_msg.data());
+	std::cerr << "[" << stage << " shader compilation error]" << std::endl
+		  << err_msg
+		  << "---------------------------------" << std::endl;
+	return false;
+}
+
+bool checkProgram(uint program, bool quiet) {
+	int result = 0, err_msg_len = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &result);
+	if (result || quiet) {
+		return result;
+	}
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &err_msg_len);
+	std::string err_msg(err_msg_len, '\0');
+	glGetProgramInfoLog(program, err_msg.size(), nullptr, err_msg.data());
+	std::cerr << "[shader program linking error]" << std::endl
+		  << err_msg
+		  << "------------------------------" << std::endl;
+	return false;
+}
+
+// only touched from the GL thread
+struct ShaderCache {
+	// empty when disabled, or when the driver has no binary formats
+	std::string dir;
+	// vendor, renderer and version: a driver update changes every key
+	std::string driver;
+	bool parallel;
+	usize hits;
+	usize misses;
+	// binaries the driver refused, e.g. written by another GPU
+	usize rejected;
+	double ms;
+
+	static ShaderCache init(const std::string& dir) {
+		ShaderCache cache = {};
+		auto str = [](GLenum name) {
+			const GLubyte *s = glGetString(name);
+			return s ? std::string(reinterpret_cast<const char*>(s)) : std::string();
+		};
+		cache.driver = str(GL_VENDOR) + "\n" + str(GL_RENDERER) + "\n" + str(GL_VERSION);
+
+		int n_formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats);
+		if (!dir.empty() && n_formats == 0) {
+			std::cerr << "shader(warning): driver has no program binary formats, not caching" << std::endl;
+		} else if (!dir.empty()) {
+			std::error_code err;
+			std::filesystem::create_directories(dir, err);
+			if (err) {
+				std::cerr << "shader(warning): can't create " << dir << " (" << err.message() << "), not caching" << std::endl;
+			} else {
+				cache.dir = dir;
+			}
+		}
+
+		// the driver picks the thread count, compiles then run in the background until their status is queried
+		if (GLAD_GL_KHR_parallel_shader_compile) {
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+			cache.parallel = true;
+		} else if (GLAD_GL_ARB_parallel_shader_compile) {
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+			cache.parallel = true;
+		}
+		return cache;
+	}
+
+	uint64_t key(const std::string& vert_src, const std::string& frag_src, const std::string& defines) const {
+		uint64_t hash = fnv1a(this->driver);
+		// separators so moving text between the parts still changes the key
+		hash = fnv1a(vert_src + '\0', hash);
+		hash = fnv1a(frag_src + '\0', hash);
+		return fnv1a(defines, hash);
+	}
+
+	std::string path(uint64_t key) const {
+		std::ostringstream s;
+		s << this->dir << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+		return s.str();
+	}
+
+	// empty on a miss, readBinaryFile() counts the read under LOAD_FILE_READ
+	std::vector<uchar> read(uint64_t key) const {
+		if (this->dir.empty()) {
+			return {};
+		}
+		return readBinaryFile(this->path(key).c_str());
+	}
+
+	// `data` from read(), 0 on a miss. anything that doesn't load cleanly is deleted so it gets rewritten
+	uint load(uint64_t key, const std::vector<uchar>& data) {
+		if (data.empty()) {
+			return 0;
+		}
+		const std::string path = this->path(key);
+		ShaderCacheHeader header = {};
+		if (data.size() >= sizeof(header)) {
+			std::memcpy(&header, data.data(), sizeof(header));
+		}
+		if (header.magic != SHADER_CACHE_MAGIC || header.version != SHADER_CACHE_VERSION || header.key != key
+		    || header.length != data.size() - sizeof(header)) {
+			std::cerr << "shader(warning): " << path << " is stale or truncated, recompiling" << std::endl;
+			std::error_code err;
+			std::filesystem::remove(path, err);
+			this->rejected++;
+			return 0;
+		}
+		uint program = glCreateProgram();
+		glProgramBinary(program, header.format, data.data() + sizeof(header), header.length);
+		if (!checkProgram(program, true)) {
+			std::cerr << "shader(warning): driver rejected " << path << ", recompiling" << std::endl;
+			glDeleteProgram(program);
+			std::error_code err;
+			std::filesystem::remove(path, err);
+			this->rejected++;
+			return 0;
+		}
+		return program;
+	}
+
+	void store(uint64_t key, uint program) {
+		if (this->dir.empty()) {
+			return;
+		}
+		int length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length == 0) {
+			return;
+		}
+		ShaderCacheHeader header = {
+			.magic = SHADER_CACHE_MAGIC,
+			.version = SHADER_CACHE_VERSION,
+			.key = key,
+			.format = 0,
+			.length = 0,
+		};
+		std::vector<uchar> data(sizeof(header) + length);
+		glGetProgramBinary(program, length, &length, &header.format, data.data() + sizeof(header));
+		header.length = length;
+		std::memcpy(data.data(), &header, sizeof(header));
+
+		// written next to it and renamed, so a crash never leaves half a binary under the real name
+		const std::string path = this->path(key), tmp = path + ".tmp";
+		std::ofstream file(tmp, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(data.data()), sizeof(header) + length);
+		file.close();
+		std::error_code err;
+		if (file) {
+			std::filesystem::rename(tmp, path, err);
+		}
+		if (!file || err) {
+			std::cerr << "shader(warning): can't write " << path << std::endl;
+			std::filesystem::remove(tmp, err);
+		}
+	}
+
+	// every program in one go: cache hits first, then all the misses are submitted before any of
+	// them is checked, which is what lets a parallel compiler work on them at the same time.
+	// exits on compile errors like createShader() always has
+	std::vector<uint> build(const std::vector<ShaderDesc>& descs) {
+		auto start = chrono::steady_clock::now();
+		struct Pending {
+			usize i;
+			uint64_t key;
+			std::string asset;
+			uint vert;
+			uint frag;
+			usize bytes;
+		};
+		std::vector<uint> programs(descs.size(), 0);
+		std::vector<Pending> pending;
+
+		for (usize i = 0; i < descs.size(); i++) {
+			const ShaderDesc& d = descs[i];
+			std::string asset = std::string(d.vert) + " + " + d.frag;
+			if (!d.name.empty()) {
+				asset += " [" + d.name + "]";
+			}
+			LoadAsset load_asset(asset);
+			const std::string vert_src = withDefines(readFile(d.vert), d.defines);
+			const std::string frag_src = withDefines(readFile(d.frag), d.defines);
+			const uint64_t key = this->key(vert_src, frag_src, d.defines);
+			// outside the timer, the cache file read is already LOAD_FILE_READ's
+			const std::vector<uchar> binary = this->read(key);
+			LoadTimer timer(LOAD_SHADER);
+			if ((programs[i] = this->load(key, binary)) != 0) {
+				this->hits++;
+				continue;
+			}
+			this->misses++;
+
+			const char *vert_src_c = vert_src.data(), *frag_src_c = frag_src.data();
+			uint vert = glCreateShader(GL_VERTEX_SHADER);
+			glShaderSource(vert, 1, &vert_src_c, nullptr);
+			glCompileShader(vert);
+			uint frag = glCreateShader(GL_FRAGMENT_SHADER);
+			glShaderSource(frag, 1, &frag_src_c, nullptr);
+			glCompileShader(frag);
+
+			programs[i] = glCreateProgram();
+			glProgramParameteri(programs[i], GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+			glAttachShader(programs[i], vert);
+			glAttachShader(programs[i], frag);
+			glLinkProgram(programs[i]);
+			pending.push_back({
+				.i = i,
+				.key = key,
+				.asset = asset,
+				.vert = vert,
+				.frag = frag,
+				.bytes = vert_src.size() + frag_src.size(),
+			});
+		}
+
+		// the first status query blocks until that program is done, the rest have been compiling meanwhile
+		bool quit = false;
+		for (const Pending& p : pending) {
+			LoadAsset load_asset(p.asset);
+			LoadTimer timer(LOAD_SHADER);
+			const uint program = programs[p.i];
+			bool ok = checkShader(p.vert, "vertex");
+			ok = checkShader(p.frag, "fragment") && ok;
+			ok = ok && checkProgram(program, false);
+			if (ok) {
+				this->store(p.key, program);
+			}
+			quit = quit || !ok;
+			glDeleteShader(p.vert);
+			glDeleteShader(p.frag);
+			timer.stop(p.bytes);
+		}
+		if (quit) exit(1);
+
+		this->ms += chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+		return programs;
+	}
+
+	// a warm start is one where every program came out of the cache
+	void print(std::ostream& out) const {
+		out << std::fixed << std::setprecision(2)
+		    << "shader(info): " << this->hits + this->misses << " programs in " << this->ms << " ms, "
+		    << (this->misses == 0 ? "warm" : "cold") << " start (" << this->hits << " cached, " << this->misses << " compiled";
+		if (this->rejected > 0) {
+			out << ", " << this->rejected << " rejected";
+		}
+		out << ", " << (this->parallel ? "parallel" : "serial") << " compiles, cache "
+		    << (this->dir.empty() ? "off" : this->dir) << ")" << std::endl
+		    << std::defaultfloat;
+	}
+};
+
+inline ShaderCache shader_cache;
+
+uint createShader(const char *const vert_filename, const char *const frag_filename) {
+	return shader_cache.build({ { .vert = vert_filename, .frag = frag_filename, .defines = "" } })[0];
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+/* Shader permutations: one source pair specialized by feature defines, one program per combination actually used */
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include <types.hpp>
+#include <shader_cache.hpp>
+
+// boneMatrices[] in model.vert, explicit so every skinned variant agrees on it
+#define BONE_MATRICES_LOCATION 6
+
+enum ShaderFeature : uint {
+	SHADER_SKINNED = 1 << 0,
+	// samples the diffuse texture
+	SHADER_TEXTURED = 1 << 1,
+	SHADER_VERTEX_COLOR = 1 << 2,
+};
+
+struct ShaderVariant {
+	uint features;
+	// bone influences read per vertex when skinned: 1, 2 or MAX_BONE_INFLUENCE. 0 otherwise
+	int influences;
+
+	// what a mesh with this data needs and nothing more. `influences` is the most any of its vertices uses
+	static ShaderVariant init(bool skinned, int influences, bool textured, bool vertex_color) {
+		ShaderVariant v = {};
+		if (skinned) {
+			v.features |= SHADER_SKINNED;
+			// the shader unrolls 1, 2 or 4, a 3 rounds up
+			v.influences = influences <= 1 ? 1 : influences <= 2 ? 2 : MAX_BONE_INFLUENCE;
+		}
+		if (textured) {
+			v.features |= SHADER_TEXTURED;
+		}
+		if (vertex_color) {
+			v.features |= SHADER_VERTEX_COLOR;
+		}
+		return v;
+	}
+
+	uint key() const {
+		return this->features | (uint)this->influences << 8;
+	}
+
+	std::string defines() const {
+		std::string d;
+		if (this->features & SHADER_SKINNED) {
+			d += "#define SKINNED\n#define BONE_INFLUENCES " + std::to_string(this->influences) + "\n";
+		}
+		if (this->features & SHADER_TEXTURED) {
+			d += "#define TEXTURED\n";
+		}
+		if (this->features & SHADER_VERTEX_COLOR) {
+			d += "#define VERTEX_COLOR\n";
+		}
+		return d;
+	}
+
+	// e.g. "skinned2+textured", for logs
+	std::string name() const {
+		std::string n;
+		if (this->features & SHADER_SKINNED) {
+			n += "skinned" + std::to_string(this->influences);
+		}
+		if (this->features & SHADER_TEXTURED) {
+			n += n.empty() ? "textured" : "+textured";
+		}
+		if (this->features & SHADER_VERTEX_COLOR) {
+			n += n.empty() ? "vertex_color" : "+vertex_color";
+		}
+		return n.empty() ? "plain" : n;
+	}
+};
+
+// only touched from the GL thread
+struct ShaderVariants {
+	std::string vert;
+	std::string frag;
+	// ShaderVariant::key() -> program
+	std::map<uint, uint> programs;
+
+	static ShaderVariants init(const std::string& vert, const std::string& frag) {
+		return {
+			.vert = vert,
+			.frag = frag,
+			.programs = {},
+		};
+	}
+
+	// the ones that aren't built yet go through shader_cache in one batch, so misses compile in parallel
+	void build(const std::vector<ShaderVariant>& variants) {
+		std::vector<ShaderVariant> missing;
+		for (const ShaderVariant& v : variants) {
+			if (!this->programs.contains(v.key()) && std::none_of(missing.begin(), missing.end(), [&](const ShaderVariant& m) { return m.key() == v.key(); })) {
+				missing.push_back(v);
+			}
+		}
+		if (missing.empty()) {
+			return;
+		}
+		std::vector<ShaderDesc> descs;
+		for (const ShaderVariant& v : missing) {
+			descs.push_back({
+				.vert = this->vert.c_str(),
+				.frag = this->frag.c_str(),
+				.defines = v.defines(),
+				.name = v.name(),
+			});
+		}
+		std::vector<uint> built = shader_cache.build(descs);
+		for (usize i = 0; i < missing.size(); i++) {
+			this->programs[missing[i].key()] = built[i];
+		}
+	}
+
+	uint get(const ShaderVariant& variant) {
+		this->build({ variant });
+		return this->programs[variant.key()];
+	}
+
+	void print(std::ostream& out) const {
+		out << "shader(info): " << this->programs.size() << " variants of " << this->vert << " + " << this->frag << ":";
+		for (const auto& [key, program] : this->programs) {
+			out << " " << ShaderVariant{ .features = key & 0xff, .influences = (int)(key >> 8) }.name();
+		}
+		out << std::endl;
+	}
+
+	void deinit() {
+		for (const auto& [key, program] : this->programs) {
+			glDeleteProgram(program);
+		}
+		this->programs.clear();
+	}
+};
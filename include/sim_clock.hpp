@@ -0,0 +1,85 @@
+#pragma once
+
+/* Fixed-rate simulation clock: frame time goes into an accumulator that's drained in whole steps */
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#include <types.hpp>
+
+// steps one frame may run before the rest of its time is dropped
+#define SIM_CLOCK_MAX_STEPS 8
+
+struct SimClock {
+	// microseconds like State.dt, 0 steps once per frame with the frame's own dt
+	float step_us;
+	float accumulator_us;
+	usize max_steps;
+	// since init()
+	usize steps;
+	// frames that hit max_steps, and the time they threw away
+	usize capped;
+	double dropped_us;
+
+	static SimClock init(float hz, usize max_steps) {
+		return {
+			.step_us = hz > 0.0f ? 1e6f / hz : 0.0f,
+			.accumulator_us = 0.0f,
+			.max_steps = max_steps,
+			.steps = 0,
+			.capped = 0,
+			.dropped_us = 0.0,
+		};
+	}
+
+	bool fixed() const {
+		return this->step_us > 0.0f;
+	}
+
+	// adds a frame's time and returns how many steps to run for it, each of step(dt_us) long.
+	// past max_steps the remainder is dropped instead of carried over, otherwise a frame that's slow
+	// because it ran many steps makes the next one run even more
+	usize advance(float dt_us) {
+		if (!this->fixed()) {
+			this->accumulator_us = dt_us;
+			this->steps++;
+			return 1;
+		}
+		this->accumulator_us += dt_us;
+		usize n = this->accumulator_us / this->step_us;
+		if (n > this->max_steps) {
+			const float dropped = (n - this->max_steps) * this->step_us;
+			this->accumulator_us -= dropped;
+			this->dropped_us += dropped;
+			this->capped++;
+			n = this->max_steps;
+		}
+		this->accumulator_us -= n * this->step_us;
+		this->steps += n;
+		return n;
+	}
+
+	float step(float dt_us) const {
+		return this->fixed() ? this->step_us : dt_us;
+	}
+
+	// how far the frame is from the previous step towards the last one, to interpolate between them
+	float alpha() const {
+		return this->fixed() ? this->accumulator_us / this->step_us : 1.0f;
+	}
+
+	void print(std::ostream& out) const {
+		out << std::fixed << std::setprecision(2) << "sim(info): " << this->steps << " steps";
+		if (this->fixed()) {
+			out << " of " << this->step_us / 1000.0f << "ms";
+			if (this->capped > 0) {
+				out << ", " << this->capped << " frames over the " << this->max_steps << " step cap dropped "
+				    << this->dropped_us / 1000.0 << "ms";
+			}
+		} else {
+			out << ", one per frame";
+		}
+		out << std::endl << std::defaultfloat;
+	}
+};
@@ -2,10 +2,15 @@
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
 #define MAX_BONE_INFLUENCE 4
 #define MAX_BONE_MATRICES 128
 
-using glm::mat4, glm::vec2, glm::vec3, glm::vec4, glm::uvec2, glm::ivec2;
+using glm::mat4, glm::vec2, glm::vec3, glm::vec4, glm::uvec2, glm::ivec2, glm::ivec3;
 namespace chrono = std::chrono;
 
 typedef unsigned char uchar;
@@ -19,6 +24,72 @@ struct BoneInfo {
 	glm::mat4 offset;
 };
 
+struct Box {
+	vec3 min;
+	vec3 max;
+
+	// inverted so that the first expand() snaps to whatever it's given
+	static Box empty() {
+		return {
+			.min = vec3(std::numeric_limits<float>::max()),
+			.max = vec3(std::numeric_limits<float>::lowest()),
+		};
+	}
+
+	void expand(vec3 p) {
+		this->min = glm::min(this->min, p);
+		this->max = glm::max(this->max, p);
+	}
+
+	void expand(const Box& box) {
+		this->min = glm::min(this->min, box.min);
+		this->max = glm::max(this->max, box.max);
+	}
+
+	bool overlaps(const Box& box) const {
+		return this->max.x >= box.min.x && this->min.x <= box.max.x
+		    && this->max.y >= box.min.y && this->min.y <= box.max.y
+		    && this->max.z >= box.min.z && this->min.z <= box.max.z;
+	}
+
+	float surfaceArea() const {
+		vec3 d = glm::max(this->max - this->min, vec3(0.0f));
+		return 2.0f * (d.x*d.y + d.y*d.z + d.z*d.x);
+	}
+
+	Box translate(vec3 x) const {
+		Box box = *this;
+		box.min += x;
+		box.max += x;
+		return box;
+	}
+
+	// local box -> world box (Arvo), stays conservative under rotation
+	Box transform(const mat4& m) const {
+		vec3 c = vec3(m * vec4(this->center(), 1.0f));
+		vec3 e = this->extent();
+		vec3 world_e = vec3(
+			std::abs(m[0][0])*e.x + std::abs(m[1][0])*e.y + std::abs(m[2][0])*e.z,
+			std::abs(m[0][1])*e.x + std::abs(m[1][1])*e.y + std::abs(m[2][1])*e.z,
+			std::abs(m[0][2])*e.x + std::abs(m[1][2])*e.y + std::abs(m[2][2])*e.z
+		);
+		return { .min = c - world_e, .max = c + world_e };
+	}
+
+	vec3 center() const {
+		return 0.5f * (this->min + this->max);
+	}
+
+	vec3 extent() const {
+		return 0.5f * (this->max - this->min);
+	}
+};
+
+struct Sphere {
+	vec3 center;
+	float radius;
+};
+
 struct Vertex {
 	vec3 pos;
 	vec3 norm;
@@ -9,6 +9,7 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <assimp/matrix4x4.h>
 #include <assimp/quaternion.h>
@@ -17,10 +18,13 @@
 #include <assimp/color4.h>
 
 #include <types.hpp>
+#include <load_stats.hpp>
+#include <gpu_resources.hpp>
 
 void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 void GLAPIENTRY debugMessageCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam);
 std::string readFile(const char *const filepath);
+std::vector<uchar> readBinaryFile(const char *const filepath);
 
 GLFWwindow* init() {
 	glfwInit();
@@ -102,6 +106,17 @@ debugMessageCallback(
 	std::cerr << "gl(" << type_str << "): " << message << std::endl;
 }
 
+// stbi_load(), but with the file read and the decode timed separately
+uchar* loadImage(const char* filepath, int *width, int *height, int *n_channels, int desired_channels) {
+	std::vector<uchar> file = readBinaryFile(filepath);
+	LoadTimer timer(LOAD_IMAGE_DECODE);
+	uchar *data = stbi_load_from_memory(file.data(), file.size(), width, height, n_channels, desired_channels);
+	if (data) {
+		timer.stop((uint64_t)*width * *height * (desired_channels ? desired_channels : *n_channels));
+	}
+	return data;
+}
+
 uint texture2DFromFile(const char* filepath, int levels) {
 	stbi_set_flip_vertically_on_load(true); // opengl/glfw dum dum
 
@@ -109,8 +124,9 @@ uint texture2DFromFile(const char* filepath, int levels) {
 	glCreateTextures(GL_TEXTURE_2D, 1, &tex);
 
 	int width, height, n_channels;
-	uchar *data = stbi_load(filepath, &width, &height, &n_channels, 0);
+	uchar *data = loadImage(filepath, &width, &height, &n_channels, 0);
 	if (data) {
+		LoadTimer timer(LOAD_UPLOAD);
 		GLenum internalformat = GL_R8, format = GL_RED;
 		switch (n_channels) {
 		case 1:
@@ -134,87 +150,46 @@ uint texture2DFromFile(const char* filepath, int levels) {
 			break;
 		}
 		glTextureStorage2D(tex, levels, internalformat, width, height);
+		gpu_resources.texture(tex, internalformat, width, height, 1, levels);
 		glTextureSubImage2D(tex, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, data);
 		glGenerateTextureMipmap(tex);
+		timer.stop((uint64_t)width * height * n_channels);
 	} else {
 		std::cerr << "stbi(error): " << stbi_failure_reason() << " (" << filepath << ")" << std::endl;
+		// no storage, but it still has to be deleted
+		gpu_resources.texture(tex, 0, 0, 0, 0, 0);
 	}
 	stbi_image_free(data);
 
 	return tex;
 }
 
-uint createShader(const char *const vert_filename, const char *const frag_filename) {
-	const std::string vert_src = readFile(vert_filename), frag_src = readFile(frag_filename);
-	const char *vert_src_c = vert_src.data(), *frag_src_c = frag_src.data();
-
-	bool quit = false;
-	int result;
-	int err_msg_len = 0;
-	std::string err_msg;
-
-	uint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex_shader, 1, &vert_src_c, nullptr);
-	glCompileShader(vertex_shader);
-
-	glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &result);
-	glGetShaderiv(vertex_shader, GL_INFO_LOG_LENGTH, &err_msg_len);
-	if (!result){
-		quit = true;
-		err_msg.resize(err_msg_len);
-		glGetShaderInfoLog(vertex_shader, err_msg.size(), nullptr, err_msg.data());
-		std::cerr << "[vertex shader compilation error]" << std::endl
-			  << err_msg
-			  << "---------------------------------" << std::endl;
-	}
-
-	uint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment_shader, 1, &frag_src_c, nullptr);
-	glCompileShader(fragment_shader);
-
-	glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &result);
-	glGetShaderiv(fragment_shader, GL_INFO_LOG_LENGTH, &err_msg_len);
-	if (!result){
-		quit = true;
-		err_msg.resize(err_msg_len);
-		glGetShaderInfoLog(fragment_shader, err_msg.size(), nullptr, err_msg.data());
-		std::cerr << "[fragment shader compilation error]" << std::endl
-			  << err_msg
-			  << "-----------------------------------" << std::endl;
-	}
-
-	uint shader = glCreateProgram();
-	glAttachShader(shader, vertex_shader);
-	glAttachShader(shader, fragment_shader);
-	glLinkProgram(shader);
-
-	glGetProgramiv(shader, GL_LINK_STATUS, &result);
-	glGetProgramiv(shader, GL_INFO_LOG_LENGTH, &err_msg_len);
-	if (!result) {
-		quit = true;
-		err_msg.resize(err_msg_len);
-		glGetProgramInfoLog(shader, err_msg.size(), nullptr, err_msg.data());
-		std::cerr << "[shader program linking error]" << std::endl
-			  << err_msg
-			  << "------------------------------" << std::endl;
-	}
-
-	if (quit) exit(1);
-
-	glDeleteShader(vertex_shader);
-	glDeleteShader(fragment_shader);
-	return shader;
-}
-
 std::string readFile(const char *const filepath) {
 	std::cerr << "debug: reading file " << filepath << std::endl;
+	LoadTimer timer(LOAD_FILE_READ);
 	std::ifstream file;
 	file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 	file.open(filepath);
 	std::stringstream stream;
 	stream << file.rdbuf();
 	file.close();
-	return stream.str();
+	std::string src = stream.str();
+	timer.stop(src.size());
+	return src;
+}
+
+// empty if it can't be read, whoever decodes it reports the error
+std::vector<uchar> readBinaryFile(const char *const filepath) {
+	LoadTimer timer(LOAD_FILE_READ);
+	std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+	if (!file) {
+		return {};
+	}
+	std::vector<uchar> data(file.tellg());
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(data.data()), data.size());
+	timer.stop(data.size());
+	return data;
 }
 
 glm::mat4 glmFromAssimpMat4(const aiMatrix4x4& src) {
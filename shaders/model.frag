@@ -1,4 +1,5 @@
 #version 430
+// TEXTURED and VERTEX_COLOR are defined above this line, see ShaderVariant::defines()
 
 in VS_OUT {
 	vec3 FragPos;
@@ -26,12 +27,26 @@ layout(location = 1) uniform sampler2D specular_texture;
 layout(location = 2) uniform sampler2D normal_texture;
 layout(location = 3) uniform sampler2D height_texture;
 
+// per mesh, from its material. see Mesh::draw()
+layout(location = 4) uniform float alpha_cutoff;
+layout(location = 5) uniform float opacity;
+
 // TODO:
 //	Normal texture
 //	Specular texture
 //	Height texture (tf is a height texture, isn't it for tesselation?)
 void main() {
-	vec4 color = texture(diffuse_texture, vsOut.TexCoord);
+	vec4 color = vec4(1.0f);
+#ifdef TEXTURED
+	color *= texture(diffuse_texture, vsOut.TexCoord);
+#endif
+#ifdef VERTEX_COLOR
+	color *= vsOut.FragColor;
+#endif
+	color.a *= opacity;
+	if (color.a < alpha_cutoff) {
+		discard;
+	}
 	vec3 ambient = ambientStr * ambientClr.xyz;
 
 	vec3 norm = normalize(vsOut.Normal);
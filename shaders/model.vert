@@ -1,15 +1,15 @@
 #version 430
+// SKINNED, BONE_INFLUENCES, TEXTURED and VERTEX_COLOR are defined above this line, see ShaderVariant::defines()
 #define MAX_BONE_MATRICES 128
-#define MAX_BONE_INFLUENCE 4
 
-// TODO: take boneIDs and weights out of model.vert
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoord;
 layout(location = 3) in vec3 aTangent;
 layout(location = 4) in vec3 aBitangent;
-layout(location = 5) in int aBoneIDs[MAX_BONE_INFLUENCE];
-layout(location = 6) in float aWeights[MAX_BONE_INFLUENCE];
+// MAX_BONE_INFLUENCE wide, unused slots have weight 0
+layout(location = 5) in ivec4 aBoneIDs;
+layout(location = 6) in vec4 aWeights;
 layout(location = 7) in vec4 aColor;
 
 out VS_OUT {
@@ -31,15 +31,40 @@ layout(binding = 0) uniform UniformBuffer {
 	float ambientStr;
 };
 
+#ifdef SKINNED
+// BONE_MATRICES_LOCATION
+layout(location = 6) uniform mat4 boneMatrices[MAX_BONE_MATRICES];
+#endif
+
 void main() {
-	vec4 fragPos = model * vec4(aPos, 1.0f);
-	vec4 pos = projection * view * fragPos;
-	vec3 normal = aNormal;
-	vec2 texCoord = aTexCoord;
+#ifdef SKINNED
+	// only as many influences as the mesh's busiest vertex has
+	mat4 skin = aWeights[0] * boneMatrices[aBoneIDs[0]];
+#if BONE_INFLUENCES >= 2
+	skin += aWeights[1] * boneMatrices[aBoneIDs[1]];
+#endif
+#if BONE_INFLUENCES >= 4
+	skin += aWeights[2] * boneMatrices[aBoneIDs[2]];
+	skin += aWeights[3] * boneMatrices[aBoneIDs[3]];
+#endif
+	// TODO: calculate normal
+	vec4 localPos = skin * vec4(aPos, 1.0f);
+#else
+	vec4 localPos = vec4(aPos, 1.0f);
+#endif
 
-	gl_Position = pos;
+	vec4 fragPos = model * localPos;
+	gl_Position = projection * view * fragPos;
 	vsOut.FragPos = fragPos.xyz / fragPos.w;
-	vsOut.Normal = mat3(model_IT) * normal;
-	vsOut.TexCoord = texCoord;
+	vsOut.Normal = mat3(model_IT) * aNormal;
+#ifdef TEXTURED
+	vsOut.TexCoord = aTexCoord;
+#else
+	vsOut.TexCoord = vec2(0.0f);
+#endif
+#ifdef VERTEX_COLOR
 	vsOut.FragColor = aColor;
+#else
+	vsOut.FragColor = vec4(1.0f);
+#endif
 }
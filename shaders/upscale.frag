@@ -0,0 +1,38 @@
+#version 430
+
+// bilinear upscale of the scene target plus contrast adaptive sharpening: the sharper the
+// neighbourhood already is, the less it gets, so edges don't ring
+
+layout(location = 0) in vec2 aTexCoord;
+
+layout(location = 0) out vec4 FragColor;
+
+layout(location = 0) uniform sampler2D sceneTexture;
+// the used part of the texture, size / max_size
+layout(location = 1) uniform vec2 uvScale;
+// 0 for none, 1 for the most
+layout(location = 2) uniform float sharpness;
+
+void main() {
+	vec2 texel = 1.0f / vec2(textureSize(sceneTexture, 0));
+	// every fetch is clamped to texel centres of the used part, past it is whatever a bigger scale left
+	// there and bilinear filtering would blend it into the last row and column
+	vec2 lo = 0.5f * texel, hi = uvScale - 0.5f * texel;
+	vec2 uv = clamp(aTexCoord * uvScale, lo, hi);
+	vec3 c = texture(sceneTexture, uv).rgb;
+	if (sharpness <= 0.0f) {
+		FragColor = vec4(c, 1.0f);
+		return;
+	}
+	vec3 n = texture(sceneTexture, clamp(uv + vec2(0.0f, -texel.y), lo, hi)).rgb;
+	vec3 w = texture(sceneTexture, clamp(uv + vec2(-texel.x, 0.0f), lo, hi)).rgb;
+	vec3 e = texture(sceneTexture, clamp(uv + vec2(texel.x, 0.0f), lo, hi)).rgb;
+	vec3 s = texture(sceneTexture, clamp(uv + vec2(0.0f, texel.y), lo, hi)).rgb;
+
+	vec3 mn = min(c, min(min(n, w), min(e, s)));
+	vec3 mx = max(c, max(max(n, w), max(e, s)));
+	// how far the neighbourhood is from clipping, relative to its brightest
+	vec3 amp = sqrt(clamp(min(mn, 1.0f - mx) / max(mx, 1e-5f), 0.0f, 1.0f));
+	vec3 weight = -amp * mix(0.125f, 0.2f, sharpness);
+	FragColor = vec4(clamp((c + (n + w + e + s) * weight) / (1.0f + 4.0f * weight), 0.0f, 1.0f), 1.0f);
+}
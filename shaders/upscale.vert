@@ -0,0 +1,11 @@
+#version 430
+
+// one triangle over the whole screen, no vertex buffer
+
+layout(location = 0) out vec2 TexCoord;
+
+void main() {
+	vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	TexCoord = pos;
+	gl_Position = vec4(pos * 2.0f - 1.0f, 0.0f, 1.0f);
+}
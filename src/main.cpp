@@ -14,19 +14,65 @@
 #include <iostream>
 #include <vector>
 #include <array>
+#include <cstdio>
+#include <csignal>
+#include <cstring>
+#include <string>
 
 #include <utils.hpp>
+#include <backend.hpp>
+#include <replay.hpp>
+#include <frame_times.hpp>
+#include <profiler.hpp>
+#include <counters.hpp>
+#include <load_stats.hpp>
+#include <shader_cache.hpp>
+#include <shader_variants.hpp>
+#include <jobs.hpp>
+#include <pipeline.hpp>
+#include <sim_clock.hpp>
+#include <frame_pacing.hpp>
+#include <governor.hpp>
+#include <scene_target.hpp>
+#define ALLOCATIONS_IMPLEMENTATION
+#include <allocations.hpp>
+#include <arena.hpp>
 #include <model.hpp>
 #include <animation.hpp>
 #include <animator.hpp>
-
-mat4 getView(vec3 model_pos, vec3 front, vec3 up, bool cam_zero);
+#include <render_queue.hpp>
+#include <bvh.hpp>
+#include <broadphase.hpp>
+#include <mesh_bvh.hpp>
+#include <heightfield.hpp>
+#include <rigid_bodies.hpp>
+#include <gl_state.hpp>
+
+// pinned cam: this far behind the player, looking at a point this high above its feet
+#define CAMERA_BOOM 2.0f
+#define CAMERA_HEIGHT 1.3f
+// kept between the camera and level geometry, about the near plane
+#define CAMERA_CLEARANCE 0.1f
+// a grounded player follows the terrain down slopes up to this steep per step instead of taking off
+#define GROUND_SNAP 0.05f
+// --bodies: crates this big (half extent), in piles this many high
+#define CRATE_HALF 0.25f
+#define CRATE_LAYERS 4
+
+mat4 getView(vec3 model_pos, vec3 front, vec3 up, bool cam_zero, float boom);
+mat4 getModel(vec3 pos, vec3 scale, vec2 front);
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 void cursorPosCallback(GLFWwindow* window, double xpos, double ypos);
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void windowSizeCallback(GLFWwindow* window, int width, int height);
 
+struct State;
+void handleInput(State *state, const InputEvent& event);
+void handleKey(State *state, int key, int action);
+void handleMouseButton(State *state, int button, int action);
+void handleCursorPos(State *state, double xpos, double ypos);
+
 struct Mouse {
 	double last_xpos;
 	double last_ypos;
@@ -45,6 +91,37 @@ struct UniformBuffer {
 	vec4 light_clr;
 	vec4 ambient_clr;
 	float ambient_str;
+
+	void upload(uint ubo) const {
+		glNamedBufferSubData(ubo, 0, sizeof(UniformBuffer), this);
+		COUNTER_ADD(COUNTER_UBO_BYTES, sizeof(UniformBuffer));
+	}
+
+	void uploadModelViewProj(uint ubo) const {
+		glNamedBufferSubData(ubo, 0, 4*sizeof(mat4) + sizeof(vec4), this);
+		COUNTER_ADD(COUNTER_UBO_BYTES, 4*sizeof(mat4) + sizeof(vec4));
+	}
+
+	void uploadViewProj(uint ubo) const {
+		glNamedBufferSubData(ubo, offsetof(UniformBuffer, view), 2*sizeof(mat4) + sizeof(vec4), &this->view);
+		COUNTER_ADD(COUNTER_UBO_BYTES, 2*sizeof(mat4) + sizeof(vec4));
+	}
+
+	void updateModel(vec3 pos, vec3 scale, vec2 front) {
+		mat4 model = getModel(pos, scale, front);
+		this->model = model;
+		this->model_it = glm::transpose(glm::inverse(model));
+	}
+
+	void updateModel(const Transform& transform) {
+		this->model = transform.model;
+		this->model_it = transform.model_it;
+	}
+
+	void uploadModel(uint ubo) const {
+		glNamedBufferSubData(ubo, offsetof(UniformBuffer, model), 2*sizeof(mat4), &this->model);
+		COUNTER_ADD(COUNTER_UBO_BYTES, 2*sizeof(mat4));
+	}
 };
 
 struct View {
@@ -84,8 +161,10 @@ struct State {
 	float dt;
 	Keys keys;
 	PlayerState player_state;
+	// live input is appended here while recording
+	InputRecording *recording;
 
-	static State init(GLFWwindow *const window) {
+	static State init(const Backend& backend) {
 		State state = {};
 		state.player_state = IDLE;
 		state.faces = 4;
@@ -106,20 +185,26 @@ struct State {
 			.ambient_clr = vec4(1.0f),
 			.ambient_str = 0.5f,
 		};
-		glfwGetWindowSize(window, &state.scr_res.x, &state.scr_res.y);
-		glfwGetCursorPos(window, &state.mouse.last_xpos, &state.mouse.last_ypos);
-		state.updateViewProj(vec3(0.0f));
-		state.updateModel(vec3(0.0f), vec3(1.0f), vec2(0.0f));
+		state.scr_res = backend.size;
+		if (backend.window != nullptr) {
+			glfwGetCursorPos(backend.window, &state.mouse.last_xpos, &state.mouse.last_ypos);
+		}
+		state.updateViewProj(vec3(0.0f), CAMERA_BOOM);
+		state.ub.updateModel(vec3(0.0f), vec3(1.0f), vec2(0.0f));
 		return state;
 	}
 
-	void uploadUB(uint ubo) const {
-		glNamedBufferSubData(ubo, 0, sizeof(UniformBuffer), &this->ub);
+	// everything the GLFW callbacks queued comes through here, on the sim thread
+	void input(const InputEvent& event) {
+		if (this->recording != nullptr) {
+			this->recording->push(event);
+		}
+		handleInput(this, event);
 	}
 
-	void updateViewProj(vec3 pos) {
+	void updateViewProj(vec3 pos, float boom) {
 		// pinned cam
-		this->ub.view = getView(pos, this->view.front, this->view.up, false);
+		this->ub.view = getView(pos, this->view.front, this->view.up, false, boom);
 		// free cam
 		// this->ub.view = glm::lookAt(this->view.pos, this->view.pos + this->view.front, this->view.up);
 
@@ -128,34 +213,30 @@ struct State {
 		this->ub.view_pos = vec4(this->view.pos, 0.0f);
 	}
 
-	void uploadModelViewProj(uint ubo) {
-		glNamedBufferSubData(ubo, 0, 4*sizeof(mat4) + sizeof(vec4), &this->ub);
-	}
-
-	void uploadViewProj(uint ubo) {
-		glNamedBufferSubData(ubo, offsetof(UniformBuffer, view), 2*sizeof(mat4) + sizeof(vec4), &this->ub);
-	}
-
-	void updateModel(vec3 pos, vec3 scale, vec2 front) {
-		const vec3 up = vec3(0.0f, 1.0f, 0.0f);
-
-		// xz
-		vec2 u = vec2(1.0f, 0.0f);
-		vec2 v = front;
-		float angle = std::atan2(u.x*v.x + u.y*v.y, u.x*v.y - u.y*v.x);
-
-		mat4 model(1.0f);
-		model = glm::scale(model, scale);
-		model = glm::translate(model, pos);
-		model = glm::rotate(model, angle, up);
-
-		this->ub.model = model;
-		this->ub.model_it = glm::transpose(glm::inverse(model));
-	}
+};
 
-	void uploadModel(uint ubo) const {
-		glNamedBufferSubData(ubo, offsetof(UniformBuffer, model), 2*sizeof(mat4), &this->ub);
-	}
+// everything the render thread needs from one sim tick. the sim fills one while the render thread
+// draws the one before, so nothing in here may point at sim state that keeps changing
+struct FrameSnapshot {
+	usize frame;
+	// camera and lights, the model part gets overwritten per draw
+	UniformBuffer ub;
+	// the camera moved to the origin, for the skybox
+	mat4 sky_view;
+	// the player's bone palette
+	std::vector<mat4> bones;
+	// culled, sort() is left to the render thread
+	RenderQueue queue;
+	// TAB was pressed
+	bool print_stats;
+	// what the camera was built from, so --late-input can turn it to the newest cursor position at draw time
+	Mouse mouse;
+	View view;
+	vec3 camera_target;
+	float boom;
+	// when the input for this frame's camera was last looked at
+	chrono::steady_clock::time_point sampled;
+	float sim_ms;
 };
 
 struct CubeMap {
@@ -196,15 +277,19 @@ struct CubeMap {
 		bool texture_allocated = false;
 
 		stbi_set_flip_vertically_on_load(false);
+		LoadAsset envmap_asset("assets/envmap_miramar");
 		for (int i = 0; i < 6; i++) {
 			int width, height, n_channels;
-			uchar *data = stbi_load(paths[i], &width, &height, &n_channels, 3);
+			uchar *data = loadImage(paths[i], &width, &height, &n_channels, 3);
 			if (data) {
+				LoadTimer timer(LOAD_UPLOAD);
 				if (!texture_allocated) {
 					glTextureStorage2D(cube_map.tex, 1, GL_RGB8, width, height);
+					gpu_resources.texture(cube_map.tex, GL_RGB8, width, height, 6, 1);
 					texture_allocated = true;
 				}
 				glTextureSubImage3D(cube_map.tex, 0, 0, 0, i, width, height, 1, GL_RGB, GL_UNSIGNED_BYTE, data);
+				timer.stop((uint64_t)width * height * 3);
 			} else {
 				std::cerr << "stbi(error): " << stbi_failure_reason() << " (" << paths[i] << ")" << std::endl;
 			}
@@ -216,21 +301,37 @@ struct CubeMap {
 
 		const char *path = "assets/cube.obj";
 		std::cerr << "assimp(info): loading " << path << std::endl;
+		LoadAsset asset(path);
 		Assimp::Importer imp;
-		const aiScene *scene = imp.ReadFile(path, flags);
+		const aiScene *scene = readScene(imp, path, flags);
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
 			std::cerr << "assimp(error): " << imp.GetErrorString() << std::endl;
 			return {}; // TODO: handle error
 		}
-		cube_map.processNode(scene->mRootNode, scene);
+		{
+			LoadTimer timer(LOAD_VERTICES);
+			cube_map.processNode(scene->mRootNode, scene);
+			timer.stop(cube_map.vertices.size() * sizeof(vec3) + cube_map.indices.size() * sizeof(uint));
+		}
 
+		LoadTimer timer(LOAD_UPLOAD);
 		glCreateBuffers(2, &cube_map.vbo);
 		glNamedBufferData(cube_map.vbo, cube_map.vertices.size() * sizeof(vec3), cube_map.vertices.data(), GL_STATIC_DRAW);
 		glNamedBufferData(cube_map.ebo, cube_map.indices.size() * sizeof(uint), cube_map.indices.data(), GL_STATIC_DRAW);
+		timer.stop(cube_map.vertices.size() * sizeof(vec3) + cube_map.indices.size() * sizeof(uint));
+		gpu_resources.buffer(cube_map.vbo, cube_map.vertices.size() * sizeof(vec3));
+		gpu_resources.buffer(cube_map.ebo, cube_map.indices.size() * sizeof(uint));
 
 		return cube_map;
 	}
 
+	void deinit() {
+		gpu_resources.deleteBuffers(2, &this->vbo);
+		gpu_resources.deleteTextures(1, &this->tex);
+		glDeleteVertexArrays(1, &this->vao);
+		glDeleteProgram(this->shader);
+	}
+
 	void processNode(aiNode* node, const aiScene* scene) {
 		for (uint i = 0; i < node->mNumMeshes; i++) {
 			aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
@@ -253,43 +354,201 @@ struct CubeMap {
 		}
 	}
 
-	void draw() const {
-		int old_cull_face_mode;
-		glGetIntegerv(GL_CULL_FACE_MODE, &old_cull_face_mode);
-		int old_depth_func;
-		glGetIntegerv(GL_DEPTH_FUNC, &old_depth_func);
+	void draw(GLState& gl) const {
+		// the tracker already knows what these were, no need to ask the driver
+		GLenum old_cull_face_mode = gl.cull_face_mode;
+		GLenum old_depth_func = gl.depth_func;
 
-		glCullFace(GL_FRONT);
-		glDepthFunc(GL_LEQUAL);
+		gl.cullFaceMode(GL_FRONT);
+		gl.depthFunc(GL_LEQUAL);
 
-		glUseProgram(this->shader);
-		glBindVertexArray(this->vao);
+		gl.useProgram(this->shader);
+		gl.bindVertexArray(this->vao);
 
 		// uniform has already been set to texture 0 in init()
-		glBindTextureUnit(0, this->tex);
+		gl.bindTextureUnit(0, this->tex);
 
-		glVertexArrayVertexBuffer(this->vao, 0, this->vbo, 0, sizeof(vec3));
-		glVertexArrayElementBuffer(this->vao, this->ebo);
+		gl.vertexBuffer(this->vao, this->vbo, sizeof(vec3));
+		gl.elementBuffer(this->vao, this->ebo);
 		glDrawElements(GL_TRIANGLES, static_cast<uint>(this->indices.size()), GL_UNSIGNED_INT, 0);
+		COUNTER_ADD(COUNTER_DRAW_CALLS, 1);
+		COUNTER_ADD(COUNTER_TRIANGLES, this->indices.size() / 3);
+		COUNTER_ADD(COUNTER_VERTICES, this->vertices.size());
 
-		glCullFace(old_cull_face_mode);
-		glDepthFunc(old_depth_func);
+		gl.cullFaceMode(old_cull_face_mode);
+		gl.depthFunc(old_depth_func);
 	}
 };
 
+// set from SIGUSR1, the main loop does the actual writing
+std::atomic<bool> dump_counters;
+
+void dumpCountersSignal(int) {
+	dump_counters.store(true);
+}
+
 const float flr = 0.0f;
 const float gravity = 0.0002f;
 
-int main() {
-	GLFWwindow *window = init();
-	State state = State::init(window);
-	glfwSetWindowUserPointer(window, reinterpret_cast<void *>(&state));
-	glfwSetKeyCallback(window, keyCallback);
-	glfwSetMouseButtonCallback(window, mouseButtonCallback);
-	glfwSetCursorPosCallback(window, cursorPosCallback);
-	glfwSetScrollCallback(window, scrollCallback);
-	glfwSetWindowSizeCallback(window, windowSizeCallback);
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+#define USAGE " [--headless] [--frames N] [--size WxH] [--record FILE] [--replay FILE] [--dt MS] [--trace FILE] [--counters FILE] [--load-stats FILE] [--gpu-budget MB] [--shader-cache DIR|none] [--threads N] [--serial] [--sim-hz HZ] [--fps-cap N] [--frames-in-flight N] [--late-input] [--frame-budget MS] [--quality N] [--render-scale S] [--sharpen X] [--scale-sweep FILE] [--terrain-cell M] [--bodies N]"
+
+int main(int argc, char **argv) {
+	load_stats.begin();
+	BackendKind backend_kind = BACKEND_WINDOW;
+	// 0 runs until the window is closed
+	usize max_frames = 0;
+	ivec2 size = ivec2(1600, 900);
+	std::string record_path, replay_path, trace_path, load_stats_path;
+	// also written on SIGUSR1
+	std::string counters_path = "counters.csv";
+	bool write_counters = false;
+	// sim time per frame in ms, 0 for wall clock (or the recording's mean dt when replaying). the sim
+	// clock cuts it into --sim-hz steps, so a large one runs the sim faster than real time
+	float fixed_dt_ms = 0.0f;
+	// warns at startup if the loaded scene's buffers and textures go over it, 0 for no budget
+	double gpu_budget_mb = 0.0;
+	// program binaries, "none" to always compile
+	std::string shader_cache_dir = "shader_cache";
+	// physics and animation steps per second, 0 for one step per frame of whatever length it was
+	float sim_hz = 60.0f;
+	// job workers including the sim thread, 0 for one per core
+	uint n_threads = 0;
+	// simulate and render one after the other on this thread instead of overlapping them
+	bool serial = false;
+	// 0 for no cap
+	float fps_cap = 0.0f;
+	// frames the CPU may get ahead of the GPU, 0 leaves it to the driver
+	uint frames_in_flight = 2;
+	// poll once more right before drawing and turn the camera to where the cursor is by then, the sim's
+	// frame can be a whole frame old when pipelined
+	bool late_input = false;
+	// the governor trades quality for frame time to stay under it. defaults to the fps cap's period, 0 turns it off
+	float frame_budget_ms = -1.0f;
+	// where quality starts, 0 is the best. stays there without a budget
+	uint quality = 0;
+	// of the output resolution, on top of what the governor picks. below 1 the scene goes through an offscreen target
+	float render_scale = 1.0f;
+	// of the upscale from a scaled render, 0 to 1
+	float sharpness = 0.5f;
+	// runs through render scales from 1 down and writes frame time per scale here
+	std::string scale_sweep_path;
+	// of the terrain heightfield, smaller is closer to the mesh and takes more memory
+	float terrain_cell = 0.5f;
+	// crates dropped onto the island
+	uint n_bodies = 0;
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--headless") == 0) {
+			backend_kind = BACKEND_HEADLESS;
+		} else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			max_frames = std::stoull(argv[++i]);
+		} else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			std::sscanf(argv[++i], "%dx%d", &size.x, &size.y);
+		} else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			record_path = argv[++i];
+		} else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replay_path = argv[++i];
+		} else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			trace_path = argv[++i];
+		} else if (std::strcmp(argv[i], "--counters") == 0 && i + 1 < argc) {
+			counters_path = argv[++i];
+			write_counters = true;
+		} else if (std::strcmp(argv[i], "--load-stats") == 0 && i + 1 < argc) {
+			load_stats_path = argv[++i];
+		} else if (std::strcmp(argv[i], "--gpu-budget") == 0 && i + 1 < argc) {
+			gpu_budget_mb = std::stod(argv[++i]);
+		} else if (std::strcmp(argv[i], "--shader-cache") == 0 && i + 1 < argc) {
+			shader_cache_dir = argv[++i];
+			if (shader_cache_dir == "none") {
+				shader_cache_dir.clear();
+			}
+		} else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			n_threads = std::stoul(argv[++i]);
+		} else if (std::strcmp(argv[i], "--serial") == 0) {
+			serial = true;
+		} else if (std::strcmp(argv[i], "--fps-cap") == 0 && i + 1 < argc) {
+			fps_cap = std::stof(argv[++i]);
+		} else if (std::strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+			frames_in_flight = std::stoul(argv[++i]);
+		} else if (std::strcmp(argv[i], "--late-input") == 0) {
+			late_input = true;
+		} else if (std::strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc) {
+			frame_budget_ms = std::stof(argv[++i]);
+		} else if (std::strcmp(argv[i], "--quality") == 0 && i + 1 < argc) {
+			quality = std::stoul(argv[++i]);
+		} else if (std::strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc) {
+			render_scale = std::stof(argv[++i]);
+		} else if (std::strcmp(argv[i], "--sharpen") == 0 && i + 1 < argc) {
+			sharpness = std::stof(argv[++i]);
+		} else if (std::strcmp(argv[i], "--scale-sweep") == 0 && i + 1 < argc) {
+			scale_sweep_path = argv[++i];
+		} else if (std::strcmp(argv[i], "--terrain-cell") == 0 && i + 1 < argc) {
+			terrain_cell = std::stof(argv[++i]);
+		} else if (std::strcmp(argv[i], "--bodies") == 0 && i + 1 < argc) {
+			n_bodies = std::stoul(argv[++i]);
+		} else if (std::strcmp(argv[i], "--sim-hz") == 0 && i + 1 < argc) {
+			sim_hz = std::stof(argv[++i]);
+		} else if (std::strcmp(argv[i], "--dt") == 0 && i + 1 < argc) {
+			fixed_dt_ms = std::stof(argv[++i]);
+		} else {
+			std::cerr << "usage: " << argv[0] << USAGE << std::endl;
+			return 1;
+		}
+	}
+	const bool replaying = !replay_path.empty();
+	InputRecording replay = {};
+	if (replaying) {
+		replay = InputRecording::load(replay_path);
+		if (replay.frames.empty()) {
+			return 1;
+		}
+		max_frames = max_frames == 0 ? replay.frames.size() : std::min(max_frames, replay.frames.size());
+		if (fixed_dt_ms == 0.0f) {
+			fixed_dt_ms = replay.meanDt() / 1000.0f;
+		}
+	}
+	if (frame_budget_ms < 0.0f) {
+		frame_budget_ms = fps_cap > 0.0f ? 1000.0f / fps_cap : 0.0f;
+	}
+	const bool sweeping = !scale_sweep_path.empty();
+	if (sweeping) {
+		// the other knobs would muddy the curve
+		frame_budget_ms = 0.0f;
+	}
+	governor.init(frame_budget_ms, quality);
+	if ((backend_kind == BACKEND_HEADLESS || sweeping) && max_frames == 0) {
+		// nobody's there to close it
+		max_frames = 1000;
+	}
+
+	job_system.init(n_threads);
+	Backend backend = Backend::init(backend_kind, size);
+	State state = State::init(backend);
+	if (replaying) {
+		state.mouse.last_xpos = replay.cursor_x;
+		state.mouse.last_ypos = replay.cursor_y;
+	}
+	InputRecording recording = {};
+	if (!record_path.empty()) {
+		recording = InputRecording::init(state.mouse.last_xpos, state.mouse.last_ypos);
+		state.recording = &recording;
+	}
+	// the callbacks run on this thread, the sim picks their events up at the start of its next tick
+	InputQueue input_queue = {};
+	input_queue.size = state.scr_res;
+	// a replay doesn't listen to the live input at all
+	GLFWwindow *window = replaying ? nullptr : backend.window;
+	if (window != nullptr) {
+		glfwSetWindowUserPointer(window, reinterpret_cast<void *>(&input_queue));
+		glfwSetKeyCallback(window, keyCallback);
+		glfwSetMouseButtonCallback(window, mouseButtonCallback);
+		glfwSetCursorPosCallback(window, cursorPosCallback);
+		glfwSetScrollCallback(window, scrollCallback);
+		glfwSetWindowSizeCallback(window, windowSizeCallback);
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	}
+
+	// everything up to the frame loop counts as asset loading
+	alloc_tag = ALLOC_ASSETS;
 
 	// Initialize buffers
 	std::array<uint, 1> va{};
@@ -302,21 +561,20 @@ int main() {
 
 	Vertex::setupVAO(vao);
 
-	glBindBufferBase(GL_UNIFORM_BUFFER, 0, ubo);
+	// every state change from here on goes through this
+	GLState gl = GLState::init();
+
+	gl.bindUniformBuffer(0, ubo);
 	glNamedBufferData(ubo, sizeof(UniformBuffer), &state.ub, GL_DYNAMIC_DRAW);
+	gpu_resources.buffer(ubo, sizeof(UniformBuffer));
 
 	// Initialize shaders
-	const uint model_vert_shader = createShader("./shaders/model.vert", "./shaders/model_vert.frag");
-	const uint model_shader = createShader("./shaders/model.vert", "./shaders/model.frag");
-	const uint model_anim_shader = createShader("./shaders/model_anim.vert", "./shaders/model.frag");
-	const uint model_plain_shader = createShader("./shaders/model.vert", "./shaders/model_plain.frag");
-	const uint model_plain_anim_shader = createShader("./shaders/model_anim.vert", "./shaders/model_plain.frag");
-
-	// TODO: move this inside model
-	const int model_anim_shader_bone_matrices = glGetUniformLocation(model_plain_anim_shader, "boneMatrices");
+	shader_cache = ShaderCache::init(shader_cache_dir);
+	// each mesh picks the permutation that matches its data when its model loads
+	ShaderVariants model_variants = ShaderVariants::init("./shaders/model.vert", "./shaders/model.frag");
 
 	// Model model = Model::init("./vampire/dancing_vampire.dae", false);
-	Model model = Model::init("./assets/Dancing Twerk.dae", vao, model_plain_anim_shader);
+	Model model = Model::init("./assets/Dancing Twerk.dae", vao, model_variants);
 	model.hitbox = { .min = vec3(0.0f), .max = vec3(0.4f) };
 
 	// auto dance_anim = Animation::init("./vampire/dancing_vampire.dae", model.bone_info_map);
@@ -326,150 +584,617 @@ int main() {
 	auto animator = Animator::init(&dance_anim);
 	assert(animator.bone_matrices.size() <= MAX_BONE_MATRICES);
 
-	Model tower = Model::init("./assets/fantasy_tower/scene.gltf", vao, model_shader);
-	Model map = Model::init("./assets/low_poly_island/scene.gltf", vao, model_shader);
-	// Model cat = Model::init("./assets/cat_low_poly.glb", vao, model_plain_shader);
+	Model tower = Model::init("./assets/fantasy_tower/scene.gltf", vao, model_variants);
+	Model map = Model::init("./assets/low_poly_island/scene.gltf", vao, model_variants);
+	const Occluder tower_occluder = Occluder::init(tower, 2048);
+	const Occluder map_occluder = Occluder::init(map, 2048);
+	const mat4 map_to_world = getModel(vec3(0.0f, -2.0f, 0.0f), vec3(4.0f, 1.0f, 4.0f), vec2(0.0f));
+	const mat4 tower_to_world = getModel(vec3(0.0f, 1.0f, 0.0f), vec3(10.0f), vec2(0.0f));
+	// the island is terrain: ground height is a lookup and its triangles never get tested. everything
+	// else in the level goes in the BVH, what the player bumps into and the camera can't go through
+	Heightfield terrain;
+	MeshBVH level;
+	{
+		std::vector<vec3> corners;
+		meshTriangles(map, map_to_world, corners);
+		terrain = Heightfield::init(corners, terrain_cell, flr);
+		corners.clear();
+		meshTriangles(tower, tower_to_world, corners);
+		level = MeshBVH::init(corners, std::thread::hardware_concurrency());
+	}
+	// Model cat = Model::init("./assets/cat_low_poly.glb", vao, model_variants);
 
 	// TODO: store a ptr/handle to Model instead of having multiple copies
 	//  Potential solution: DrawContext{ vao, shader, drawfn }
 	std::vector<Model> objs;
 
+	std::vector<Box> obj_boxes;
+	obj_boxes.reserve(objs.size());
+	for (const auto& o : objs) {
+		obj_boxes.push_back(o.worldBounds(getModel(o.pos, vec3(1.0f), vec2(0.0f))));
+	}
+	SceneBVH scene = SceneBVH::init(std::move(obj_boxes), std::thread::hardware_concurrency());
+	// collision's, separate from the scene BVH which keeps culling and rays. objects go in first so a body
+	// id below objs.size() is that object's index
+	SpatialHash broadphase = SpatialHash::init(2.0f);
+	for (const auto& o : objs) {
+		broadphase.insert(o.hitbox.translate(o.pos), false);
+	}
+	const uint player_body = broadphase.insert(model.hitbox.translate(model.pos), true);
+	// scratch for the narrowphase
+	std::vector<BodyPair> body_pairs;
+
+	// crates, in piles over the far corner of the island away from the tower. the tower stands in for
+	// them, squeezed into each one's box
+	RigidBodies bodies = RigidBodies::init(4.0f * CRATE_HALF, flr);
+	{
+		const vec2 far = terrain.origin + vec2(terrain.cells) * terrain.cell_size * 0.75f;
+		const uint side = (uint)std::ceil(std::sqrt((float)n_bodies / CRATE_LAYERS));
+		const float spacing = 3.0f * CRATE_HALF;
+		for (uint i = 0; i < n_bodies; i++) {
+			const uint column = i % (side * side), layer = i / (side * side);
+			const float x = far.x + ((float)(column % side) - side / 2.0f) * spacing;
+			const float z = far.y + ((float)(column / side) - side / 2.0f) * spacing;
+			bodies.add(vec3(x, terrain.height(x, z) + 2.0f + layer * spacing, z), vec3(CRATE_HALF));
+		}
+	}
+	const mat4 crate_local = glm::translate(glm::scale(mat4(1.0f), 2.0f / (tower.bounds.max - tower.bounds.min)), -tower.bounds.center());
+	std::vector<mat4> crate_transforms;
+
+	OcclusionBuffer occlusion = OcclusionBuffer::init(256, 144, job_system.size());
+
 	CubeMap cube_map = CubeMap::init();
 
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_CULL_FACE);
+	// blending is only turned on for the transparent pass
+	gl.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	gl.depthTest(true);
+	gl.cullFace(true);
 	// glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
-	auto start = chrono::steady_clock::now();
-	while (!glfwWindowShouldClose(window)) {
-		auto now = chrono::steady_clock::now();
-		state.dt = chrono::duration_cast<chrono::microseconds>(now - start).count();
-		start = now;
-
-		{ // process
-			glfwPollEvents();
-			const float dt_ms = state.dt/1000.0f;
-
-			// Floating cam
-			// if (state.keys.w) state.view.pos += state.view.front * state.view.speed * dt_ms;
-			// if (state.keys.s) state.view.pos -= state.view.front * state.view.speed * dt_ms;
-			// if (state.keys.a) state.view.pos -= glm::normalize(glm::cross(state.view.front, state.view.up)) * state.view.speed * dt_ms;
-			// if (state.keys.d) state.view.pos += glm::normalize(glm::cross(state.view.front, state.view.up)) * state.view.speed * dt_ms;
-			// if (state.keys.space) state.view.pos += state.view.up * state.view.speed * dt_ms;
-			// if (state.keys.shift) state.view.pos -= state.view.up * state.view.speed * dt_ms;
-
-			vec3 move_front = state.view.front * state.view.speed * dt_ms;
-			move_front.y = 0.0f;
-			vec3 move_side = glm::normalize(glm::cross(state.view.front, state.view.up)) * state.view.speed * dt_ms;
-			vec3 move_vert = state.view.up * 0.01f;
-
-			model.velocity.x = 0;
-			model.velocity.y -= gravity * dt_ms;
-			model.velocity.z = 0;
-
-			if (state.keys.w)     model.velocity   += move_front;
-			if (state.keys.s)     model.velocity   -= move_front;
-			if (state.keys.a)     model.velocity   -= move_side;
-			if (state.keys.d)     model.velocity   += move_side;
-			if (state.keys.space) model.velocity.y += 1.35f*gravity*dt_ms;
-			// if (state.keys.shift) model.velocity -= move_vert;
-
-			vec3 new_pos = model.pos + model.velocity;
-
-			// TODO:
-			// "physics"
-			if (new_pos.y < flr) {
-				new_pos.y = flr;
-				model.velocity.y = 0.0f;
-			}
+	alloc_tag = ALLOC_OTHER;
+	load_stats.finish();
+	load_stats.print(std::cerr);
+	shader_cache.print(std::cerr);
+	model_variants.print(std::cerr);
+	gpu_resources.print(std::cerr, gpu_budget_mb);
+	level.print(std::cerr);
+	terrain.print(std::cerr);
+	if (!load_stats_path.empty()) {
+		load_stats.writeJson(load_stats_path);
+	}
 
-			for (usize i = 0; i < objs.size(); i++) {
-				model.detectObj(new_pos, objs[i]);
+	frame_arena = FrameArena::init(1 << 20);
+	FrameTimes frame_times = FrameTimes::init();
+	std::signal(SIGUSR1, dumpCountersSignal);
+	if (!trace_path.empty()) {
+		profiler.enable();
+	}
+
+	SimClock sim_clock = SimClock::init(sim_hz, SIM_CLOCK_MAX_STEPS);
+	model.prev_pos = model.pos;
+
+	// the sim writes frame N + 1 into one of these while this thread renders frame N from another
+	TripleBuffer<FrameSnapshot> snapshots = {};
+	snapshots.init();
+	// the one the frame graph is filling
+	FrameSnapshot *next = nullptr;
+
+	// the sim side of a frame as a DAG, built once. animation runs alongside the camera and culling
+	// chain, culling and occluder rasterization alongside each other, and the per-object loops inside
+	// them fan out over the job system. input polling (GLFW) and every GL call stay on this thread
+	TaskGraph frame_graph;
+	// culling's own
+	std::vector<uint> visible_objs;
+	Frustum frustum = {};
+	// the governor's level as of the start of this tick
+	QualityLevel sim_quality = governor.quality();
+	// camera position, for cullSmall()
+	vec3 eye = vec3(0.0f);
+	usize frames_since_pose = 0;
+	// as of the last sim step
+	bool on_ground = false;
+	// how far the player moves in a step, falls build up in y
+	vec3 player_velocity = vec3(0.0f);
+	mat4 view_proj = mat4(1.0f);
+	// one fixed step of movement, collision and the player state machine, dt in microseconds
+	auto simStep = [&](float dt_us) {
+		const float dt_ms = dt_us/1000.0f;
+		model.prev_pos = model.pos;
+
+		// Floating cam
+		// if (state.keys.w) state.view.pos += state.view.front * state.view.speed * dt_ms;
+		// if (state.keys.s) state.view.pos -= state.view.front * state.view.speed * dt_ms;
+		// if (state.keys.a) state.view.pos -= glm::normalize(glm::cross(state.view.front, state.view.up)) * state.view.speed * dt_ms;
+		// if (state.keys.d) state.view.pos += glm::normalize(glm::cross(state.view.front, state.view.up)) * state.view.speed * dt_ms;
+		// if (state.keys.space) state.view.pos += state.view.up * state.view.speed * dt_ms;
+		// if (state.keys.shift) state.view.pos -= state.view.up * state.view.speed * dt_ms;
+
+		vec3 move_front = state.view.front * state.view.speed * dt_ms;
+		move_front.y = 0.0f;
+		vec3 move_side = glm::normalize(glm::cross(state.view.front, state.view.up)) * state.view.speed * dt_ms;
+		vec3 move_vert = state.view.up * 0.01f;
+
+		player_velocity.x = 0;
+		player_velocity.y -= gravity * dt_ms;
+		player_velocity.z = 0;
+
+		if (state.keys.w)     player_velocity   += move_front;
+		if (state.keys.s)     player_velocity   -= move_front;
+		if (state.keys.a)     player_velocity   -= move_side;
+		if (state.keys.d)     player_velocity   += move_side;
+		if (state.keys.space) player_velocity.y += 1.35f*gravity*dt_ms;
+		// if (state.keys.shift) player_velocity -= move_vert;
+
+		vec3 new_pos = model.pos + player_velocity;
+
+		// level geometry, against the hitbox as an upright capsule
+		const vec3 half = (model.hitbox.max - model.hitbox.min) * 0.5f;
+		const float radius = std::min(half.x, half.z);
+		const vec3 center = model.hitbox.translate(model.pos).center();
+		const vec3 axis = vec3(0.0f, std::max(half.y - radius, 0.0f), 0.0f);
+		bool grounded = false;
+		new_pos = model.pos + level.slide({ .a = center - axis, .b = center + axis, .radius = radius }, new_pos - model.pos, grounded);
+		if (grounded && player_velocity.y < 0.0f) {
+			player_velocity.y = 0.0f;
+		}
+
+		// terrain under the middle of the hitbox's base, never below flr
+		const vec3 feet = new_pos + vec3(model.hitbox.min.x + half.x, model.hitbox.min.y, model.hitbox.min.z + half.z);
+		const float ground = std::max(terrain.height(feet.x, feet.z), flr);
+		if (feet.y < ground || (on_ground && player_velocity.y <= 0.0f && feet.y - ground < GROUND_SNAP)) {
+			new_pos.y += ground - feet.y;
+			player_velocity.y = 0.0f;
+			grounded = true;
+		}
+		on_ground = grounded;
+
+		// the player's body covers the whole step so nothing in between is missed
+		Box sweep = model.hitbox.translate(model.pos);
+		sweep.expand(model.hitbox.translate(new_pos));
+		{
+			// cells come and go as the player crosses them, that's the grid's business
+			ALLOC_ALLOW();
+			broadphase.update(player_body, sweep);
+		}
+		body_pairs.clear();
+		broadphase.pairs(body_pairs);
+		for (auto [a, b] : body_pairs) {
+			// the player is the only dynamic body so far, anything else that moves gets its response here
+			if (a == player_body && b < objs.size()) {
+				model.detectObj(new_pos, player_velocity, objs[b]);
 			}
-			model.pos = new_pos;
-
-			switch (state.player_state) {
-			case IDLE:
-				if (model.velocity.x != 0) {
-					if (new_pos.y == flr) {
-						state.player_state = WALK;
-						animator.playAnimation(&walk_anim);
-					} else {
-						state.player_state = SWIM;
-						animator.playAnimation(&swim_anim);
-					}
-				}
-				break;
-			case SWIM:
-				if (model.velocity.x == 0) {
-					state.player_state = IDLE;
-					animator.playAnimation(&dance_anim);
-				} else if (model.pos.y == flr) {
+		}
+		model.pos = new_pos;
+
+		switch (state.player_state) {
+		case IDLE:
+			if (player_velocity.x != 0) {
+				if (grounded) {
 					state.player_state = WALK;
 					animator.playAnimation(&walk_anim);
-				}
-				break;
-			case WALK:
-				if (model.velocity.x == 0) {
-					state.player_state = IDLE;
-					animator.playAnimation(&dance_anim);
-				} else if (model.pos.y > flr) {
+				} else {
 					state.player_state = SWIM;
 					animator.playAnimation(&swim_anim);
 				}
-				break;
 			}
+			break;
+		case SWIM:
+			if (player_velocity.x == 0) {
+				state.player_state = IDLE;
+				animator.playAnimation(&dance_anim);
+			} else if (grounded) {
+				state.player_state = WALK;
+				animator.playAnimation(&walk_anim);
+			}
+			break;
+		case WALK:
+			if (player_velocity.x == 0) {
+				state.player_state = IDLE;
+				animator.playAnimation(&dance_anim);
+			} else if (!grounded) {
+				state.player_state = SWIM;
+				animator.playAnimation(&swim_anim);
+			}
+			break;
+		}
+		animator.advance(dt_us/1000000.0f);
+	};
+	// as many steps as the frame's time covers, render transforms are interpolated between the last two
+	const uint physics_task = frame_graph.add("physics", ALLOC_PHYSICS, {}, [&] {
+		// objects don't move on their own yet, anything that does should scene.update() itself before this
+		scene.maintain();
+		const usize steps = sim_clock.advance(state.dt);
+		for (usize i = 0; i < steps; i++) {
+			const float dt_us = sim_clock.step(state.dt);
+			simStep(dt_us);
+			bodies.step(dt_us / 1000000.0f, &terrain);
+		}
+		// crates aren't interpolated, at sim rate a box that's moving at all is falling
+		bodies.writeTransforms(crate_transforms, crate_local);
+	});
+	frame_graph.add("animation", ALLOC_ANIMATION, { physics_task }, [&] {
+		// the palette from the last pose() stays in use for the frames in between
+		if (++frames_since_pose >= sim_quality.animation_interval) {
+			animator.pose(sim_clock.alpha());
+			frames_since_pose = 0;
+		}
+		next->bones.assign(animator.bone_matrices.begin(), animator.bone_matrices.end());
+	});
+	const uint camera_task = frame_graph.add("camera", ALLOC_RENDER, { physics_task }, [&] {
+		// the boom pulls in when the level is between the player and the camera. rays around the middle
+		// one too, so the near plane doesn't clip a corner it just missed
+		const vec3 target = model.renderPos(sim_clock.alpha());
+		const vec3 right = glm::normalize(glm::cross(state.view.front, state.view.up));
+		const vec3 up = glm::cross(right, state.view.front);
+		const vec3 offsets[5] = { vec3(0.0f), right, -right, up, -up };
+		Ray rays[5];
+		TriHit boom_hits[5];
+		for (uint i = 0; i < 5; i++) {
+			rays[i] = { .origin = target + vec3(0.0f, CAMERA_HEIGHT, 0.0f) + offsets[i] * CAMERA_CLEARANCE, .dir = -state.view.front, .max_t = CAMERA_BOOM };
+		}
+		float boom = CAMERA_BOOM;
+		level.raycast(rays, boom_hits, 5);
+		for (uint i = 0; i < 5; i++) {
+			if (boom_hits[i].tri != UINT32_MAX) {
+				boom = std::min(boom, boom_hits[i].t - CAMERA_CLEARANCE);
+			}
+			float t;
+			vec3 normal;
+			if (terrain.raycast(rays[i], t, normal)) {
+				boom = std::min(boom, t - CAMERA_CLEARANCE);
+			}
+		}
+		boom = std::max(boom, CAMERA_CLEARANCE);
+		state.updateViewProj(target, boom);
+		view_proj = state.ub.projection * state.ub.view;
+		// the governor can pull the far plane in for culling only, the projection keeps its own
+		const mat4 cull_proj = glm::perspective(glm::radians(state.view.fov), (float)state.scr_res.x / (float)state.scr_res.y, 0.1f, sim_quality.cull_distance);
+		frustum = Frustum::init(cull_proj * state.ub.view);
+		eye = vec3(glm::inverse(state.ub.view)[3]);
+		next->ub = state.ub;
+		next->sky_view = getView(vec3(0.0), state.view.front, state.view.up, true, CAMERA_BOOM);
+		next->mouse = state.mouse;
+		next->view = state.view;
+		next->camera_target = target;
+		next->boom = boom;
+	});
+	const uint render_list_task = frame_graph.add("render list", ALLOC_RENDER, { camera_task }, [&] {
+		RenderQueue& queue = next->queue;
+		queue.clear();
+		queue.push(model, getModel(model.renderPos(sim_clock.alpha()), vec3(1.0f), vec2(state.view.front.x, state.view.front.z)));
+		visible_objs.clear();
+		scene.queryFrustum(frustum, visible_objs);
+		for (uint id : visible_objs) {
+			queue.push(objs[id], getModel(objs[id].pos, vec3(1.0f), vec2(0.0f)));
+		}
+		for (const auto& transform : crate_transforms) {
+			queue.push(tower, transform);
+		}
+		usize map_transform = queue.push(map, map_to_world);
+		usize tower_transform = queue.push(tower, tower_to_world);
+		queue.pushOccluder(map_occluder, map_transform);
+		queue.pushOccluder(tower_occluder, tower_transform);
+	});
+	const uint frustum_task = frame_graph.add("frustum cull", ALLOC_RENDER, { render_list_task }, [&] {
+		next->queue.cull(frustum);
+		if (sim_quality.min_screen_size > 0.0f) {
+			next->queue.cullSmall(eye, sim_quality.min_screen_size);
+		}
+	});
+	const uint occluders_task = frame_graph.add("occluders", ALLOC_RENDER, { render_list_task }, [&] {
+		next->queue.rasterizeOccluders(occlusion, view_proj);
+	});
+	frame_graph.add("occlusion cull", ALLOC_RENDER, { frustum_task, occluders_task }, [&] {
+		next->queue.testOcclusion(occlusion, view_proj);
+	});
+
+	// one sim tick into the back snapshot, false once max_frames of them are done
+	usize sim_frame = 0;
+	auto sim_start = chrono::steady_clock::now();
+	std::vector<InputEvent> events;
+	auto simulate = [&]() -> bool {
+		if (max_frames != 0 && sim_frame == max_frames) {
+			return false;
+		}
+		PROFILE_ZONE("sim");
+		auto now = chrono::steady_clock::now();
+		state.dt = chrono::duration_cast<chrono::microseconds>(now - sim_start).count();
+		sim_start = now;
+		if (fixed_dt_ms > 0.0f) {
+			state.dt = fixed_dt_ms * 1000.0f;
+		}
+		if (state.recording != nullptr) {
+			state.recording->beginFrame(state.dt);
+		}
+		sim_quality = governor.quality();
+
+		{ // input
+			PROFILE_ZONE("input");
+			ivec2 size;
+			if (input_queue.drain(events, size)) {
+				state.scr_res = size;
+			}
+			for (const auto& event : events) {
+				state.input(event);
+			}
+			if (replaying) {
+				for (const auto& event : replay.frames[sim_frame].events) {
+					handleInput(&state, event);
+				}
+			}
+		}
+		next = &snapshots.write();
+		frame_graph.run(job_system);
+		next->frame = sim_frame;
+		next->print_stats = state.keys.tab;
+		state.keys.tab = false;
+		next->sampled = now;
+		next->sim_ms = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - now).count() / 1000.0f;
+		snapshots.publish();
+		sim_frame++;
+		return true;
+	};
+
+	// the sim thread stays one frame ahead: it starts on N + 1 as soon as this thread has taken N.
+	// frames take max(sim, render) that way instead of their sum
+	const bool pipelined = !serial;
+	std::thread sim_thread;
+	if (pipelined) {
+		job_system.release();
+		sim_thread = std::thread([&] {
+			job_system.adopt();
+			while (snapshots.waitConsumed() && simulate()) {}
+			snapshots.close();
+			job_system.release();
+		});
+	}
 
-			animator.updateAnimation(state.dt/1000000.0f);
+	FramePacer pacer = FramePacer::init(fps_cap);
+	// only drawn through when the scale is below 1
+	SceneTarget scene_target = SceneTarget::init(backend.framebufferSize(), sharpness);
+	ScaleSweep sweep = sweeping ? ScaleSweep::init(max_frames) : ScaleSweep{};
+	FrameFences fences = FrameFences::init(frames_in_flight);
+
+	usize frame = 0;
+	const auto loop_start = chrono::steady_clock::now();
+	for (;;) {
+		PROFILE_ZONE("frame");
+		{
+			// both before polling, so whatever input comes in meanwhile still makes this frame
+			PROFILE_ZONE("pacing");
+			pacer.wait();
+			fences.wait();
+		}
+		PROFILE_FRAME();
+		{
+			PROFILE_ZONE("poll");
+			backend.pollEvents();
+		}
+		if (backend.shouldClose()) {
+			snapshots.close();
+		} else if (!pipelined && !simulate()) {
+			snapshots.close();
+		}
+		FrameSnapshot *snap;
+		{
+			PROFILE_ZONE("wait for sim");
+			snap = snapshots.read();
+		}
+		if (snap == nullptr) {
+			break;
+		}
+		if (late_input) {
+			// only the view moves, the sim and the culling keep the camera they had. the events stay queued
+			// for the sim, which catches up to the same place next tick
+			PROFILE_ZONE("late input");
+			backend.pollEvents();
+			double x, y;
+			if (input_queue.latestCursor(x, y)) {
+				State look = {};
+				look.mouse = snap->mouse;
+				look.view = snap->view;
+				handleCursorPos(&look, x, y);
+				snap->ub.view = getView(snap->camera_target, look.view.front, look.view.up, false, snap->boom);
+				snap->sky_view = getView(vec3(0.0), look.view.front, look.view.up, true, CAMERA_BOOM);
+			}
+			snap->sampled = chrono::steady_clock::now();
 		}
+		auto now = chrono::steady_clock::now();
+		frame_times.beginFrame();
+
 		{ // render
+			PROFILE_ZONE("render");
+			ALLOC_SCOPE(ALLOC_RENDER);
+			RenderQueue& queue = snap->queue;
+			const QualityLevel& render_quality = governor.quality();
+			const ivec2 output = backend.framebufferSize();
+			const float scale = sweeping ? sweep.scale(frame) : render_scale * render_quality.resolution_scale;
+			const bool scaled = scale < 1.0f;
+			if (scaled) {
+				scene_target.resize(scale, output);
+				scene_target.bind();
+			}
+			if (sweeping) {
+				sweep.record(scaled ? scene_target.size : output);
+			}
 			glClearColor(0.0f, 0.0f, 0.0f, 1.00f);
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 			// render player model
-			const auto& transforms = animator.bone_matrices;
-			glProgramUniformMatrix4fv(model_plain_anim_shader, model_anim_shader_bone_matrices, transforms.size(), false, glm::value_ptr(transforms[0]));
-
-			state.updateModel(model.pos, vec3(1.0f), vec2(state.view.front.x, state.view.front.z));
-			state.updateViewProj(model.pos);
-			state.uploadModelViewProj(ubo);
-			model.draw();
-
-			// render objects
-			for (auto o : objs) {
-				state.updateModel(o.pos, vec3(1.0f), vec2(0.0f));
-				state.uploadModel(ubo);
-				o.draw();
+			const auto& transforms = snap->bones;
+			for (uint program : model.skinned_programs) {
+				gl.uniformMatrix4fv(program, BONE_MATRICES_LOCATION, transforms.size(), glm::value_ptr(transforms[0]));
+			}
+
+			snap->ub.uploadViewProj(ubo);
+
+			// counts from the last frame, the current one isn't done yet
+			const GLStateStats gl_stats = gl.frame();
+			if (snap->print_stats) {
+				counters.print(std::cerr);
+				alloc_tracker.print(std::cerr);
+				job_system.print(std::cerr);
+				job_system.resetStats();
+				std::cerr << "cull(info): " << queue.stats.tested << " meshes, "
+					  << queue.stats.culled << " outside the frustum, "
+					  << queue.stats.occluded << " occluded, "
+					  << queue.stats.small << " too small ("
+					  << 100.0f * queue.stats.rejectedFraction() << "% rejected)" << std::endl;
+				std::cerr << "gl(info): " << gl_stats.issued << " state changes issued, "
+					  << gl_stats.avoided << " redundant ones filtered" << std::endl;
+			}
+
+			{
+				PROFILE_ZONE("sort");
+				queue.sort(snap->ub.view);
 			}
-			state.updateModel(vec3(0.0f, -2.0f, 0.0f), vec3(4.0f, 1.0f, 4.0f), vec2(0.0f));
-			state.uploadModel(ubo);
-			map.draw();
-			state.updateModel(vec3(0.0f, 1.0f, 0.0f), vec3(10.0f), vec2(0.0f));
-			state.uploadModel(ubo);
-			tower.draw();
 
-			// render cube map
-			mat4 view = getView(vec3(0.0), state.view.front, state.view.up, true);
-			glNamedBufferSubData(ubo, offsetof(UniformBuffer, view), sizeof(mat4), glm::value_ptr(view));
-			cube_map.draw();
+			usize uploaded = SIZE_MAX;
+			auto drawPass = [&](AlphaMode pass) {
+				for (usize k = queue.pass_begin[pass]; k < queue.pass_begin[pass + 1]; k++) {
+					const DrawItem& item = queue.items[queue.order[k]];
+					if (item.transform != uploaded) {
+						snap->ub.updateModel(queue.transforms[item.transform]);
+						snap->ub.uploadModel(ubo);
+						uploaded = item.transform;
+					}
+					item.mesh->draw(gl, item.vao, item.shader);
+				}
+			};
+
+			gl.blend(false);
+			{
+				PROFILE_GPU_ZONE("opaque");
+				drawPass(ALPHA_OPAQUE);
+			}
+			{
+				PROFILE_GPU_ZONE("alpha tested");
+				drawPass(ALPHA_MASK);
+			}
+
+			if (render_quality.skybox) { // render cube map, after the opaques so it only shades what they left uncovered
+				PROFILE_GPU_ZONE("skybox");
+				glNamedBufferSubData(ubo, offsetof(UniformBuffer, view), sizeof(mat4), glm::value_ptr(snap->sky_view));
+				cube_map.draw(gl);
+				// the blended pass is lit from the real camera
+				glNamedBufferSubData(ubo, offsetof(UniformBuffer, view), sizeof(mat4), glm::value_ptr(snap->ub.view));
+				COUNTER_ADD(COUNTER_UBO_BYTES, 2*sizeof(mat4));
+			}
+
+			gl.blend(true);
+			gl.depthMask(false);
+			{
+				PROFILE_GPU_ZONE("transparent");
+				drawPass(ALPHA_BLEND);
+			}
+			gl.depthMask(true);
+
+			if (scaled) {
+				PROFILE_GPU_ZONE("upscale");
+				scene_target.resolve(gl, backend.framebuffer, output);
+			}
+		}
+		counters.endFrame();
+		alloc_tracker.endFrame();
+		frame_arena.reset();
+		if (dump_counters.exchange(false)) {
+			counters.write(counters_path);
 		}
-		glfwSwapBuffers(window);
+		const float cpu_ms = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - now).count() / 1000.0f;
+		frame_times.endFrame(cpu_ms, snap->sim_ms);
+		// whichever of the sim, the render thread and the GPU is holding the frame rate back
+		governor.observe(frame, std::max(pipelined ? std::max(cpu_ms, snap->sim_ms) : cpu_ms + snap->sim_ms, frame_times.last_gpu_ms));
+		{
+			PROFILE_ZONE("swap");
+			backend.present();
+		}
+		fences.insert();
+		frame_times.presented(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - snap->sampled).count() / 1000.0f);
+		frame++;
+	}
+	if (pipelined) {
+		sim_thread.join();
+		job_system.adopt();
+	}
+
+	frame_times.finish();
+	frame_times.report(std::cerr);
+	if (sweeping) {
+		sweep.write(scale_sweep_path, frame_times);
+	}
+	sim_clock.print(std::cerr);
+	broadphase.print(std::cerr);
+	bodies.print(std::cerr);
+	printPacing(std::cerr, pacer, fences);
+	governor.print(std::cerr);
+	alloc_tracker.report(std::cerr);
+	if (write_counters) {
+		counters.write(counters_path);
+	}
+	if (!trace_path.empty()) {
+		profiler.gpu.flush();
+		profiler.writeChromeTrace(trace_path);
+	}
+	if (state.recording != nullptr) {
+		state.recording->save(record_path);
 	}
 
-	// TODO: free stuff
-	// glDeleteVertexArrays(, );
-	// glDeleteBuffers(, );
-	// glDeleteProgram(model_plain_shader);
-	// glDeleteProgram(model_plain_anim_shader);
+	if (backend.headless()) {
+		const float total_ms = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - loop_start).count() / 1000.0f;
+		std::cerr << "headless(info): " << frame << " frames in " << total_ms << "ms ("
+			  << total_ms / std::max<usize>(frame, 1) << "ms/frame, " << (pipelined ? "pipelined" : "serial") << (late_input ? ", late input" : "") << ")" << std::endl;
+	}
 
-	deinit(&window);
+	model.deinit();
+	tower.deinit();
+	map.deinit();
+	for (auto& o : objs) {
+		o.deinit();
+	}
+	cube_map.deinit();
+	gpu_resources.deleteBuffers(b.size(), b.data());
+	glDeleteVertexArrays(va.size(), va.data());
+	model_variants.deinit();
+	frame_times.gpu_timer.deinit();
+	fences.deinit();
+	scene_target.deinit();
+
+	backend.deinit();
+	job_system.deinit();
+	gpu_resources.reportLeaks(std::cerr);
 	return 0;
 }
 
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
-	State *state = reinterpret_cast<State*>(glfwGetWindowUserPointer(window));
+	InputQueue *input = reinterpret_cast<InputQueue*>(glfwGetWindowUserPointer(window));
+	input->push({ .type = INPUT_KEY, .code = key, .action = action });
+}
+
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+	InputQueue *input = reinterpret_cast<InputQueue*>(glfwGetWindowUserPointer(window));
+	input->push({ .type = INPUT_MOUSE_BUTTON, .code = button, .action = action });
+}
+
+void cursorPosCallback(GLFWwindow* window, double xpos, double ypos) {
+	InputQueue *input = reinterpret_cast<InputQueue*>(glfwGetWindowUserPointer(window));
+	input->push({ .type = INPUT_CURSOR_POS, .x = xpos, .y = ypos });
+}
+
+void handleInput(State *state, const InputEvent& event) {
+	switch (event.type) {
+	case INPUT_KEY:
+		handleKey(state, event.code, event.action);
+		break;
+	case INPUT_MOUSE_BUTTON:
+		handleMouseButton(state, event.code, event.action);
+		break;
+	case INPUT_CURSOR_POS:
+		handleCursorPos(state, event.x, event.y);
+		break;
+	}
+}
+
+void handleKey(State *state, int key, int action) {
 	switch (key) {
 	case GLFW_KEY_W:
 		switch (action) {
@@ -564,8 +1289,7 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 	}
 }
 
-void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
-	State *state = reinterpret_cast<State*>(glfwGetWindowUserPointer(window));
+void handleMouseButton(State *state, int button, int action) {
 	switch (button) {
 	case GLFW_MOUSE_BUTTON_LEFT:
 		switch (action) {
@@ -590,8 +1314,7 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
 	}
 }
 
-void cursorPosCallback(GLFWwindow* window, double xpos, double ypos) {
-	State *state = reinterpret_cast<State*>(glfwGetWindowUserPointer(window));
+void handleCursorPos(State *state, double xpos, double ypos) {
 	double xoffset =  (xpos - state->mouse.last_xpos) * state->mouse.sens;
 	double yoffset = -(ypos - state->mouse.last_ypos) * state->mouse.sens;
 	state->mouse.last_xpos = xpos;
@@ -611,14 +1334,29 @@ void scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
 }
 
 void windowSizeCallback(GLFWwindow* window, int width, int height) {
-	State *state = reinterpret_cast<State*>(glfwGetWindowUserPointer(window));
-	state->scr_res = ivec2(width, height);
+	InputQueue *input = reinterpret_cast<InputQueue*>(glfwGetWindowUserPointer(window));
+	input->resize(ivec2(width, height));
+}
+
+mat4 getModel(vec3 pos, vec3 scale, vec2 front) {
+	const vec3 up = vec3(0.0f, 1.0f, 0.0f);
+
+	// xz
+	vec2 u = vec2(1.0f, 0.0f);
+	vec2 v = front;
+	float angle = std::atan2(u.x*v.x + u.y*v.y, u.x*v.y - u.y*v.x);
+
+	mat4 model(1.0f);
+	model = glm::scale(model, scale);
+	model = glm::translate(model, pos);
+	model = glm::rotate(model, angle, up);
+	return model;
 }
 
-mat4 getView(vec3 model_pos, vec3 front, vec3 up, bool cam_zero) {
-	vec3 radius = 2.0f * front;
+mat4 getView(vec3 model_pos, vec3 front, vec3 up, bool cam_zero, float boom) {
+	vec3 radius = boom * front;
 	if (!cam_zero) {
-		model_pos.y += 1.3f;
+		model_pos.y += CAMERA_HEIGHT;
 		return glm::lookAt(model_pos - radius, model_pos, up);
 	} else {
 		return glm::lookAt(vec3(0.0), radius, up);